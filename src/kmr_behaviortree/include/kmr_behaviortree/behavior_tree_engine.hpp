@@ -12,13 +12,21 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include "rclcpp/rclcpp.hpp"
 #include "behaviortree_cpp_v3/behavior_tree.h"
 #include "behaviortree_cpp_v3/bt_factory.h"
 #include "behaviortree_cpp_v3/xml_parsing.h"
+#include "kmr_behaviortree/tick_notifier.hpp"
+#include "kmr_behaviortree/tick_profiler.hpp"
 
 
 namespace kmr_behavior_tree
@@ -30,7 +38,7 @@ class BehaviorTreeEngine
 {
 public:
   explicit BehaviorTreeEngine(const std::vector<std::string> & plugin_libraries);
-  virtual ~BehaviorTreeEngine() {}
+  virtual ~BehaviorTreeEngine();
 
   BtStatus run(
     BT::Tree * tree,
@@ -38,10 +46,69 @@ public:
     std::function<bool()> cancelRequested,
     std::chrono::milliseconds loopTimeout = std::chrono::milliseconds(10));
 
+  // Alternative to run() which re-ticks the tree as soon as the tick notifier is signalled,
+  // e.g. when an action result arrives. loopTimeout is only used as a fallback period.
+  BtStatus runEventDriven(
+    BT::Tree * tree,
+    std::function<void()> onLoop,
+    std::function<bool()> cancelRequested,
+    std::chrono::milliseconds loopTimeout = std::chrono::milliseconds(10));
+
+  // Same as above with the notifier and profiler of the caller instead of the engine's own, for
+  // trees run concurrently from several threads, e.g. one per robot in fleet mode. The profiler
+  // may be null.
+  BtStatus run(
+    BT::Tree * tree,
+    std::function<void()> onLoop,
+    std::function<bool()> cancelRequested,
+    TickProfiler::Ptr profiler,
+    std::chrono::milliseconds loopTimeout = std::chrono::milliseconds(10));
+
+  BtStatus runEventDriven(
+    BT::Tree * tree,
+    std::function<void()> onLoop,
+    std::function<bool()> cancelRequested,
+    TickNotifier::Ptr notifier,
+    TickProfiler::Ptr profiler,
+    std::chrono::milliseconds loopTimeout = std::chrono::milliseconds(10));
+
+  // The notifier should be put on the blackboard as "tick_notifier" for the nodes to use it
+  TickNotifier::Ptr getTickNotifier() {return tick_notifier_;}
+
+  // Profile every run of the tree. The profiler should also be put on the blackboard as
+  // "tick_profiler" for the action nodes to report their server waits. Null disables it.
+  void setTickProfiler(TickProfiler::Ptr profiler) {tick_profiler_ = profiler;}
+
+  // Spin the node used by the BT nodes on a background multi-threaded executor owned by the
+  // engine. Result, feedback and status callbacks are then handled concurrently with the
+  // ticks, so the nodes must not spin the node themselves. Zero threads means one per core.
+  void startCallbackExecutor(rclcpp::Node::SharedPtr node, size_t number_of_threads = 0);
+  // Spin one more node on the executor started above, so several robots share its threads
+  void addCallbackNode(rclcpp::Node::SharedPtr node);
+  void stopCallbackExecutor();
+
   BT::Tree buildTreeFromText(
     const std::string & xml_string,
     BT::Blackboard::Ptr blackboard);
 
+  // Returns the tree built from xml_string on blackboard, which is only built the first time.
+  // The trees are kept by the engine, so switching between them does not parse the XML or
+  // construct the nodes again. Safe to call from several threads.
+  BT::Tree * getTree(
+    const std::string & xml_string,
+    BT::Blackboard::Ptr blackboard);
+
+  // Same as getTree() for the tree in a file, which may include other tree files. Relative
+  // include paths are resolved from the directory of the file. The cache is keyed by the text
+  // of the file itself, so the included files must not change while the engine is running.
+  BT::Tree * getTreeFromFile(
+    const std::string & filename,
+    BT::Blackboard::Ptr blackboard);
+
+  // The literal frames of the PlanManipulatorPath nodes in the order they appear in the tree.
+  // Frames only known at runtime (blackboard entries and object poses) are left out.
+  std::vector<std::string> getStaticPlanFrames(BT::Tree * tree);
+
   void haltAllActions(BT::TreeNode * root_node)
   {
   // Halts the node
@@ -59,19 +126,46 @@ public:
     BT::applyRecursiveVisitor(root_node, visitor);
   }
 
-  // In order to re-run a Behavior Tree, we must be able to reset all nodes to the initial state
-  //void resetTree(BT::TreeNode * root_node)
-  //{
-   // Deprecated, no need to set node status to idle
-    //auto visitor = [](BT::TreeNode * node) {
-        //node->setStatus(BT::NodeStatus::IDLE);
-      //};
-    //BT::applyRecursiveVisitor(root_node, visitor);
-  //}
+  // In order to re-run a Behavior Tree, we must be able to reset all nodes to the initial state.
+  // Halts what is still running and sets the nodes left in SUCCESS or FAILURE back to IDLE.
+  void resetTree(BT::Tree * tree);
 
 protected:
+  // Returns the cached tree for xml_string and blackboard, or caches the one made by build
+  BT::Tree * getCachedTree(
+    const std::string & xml_string,
+    BT::Blackboard::Ptr blackboard,
+    const std::function<BT::Tree()> & build);
+
+  // Ticks the tree once and reports the tick to the profiler, if any
+  BT::NodeStatus tickOnce(
+    BT::Tree * tree, std::chrono::milliseconds loopTimeout,
+    const TickProfiler::Ptr & profiler);
+
+  BtStatus finishRun(BtStatus status, const TickProfiler::Ptr & profiler);
+
   // The factory that will be used to dynamically construct the behavior tree
   BT::BehaviorTreeFactory factory_;
+
+  // Used by runEventDriven to wake up the tick loop
+  TickNotifier::Ptr tick_notifier_;
+
+  // Optional, records the timing of the runs
+  TickProfiler::Ptr tick_profiler_;
+
+  // The trees built by getTree, by the hash of their XML
+  struct CachedTree
+  {
+    std::string xml_string;
+    BT::Blackboard::Ptr blackboard;
+    std::unique_ptr<BT::Tree> tree;
+  };
+  std::unordered_multimap<size_t, CachedTree> tree_cache_;
+  std::mutex tree_cache_mutex_;
+
+  // Handles the callbacks of all action clients created by the BT nodes
+  std::shared_ptr<rclcpp::executors::MultiThreadedExecutor> callback_executor_;
+  std::thread callback_thread_;
 };
 
 }  // namespace kmr_behavior_tree
@@ -15,12 +15,18 @@
 #ifndef KMR_BEHAVIOR_TREE__BT_ACTION_NODE_HPP_
 #define KMR_BEHAVIOR_TREE__BT_ACTION_NODE_HPP_
 
+#include <atomic>
+#include <chrono>
+#include <future>
 #include <memory>
 #include <string>
 #include <iostream>
 
 #include "behaviortree_cpp_v3/action_node.h"
+#include "kmr_behaviortree/client_registry.hpp"
 #include "kmr_behaviortree/node_utils.hpp"
+#include "kmr_behaviortree/tick_notifier.hpp"
+#include "kmr_behaviortree/tick_profiler.hpp"
 #include "rclcpp_action/rclcpp_action.hpp"
 
 namespace kmr_behavior_tree
@@ -38,6 +44,11 @@ public:
   {
     node_ = config().blackboard->get<rclcpp::Node::SharedPtr>("node");
 
+    // Optional, only present when the tree is run by BehaviorTreeEngine::runEventDriven
+    config().blackboard->get<TickNotifier::Ptr>("tick_notifier", tick_notifier_);
+    // Optional, only present when the runs are profiled
+    config().blackboard->get<TickProfiler::Ptr>("tick_profiler", tick_profiler_);
+
     // Initialize the input and output messages
     goal_ = typename ActionT::Goal();
     result_ = typename rclcpp_action::ClientGoalHandle<ActionT>::WrappedResult();
@@ -47,6 +58,7 @@ public:
       action_name_ = remapped_action_name;
     }
     createActionClient(action_name_);
+    getInput<std::chrono::milliseconds>("server_timeout", server_timeout_);
 
     // Give the derive class a chance to do any initialization
     RCLCPP_INFO(node_->get_logger(), "\"%s\" BtActionNode initialized", xml_tag_name.c_str());
@@ -58,15 +70,18 @@ public:
   {
   }
 
-  // Create instance of an action server
+  // Get the action client for this BT action from the client registry. Clients are shared
+  // between all node instances using the same server, and the server is only looked for on
+  // the first tick.
   void createActionClient(const std::string & action_name)
   {
-    // Now that we have the ROS node to use, create the action client for this BT action
-    action_client_ = rclcpp_action::create_client<ActionT>(node_, action_name);
-
-    // Make sure the server is actually there before continuing
-    RCLCPP_INFO(node_->get_logger(), "Waiting for \"%s\" action server", action_name.c_str());
-    action_client_->wait_for_action_server();
+    ClientRegistry::Ptr registry;
+    if (!config().blackboard->get<ClientRegistry::Ptr>("client_registry", registry)) {
+      // Without a shared registry on the blackboard each node gets a client of its own
+      registry = std::make_shared<ClientRegistry>(node_);
+    }
+    shared_client_ = registry->getActionClient<ActionT>(action_name);
+    action_client_ = shared_client_->client;
   }
 
   // Any subclass of BtActionNode that accepts parameters must provide a providedPorts method
@@ -101,6 +116,12 @@ public:
   {
   }
 
+  // Called from the executor thread for every feedback message of the current goal, so it
+  // must not touch the blackboard. Wake up the tick loop to act on the feedback.
+  virtual void on_feedback(const std::shared_ptr<const typename ActionT::Feedback>/*feedback*/)
+  {
+  }
+
   // Called upon successful completion of the action. A derived class can override this
   // method to put a value on the blackboard, for example.
   virtual BT::NodeStatus on_success()
@@ -133,11 +154,34 @@ public:
       // user defined callback
       on_tick();
 
+      future_goal_handle_ = {};
+    }
+
+    // The goal is sent once the server has been discovered
+    if (!future_goal_handle_.valid()) {
+      if (!is_action_server_ready()) {
+        return BT::NodeStatus::RUNNING;
+      }
       on_new_goal_received();
     }
 
     // The following code corresponds to the "RUNNING" loop
-    if (rclcpp::ok() && !goal_result_available_) {
+    if (rclcpp::ok() && !goal_result_available_.load(std::memory_order_acquire)) {
+      // The goal is sent asynchronously, so wait for the server to answer before going on
+      if (!goal_handle_ && !is_goal_accepted()) {
+        if (TickProfiler::Clock::now() - goal_sent_time_ > server_timeout_) {
+          RCLCPP_ERROR(
+            node_->get_logger(),
+            "No goal response from %s within %ld ms", action_name_.c_str(),
+            static_cast<long>(server_timeout_.count()));
+          // A late response and the result of the goal are ignored from now on
+          ++goal_request_id_;
+          future_goal_handle_ = {};
+          return BT::NodeStatus::FAILURE;
+        }
+        return BT::NodeStatus::RUNNING;
+      }
+
       // user defined callback. May modify the value of "goal_updated_"
       on_wait_for_result();
 
@@ -147,16 +191,19 @@ public:
       {
         goal_updated_ = false;
         on_new_goal_received();
+        return BT::NodeStatus::RUNNING;
       }
 
-      rclcpp::spin_some(node_);
-
-      // check if, after invoking spin_some(), we finally received the result
-      if (!goal_result_available_) {
+      // check if the executor has delivered the result in the meantime
+      if (!goal_result_available_.load(std::memory_order_acquire)) {
         // Yield this Action, returning RUNNING
         return BT::NodeStatus::RUNNING;
       }
     }
+    if (tick_profiler_) {
+      tick_profiler_->addGoal(
+        *this, goal_sent_time_, fromNs(goal_accepted_ns_), fromNs(goal_result_ns_));
+    }
     switch (result_.code) {
       case rclcpp_action::ResultCode::SUCCEEDED:
         return on_success();
@@ -176,17 +223,33 @@ public:
   // make sure to cancel the ROS2 action if it is still running.
   void halt() override
   {
+    // Callbacks of the halted goal are ignored from now on, so its result is not taken for the
+    // result of the next goal
+    ++goal_request_id_;
+    goal_result_available_ = false;
+
+    // A goal which is still waiting for acceptance has to be accepted before it can be cancelled
+    if (status() == BT::NodeStatus::RUNNING && !goal_handle_ && future_goal_handle_.valid()) {
+      if (future_goal_handle_.wait_for(server_timeout_) != std::future_status::ready) {
+        RCLCPP_ERROR(
+          node_->get_logger(),
+          "No goal response from %s before halting", action_name_.c_str());
+      } else {
+        goal_handle_ = future_goal_handle_.get();
+      }
+    }
+
     if (should_cancel_goal()) {
       auto future_cancel = action_client_->async_cancel_goal(goal_handle_);
-      if (rclcpp::spin_until_future_complete(node_, future_cancel) !=
-        rclcpp::executor::FutureReturnCode::SUCCESS)
-      {
+      if (future_cancel.wait_for(server_timeout_) != std::future_status::ready) {
         RCLCPP_ERROR(
           node_->get_logger(),
           "Failed to cancel action server for %s", action_name_.c_str());
       }
     }
 
+    goal_handle_.reset();
+    future_goal_handle_ = {};
     setStatus(BT::NodeStatus::IDLE);
   }
 
@@ -194,11 +257,10 @@ protected:
   bool should_cancel_goal()
   {
     // Shut the node down if it is currently running
-    if (status() != BT::NodeStatus::RUNNING) {
+    if (status() != BT::NodeStatus::RUNNING || !goal_handle_) {
       return false;
     }
 
-    rclcpp::spin_some(node_);
     auto status = goal_handle_->get_status();
 
     // Check if the goal is still executing
@@ -212,45 +274,128 @@ protected:
   }
 
 
+  // Sends the goal without waiting for the server to accept it. The goal handle is
+  // picked up by is_goal_accepted() on one of the following ticks.
   void on_new_goal_received()
   {
+    // Results belonging to a goal that has since been replaced must be ignored. The id is
+    // changed before the flag is cleared, so a late result of the old goal can not set it again.
+    const uint64_t goal_request_id = ++goal_request_id_;
     goal_result_available_ = false;
+    goal_handle_.reset();
+
     auto send_goal_options = typename rclcpp_action::Client<ActionT>::SendGoalOptions();
+    send_goal_options.goal_response_callback =
+      [this, goal_request_id](auto) {
+        if (goal_request_id != goal_request_id_) {
+          return;
+        }
+        goal_accepted_ns_ = toNs(TickProfiler::Clock::now());
+        if (tick_notifier_) {
+          tick_notifier_->notify();
+        }
+      };
+    send_goal_options.feedback_callback =
+      [this, goal_request_id](
+      typename rclcpp_action::ClientGoalHandle<ActionT>::SharedPtr,
+      const std::shared_ptr<const typename ActionT::Feedback> feedback) {
+        if (goal_request_id != goal_request_id_) {
+          return;
+        }
+        on_feedback(feedback);
+      };
     send_goal_options.result_callback =
-      [this](const typename rclcpp_action::ClientGoalHandle<ActionT>::WrappedResult & result) {
-        //if (result.code != rclcpp_action::ResultCode::ABORTED) {
-        //  goal_result_available_ = true;
-        //  result_ = result;
-        //}
-        goal_result_available_ = true;
+      [this, goal_request_id](
+      const typename rclcpp_action::ClientGoalHandle<ActionT>::WrappedResult & result) {
+        if (goal_request_id != goal_request_id_) {
+          return;
+        }
+        goal_result_ns_ = toNs(TickProfiler::Clock::now());
         result_ = result;
+        // Published last, so the tick thread sees the whole result once it sees the flag
+        goal_result_available_.store(true, std::memory_order_release);
+        if (tick_notifier_) {
+          tick_notifier_->notify();
+        }
       };
-    auto future_goal_handle = action_client_->async_send_goal(goal_, send_goal_options);
+    goal_sent_time_ = TickProfiler::Clock::now();
+    goal_accepted_ns_ = toNs(goal_sent_time_);
+    future_goal_handle_ = action_client_->async_send_goal(goal_, send_goal_options);
+  }
 
-    if (rclcpp::spin_until_future_complete(node_, future_goal_handle) !=
-      rclcpp::executor::FutureReturnCode::SUCCESS)
-    {
-      throw std::runtime_error("send_goal failed");
+  // The callbacks store their times as atomic nanosecond counts
+  static int64_t toNs(TickProfiler::Clock::time_point time)
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+  }
+
+  static TickProfiler::Clock::time_point fromNs(int64_t ns)
+  {
+    return TickProfiler::Clock::time_point(
+      std::chrono::duration_cast<TickProfiler::Clock::duration>(std::chrono::nanoseconds(ns)));
+  }
+
+  // Non-blocking check for the action server, replaces waiting for it in the constructor
+  bool is_action_server_ready()
+  {
+    if (action_client_->action_server_is_ready()) {
+      waiting_for_server_ = false;
+      return true;
+    }
+
+    if (!waiting_for_server_) {
+      RCLCPP_INFO(node_->get_logger(), "Waiting for \"%s\" action server", action_name_.c_str());
+      waiting_for_server_ = true;
+    }
+    return false;
+  }
+
+  // Returns true once the server has accepted the goal sent by on_new_goal_received
+  bool is_goal_accepted()
+  {
+    if (future_goal_handle_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      return false;
     }
 
-    goal_handle_ = future_goal_handle.get();
+    goal_handle_ = future_goal_handle_.get();
     if (!goal_handle_) {
       throw std::runtime_error("Goal was rejected by the action server");
     }
+    return true;
   }
 
   std::string action_name_;
+  // Keeps the registry entry, and with it the client and its callback group, alive
+  std::shared_ptr<ClientRegistry::ActionEntry<ActionT>> shared_client_;
   typename std::shared_ptr<rclcpp_action::Client<ActionT>> action_client_;
+  bool waiting_for_server_{false};
 
   // All ROS2 actions have a goal and a result
   typename ActionT::Goal goal_;
   bool goal_updated_{false};
-  bool goal_result_available_{false};
+  // Written by the executor callbacks and read by the tick thread
+  std::atomic<bool> goal_result_available_{false};
+  std::atomic<uint64_t> goal_request_id_{0};
+  std::shared_future<typename rclcpp_action::ClientGoalHandle<ActionT>::SharedPtr>
+  future_goal_handle_;
   typename rclcpp_action::ClientGoalHandle<ActionT>::SharedPtr goal_handle_;
   typename rclcpp_action::ClientGoalHandle<ActionT>::WrappedResult result_;
 
   // The node that will be used for any ROS operations
   rclcpp::Node::SharedPtr node_;
+
+  // How long the server may take to answer a goal, and how long halt() waits for the answer
+  // to a pending goal or cancel request
+  std::chrono::milliseconds server_timeout_{1000};
+
+  // Wakes up the tick loop when a result arrives, may be null
+  TickNotifier::Ptr tick_notifier_;
+
+  // Gets the server waits of every goal, may be null
+  TickProfiler::Ptr tick_profiler_;
+  TickProfiler::Clock::time_point goal_sent_time_;
+  std::atomic<int64_t> goal_accepted_ns_{0};
+  std::atomic<int64_t> goal_result_ns_{0};
 };
 
 }  // namespace kmr_behavior_tree
@@ -15,16 +15,23 @@
 #ifndef NAV2_BEHAVIOR_TREE__BT_SERVICE_NODE_HPP_
 #define NAV2_BEHAVIOR_TREE__BT_SERVICE_NODE_HPP_
 
+#include <atomic>
+#include <chrono>
+#include <future>
 #include <string>
 #include <memory>
 
 #include "behaviortree_cpp_v3/action_node.h"
+#include "kmr_behaviortree/client_registry.hpp"
+#include "kmr_behaviortree/tick_notifier.hpp"
 #include "nav2_util/node_utils.hpp"
 #include "rclcpp/rclcpp.hpp"
 
 namespace nav2_behavior_tree
 {
 
+// Sends the request and yields RUNNING until the response arrives or the deadline given by
+// server_timeout has passed, so the tree is ticked on while the call is in flight.
 template<class ServiceT>
 class BtServiceNode : public BT::CoroActionNode
 {
@@ -36,21 +43,25 @@ public:
   {
     node_ = config().blackboard->get<rclcpp::Node::SharedPtr>("node");
 
-    // Get the required items from the blackboard
-    server_timeout_ =
-      config().blackboard->get<std::chrono::milliseconds>("server_timeout");
+    // Optional, only present when the tree is run by BehaviorTreeEngine::runEventDriven
+    config().blackboard->get<kmr_behavior_tree::TickNotifier::Ptr>("tick_notifier", tick_notifier_);
+
+    // A default for all nodes may be put on the blackboard, the port sets it per node
+    config().blackboard->get<std::chrono::milliseconds>("server_timeout", server_timeout_);
     getInput<std::chrono::milliseconds>("server_timeout", server_timeout_);
 
     // Now that we have node_ to use, create the service client for this BT service
     getInput("service_name", service_name_);
-    service_client_ = node_->create_client<ServiceT>(service_name_);
-
-    // Make sure the server is actually there before continuing
-    RCLCPP_INFO(
-      node_->get_logger(), "Waiting for \"%s\" service",
-      service_name_.c_str());
-    service_client_->wait_for_service();
+    kmr_behavior_tree::ClientRegistry::Ptr registry;
+    if (!config().blackboard->get<kmr_behavior_tree::ClientRegistry::Ptr>(
+        "client_registry", registry))
+    {
+      registry = std::make_shared<kmr_behavior_tree::ClientRegistry>(node_);
+    }
+    shared_client_ = registry->getServiceClient<ServiceT>(service_name_);
+    service_client_ = shared_client_->client;
 
+    // The server is looked for on the first tick, like in BtActionNode
     RCLCPP_INFO(
       node_->get_logger(), "\"%s\" BtServiceNode initialized",
       service_node_name_.c_str());
@@ -80,25 +91,56 @@ public:
     return providedBasicPorts({});
   }
 
-  // The main override required by a BT service
+  // The main override required by a BT service. Runs as a coroutine which is resumed on
+  // every tick. A halt destroys the coroutine stack without running any destructors, so
+  // everything that has to be released is kept in members.
   BT::NodeStatus tick() override
   {
     on_tick();
-    auto future_result = service_client_->async_send_request(request_);
-
-    rclcpp::executor::FutureReturnCode rc;
-    rc = rclcpp::spin_until_future_complete(
-      node_,
-      future_result, server_timeout_);
-    if (rc == rclcpp::executor::FutureReturnCode::SUCCESS) {
-      return BT::NodeStatus::SUCCESS;
-    } else if (rc == rclcpp::executor::FutureReturnCode::TIMEOUT) {
-      RCLCPP_WARN(
-        node_->get_logger(),
-        "Node timed out while executing service call to %s.", service_name_.c_str());
-      on_server_timeout();
+
+    if (!service_client_->service_is_ready()) {
+      RCLCPP_INFO(
+        node_->get_logger(), "Waiting for \"%s\" service",
+        service_name_.c_str());
+      while (!service_client_->service_is_ready()) {
+        setStatusRunningAndYield();
+      }
+    }
+
+    // Responses to requests sent before a halt must not wake up the tree
+    const uint64_t request_id = ++request_id_;
+    future_result_ = service_client_->async_send_request(
+      request_,
+      [this, request_id](typename rclcpp::Client<ServiceT>::SharedFuture) {
+        if (tick_notifier_ && request_id == request_id_) {
+          tick_notifier_->notify();
+        }
+      });
+    deadline_ = std::chrono::steady_clock::now() + server_timeout_;
+
+    // The node is spun by the engine's callback executor, so only check for the response here
+    while (future_result_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      if (std::chrono::steady_clock::now() >= deadline_) {
+        RCLCPP_WARN(
+          node_->get_logger(),
+          "Node timed out while executing service call to %s.", service_name_.c_str());
+        future_result_ = {};
+        on_server_timeout();
+        return BT::NodeStatus::FAILURE;
+      }
+      setStatusRunningAndYield();
     }
-    return BT::NodeStatus::FAILURE;
+
+    auto response = future_result_.get();
+    future_result_ = {};
+    return on_completion(response);
+  }
+
+  void halt() override
+  {
+    ++request_id_;
+    future_result_ = {};
+    BT::CoroActionNode::halt();
   }
 
   // Fill in service request with information if necessary
@@ -107,6 +149,13 @@ public:
     request_ = std::make_shared<typename ServiceT::Request>();
   }
 
+  // Called with the response of the server. A derived class can override this method to
+  // put a value on the blackboard, for example.
+  virtual BT::NodeStatus on_completion(std::shared_ptr<typename ServiceT::Response>/*response*/)
+  {
+    return BT::NodeStatus::SUCCESS;
+  }
+
   // An opportunity to do something after
   // a timeout waiting for a result that hasn't been received yet
   virtual void on_server_timeout()
@@ -115,15 +164,23 @@ public:
 
 protected:
   std::string service_name_, service_node_name_;
+  // Keeps the registry entry, and with it the client and its callback group, alive
+  std::shared_ptr<kmr_behavior_tree::ClientRegistry::ServiceEntry<ServiceT>> shared_client_;
   typename std::shared_ptr<rclcpp::Client<ServiceT>> service_client_;
   std::shared_ptr<typename ServiceT::Request> request_;
 
   // The node that will be used for any ROS operations
   rclcpp::Node::SharedPtr node_;
 
-  // The timeout value while to use in the tick loop while waiting for
-  // a result from the server
-  std::chrono::milliseconds server_timeout_;
+  // How long to wait for the response to a request, counted from when it is sent
+  std::chrono::milliseconds server_timeout_{1000};
+  std::chrono::steady_clock::time_point deadline_;
+
+  typename rclcpp::Client<ServiceT>::SharedFuture future_result_;
+  std::atomic<uint64_t> request_id_{0};
+
+  // Wakes up the tick loop when a response arrives, may be null
+  kmr_behavior_tree::TickNotifier::Ptr tick_notifier_;
 };
 
 }  // namespace nav2_behavior_tree
@@ -0,0 +1,120 @@
+// Copyright 2019 Nina Marie Wahl and Charlotte Heggem.
+// Copyright 2019 Norwegian University of Science and Technology.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KMR_BEHAVIOR_TREE__CLIENT_REGISTRY_HPP_
+#define KMR_BEHAVIOR_TREE__CLIENT_REGISTRY_HPP_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeindex>
+#include <utility>
+
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_action/rclcpp_action.hpp"
+
+namespace kmr_behavior_tree
+{
+
+// Hands out one action or service client per (type, name) to all BT nodes using the same
+// server. The registry only keeps weak references, so a client is destroyed when the last
+// node holding it is destroyed. It is put on the blackboard under "client_registry".
+class ClientRegistry
+{
+public:
+  using Ptr = std::shared_ptr<ClientRegistry>;
+
+  // A client together with the callback group it is serviced in. The group is destroyed
+  // after the client, as the members are destroyed in reverse order.
+  template<class ClientT>
+  struct Entry
+  {
+    rclcpp::CallbackGroup::SharedPtr callback_group;
+    std::shared_ptr<ClientT> client;
+  };
+
+  template<class ActionT>
+  using ActionEntry = Entry<rclcpp_action::Client<ActionT>>;
+
+  template<class ServiceT>
+  using ServiceEntry = Entry<rclcpp::Client<ServiceT>>;
+
+  explicit ClientRegistry(rclcpp::Node::SharedPtr node)
+  : node_(node)
+  {
+  }
+
+  template<class ActionT>
+  std::shared_ptr<ActionEntry<ActionT>> getActionClient(const std::string & action_name)
+  {
+    return getOrCreate<ActionEntry<ActionT>>(
+      action_name,
+      [this, &action_name](rclcpp::CallbackGroup::SharedPtr group) {
+        return rclcpp_action::create_client<ActionT>(node_, action_name, group);
+      });
+  }
+
+  template<class ServiceT>
+  std::shared_ptr<ServiceEntry<ServiceT>> getServiceClient(const std::string & service_name)
+  {
+    return getOrCreate<ServiceEntry<ServiceT>>(
+      service_name,
+      [this, &service_name](rclcpp::CallbackGroup::SharedPtr group) {
+        return node_->create_client<ServiceT>(
+          service_name, rmw_qos_profile_services_default, group);
+      });
+  }
+
+  // Number of clients currently in use, mostly useful for debugging
+  size_t size()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t count = 0;
+    for (const auto & entry : entries_) {
+      if (!entry.second.expired()) {
+        ++count;
+      }
+    }
+    return count;
+  }
+
+private:
+  template<class EntryT, class CreateT>
+  std::shared_ptr<EntryT> getOrCreate(const std::string & name, CreateT create)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto & cached = entries_[std::make_pair(std::type_index(typeid(EntryT)), name)];
+    auto entry = std::static_pointer_cast<EntryT>(cached.lock());
+    if (!entry) {
+      // The node is spun by the engine's executor, and a group per client lets the callbacks
+      // of different clients run in parallel.
+      entry = std::make_shared<EntryT>();
+      entry->callback_group =
+        node_->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+      entry->client = create(entry->callback_group);
+      cached = entry;
+    }
+    return entry;
+  }
+
+  rclcpp::Node::SharedPtr node_;
+  std::mutex mutex_;
+  std::map<std::pair<std::type_index, std::string>, std::weak_ptr<void>> entries_;
+};
+
+}  // namespace kmr_behavior_tree
+
+#endif  // KMR_BEHAVIOR_TREE__CLIENT_REGISTRY_HPP_
@@ -0,0 +1,44 @@
+// Copyright 2019 Nina Marie Wahl and Charlotte Heggem.
+// Copyright 2019 Norwegian University of Science and Technology.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KMR_BEHAVIOR_TREE__MESSAGE_PORTS_HPP_
+#define KMR_BEHAVIOR_TREE__MESSAGE_PORTS_HPP_
+
+#include <memory>
+
+#include "geometry_msgs/msg/pose_stamped.hpp"
+#include "trajectory_msgs/msg/joint_trajectory.hpp"
+
+namespace kmr_behavior_tree
+{
+
+// Messages are passed between the BT nodes as shared pointers to const, so they are put on and
+// taken from the blackboard without being copied. All ports using the same blackboard entry
+// must use the pointer type.
+using JointTrajectoryPtr = std::shared_ptr<const trajectory_msgs::msg::JointTrajectory>;
+using PoseStampedPtr = std::shared_ptr<const geometry_msgs::msg::PoseStamped>;
+
+// Points to a member of an action result without copying it. The result is kept alive for as
+// long as the pointer is in use, also after the action node has received a new result.
+template<typename MemberT, typename ResultT>
+std::shared_ptr<const MemberT> shareResultMember(
+  const std::shared_ptr<ResultT> & result, const MemberT & member)
+{
+  return std::shared_ptr<const MemberT>(result, &member);
+}
+
+}  // namespace kmr_behavior_tree
+
+#endif  // KMR_BEHAVIOR_TREE__MESSAGE_PORTS_HPP_
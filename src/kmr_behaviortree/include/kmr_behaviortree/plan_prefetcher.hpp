@@ -0,0 +1,179 @@
+// Copyright 2019 Nina Marie Wahl and Charlotte Heggem.
+// Copyright 2019 Norwegian University of Science and Technology.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KMR_BEHAVIOR_TREE__PLAN_PREFETCHER_HPP_
+#define KMR_BEHAVIOR_TREE__PLAN_PREFETCHER_HPP_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_action/rclcpp_action.hpp"
+#include "kmr_msgs/action/plan_to_frame.hpp"
+#include "trajectory_msgs/msg/joint_trajectory.hpp"
+#include "kmr_behaviortree/client_registry.hpp"
+#include "kmr_behaviortree/message_ports.hpp"
+#include "kmr_behaviortree/tick_notifier.hpp"
+
+namespace kmr_behavior_tree
+{
+
+// Plans ahead to the next named frame while the manipulator is still moving. The frame
+// sequence is taken from the PlanManipulatorPath nodes of the tree, and the plans are kept
+// per (from frame, to frame) until a PlanManipulatorPath node takes them. It is put on the
+// blackboard under "plan_prefetcher".
+class PlanPrefetcher
+{
+public:
+  using Ptr = std::shared_ptr<PlanPrefetcher>;
+  using PlanToFrame = kmr_msgs::action::PlanToFrame;
+
+  enum class Lookup { HIT, PENDING, MISS };
+
+  PlanPrefetcher(
+    rclcpp::Node::SharedPtr node,
+    ClientRegistry::Ptr registry,
+    TickNotifier::Ptr tick_notifier = nullptr,
+    const std::string & action_name = "/moveit/frame")
+  : node_(node), tick_notifier_(tick_notifier)
+  {
+    shared_client_ = registry->getActionClient<PlanToFrame>(action_name);
+  }
+
+  // The named frames in the order they are planned to in the tree
+  void setFrameSequence(const std::vector<std::string> & frames)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    frames_ = frames;
+  }
+
+  // Called when the manipulator starts moving to frame along path. Requests plans from the
+  // end of path to every frame that can follow frame in the sequence.
+  void prefetchFrom(const std::string & frame, const trajectory_msgs::msg::JointTrajectory & path)
+  {
+    if (path.points.empty() || !shared_client_->client->action_server_is_ready()) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < frames_.size(); ++i) {
+      const auto & next_frame = frames_[(i + 1) % frames_.size()];
+      if (frames_[i] != frame || next_frame == frame) {
+        continue;
+      }
+
+      auto key = std::make_pair(frame, next_frame);
+      if (plans_.count(key)) {
+        continue;
+      }
+      const uint64_t request_id = ++last_request_id_;
+      plans_[key].request_id = request_id;
+
+      PlanToFrame::Goal goal;
+      goal.frame = next_frame;
+      goal.start_state.name = path.joint_names;
+      goal.start_state.position = path.points.back().positions;
+
+      auto send_goal_options = rclcpp_action::Client<PlanToFrame>::SendGoalOptions();
+      send_goal_options.result_callback =
+        [this, key, request_id](
+        const rclcpp_action::ClientGoalHandle<PlanToFrame>::WrappedResult & result) {
+          on_result(key, request_id, result);
+        };
+      shared_client_->client->async_send_goal(goal, send_goal_options);
+      RCLCPP_INFO(
+        node_->get_logger(), "Planning ahead from %s to %s", frame.c_str(), next_frame.c_str());
+    }
+  }
+
+  // Hands out the plan from from_frame to to_frame if there is one. Each plan is only used
+  // once. PENDING means that the plan is still being computed, and the caller should wait for
+  // it instead of asking the planner for the same plan again.
+  Lookup take(
+    const std::string & from_frame, const std::string & to_frame, JointTrajectoryPtr & path)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = plans_.find(std::make_pair(from_frame, to_frame));
+    if (it == plans_.end()) {
+      return Lookup::MISS;
+    }
+    if (!it->second.done) {
+      return Lookup::PENDING;
+    }
+
+    path = it->second.path;
+    plans_.erase(it);
+    return Lookup::HIT;
+  }
+
+  // Forget all plans, e.g. when the environment has changed. Pending requests are ignored
+  // when they complete.
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    plans_.clear();
+  }
+
+private:
+  struct Plan
+  {
+    uint64_t request_id{0};
+    bool done{false};
+    JointTrajectoryPtr path;
+  };
+
+  void on_result(
+    const std::pair<std::string, std::string> & key,
+    uint64_t request_id,
+    const rclcpp_action::ClientGoalHandle<PlanToFrame>::WrappedResult & result)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = plans_.find(key);
+      if (it == plans_.end() || it->second.request_id != request_id) {
+        return;
+      }
+
+      // Failed plans are dropped, so the PlanManipulatorPath node plans on its own
+      if (result.code == rclcpp_action::ResultCode::SUCCEEDED && result.result->success) {
+        it->second.done = true;
+        it->second.path = shareResultMember(result.result, result.result->path);
+      } else {
+        plans_.erase(it);
+      }
+    }
+
+    if (tick_notifier_) {
+      tick_notifier_->notify();
+    }
+  }
+
+  rclcpp::Node::SharedPtr node_;
+  TickNotifier::Ptr tick_notifier_;
+  std::shared_ptr<ClientRegistry::ActionEntry<PlanToFrame>> shared_client_;
+
+  std::mutex mutex_;
+  std::vector<std::string> frames_;
+  uint64_t last_request_id_{0};
+  std::map<std::pair<std::string, std::string>, Plan> plans_;
+};
+
+}  // namespace kmr_behavior_tree
+
+#endif  // KMR_BEHAVIOR_TREE__PLAN_PREFETCHER_HPP_
@@ -0,0 +1,63 @@
+// Copyright 2019 Nina Marie Wahl and Charlotte Heggem.
+// Copyright 2019 Norwegian University of Science and Technology.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KMR_BEHAVIOR_TREE__TICK_NOTIFIER_HPP_
+#define KMR_BEHAVIOR_TREE__TICK_NOTIFIER_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+namespace kmr_behavior_tree
+{
+
+// Wakes up the tick loop of the BehaviorTreeEngine when something has happened that
+// the tree should react to, e.g. an action result arriving or a blackboard update.
+// It is put on the blackboard under "tick_notifier" so that the BT nodes can reach it.
+class TickNotifier
+{
+public:
+  using Ptr = std::shared_ptr<TickNotifier>;
+
+  // Request a new tick. Safe to call from any thread, including executor callbacks
+  void notify()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_ = true;
+    }
+    cv_.notify_all();
+  }
+
+  // Block until notify() has been called or the timeout expires.
+  // Returns true if woken up by a notification, false on timeout.
+  bool waitFor(std::chrono::milliseconds timeout)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool notified = cv_.wait_for(lock, timeout, [this] {return pending_;});
+    pending_ = false;
+    return notified;
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool pending_{false};
+};
+
+}  // namespace kmr_behavior_tree
+
+#endif  // KMR_BEHAVIOR_TREE__TICK_NOTIFIER_HPP_
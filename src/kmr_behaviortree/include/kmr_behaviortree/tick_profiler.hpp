@@ -0,0 +1,335 @@
+// Copyright 2019 Nina Marie Wahl and Charlotte Heggem.
+// Copyright 2019 Norwegian University of Science and Technology.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KMR_BEHAVIOR_TREE__TICK_PROFILER_HPP_
+#define KMR_BEHAVIOR_TREE__TICK_PROFILER_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rclcpp/rclcpp.hpp"
+#include "behaviortree_cpp_v3/behavior_tree.h"
+#include "behaviortree_cpp_v3/loggers/abstract_logger.h"
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
+
+namespace kmr_behavior_tree
+{
+
+// Records where the time of a run of the tree goes: how long every node is RUNNING and how
+// often it is ticked, how long the action nodes wait for their server to accept a goal and
+// for the result, and how often a tick takes longer than the loop period. After every run a
+// summary is published on "bt_profile", and if a trace directory is given the run is written
+// to it as a Chrome trace (chrome://tracing or ui.perfetto.dev).
+// It is set on the BehaviorTreeEngine and put on the blackboard under "tick_profiler". All
+// calls are made from the thread ticking the tree.
+class TickProfiler
+{
+public:
+  using Ptr = std::shared_ptr<TickProfiler>;
+  using Clock = std::chrono::steady_clock;
+
+  // The traces are named <trace_name>_<time>_<run>.json, so that several profilers can share
+  // the directory
+  TickProfiler(
+    rclcpp::Node::SharedPtr node, const std::string & trace_directory = "",
+    const std::string & trace_name = "bt_profile")
+  : node_(node), trace_directory_(trace_directory), trace_name_(trace_name)
+  {
+    publisher_ = node_->create_publisher<diagnostic_msgs::msg::DiagnosticArray>("bt_profile", 10);
+  }
+
+  // Called by the engine before the first tick of a run
+  void startRun(BT::Tree * tree)
+  {
+    nodes_.clear();
+    running_since_.clear();
+    events_.clear();
+    ticks_ = 0;
+    overruns_ = 0;
+    max_overrun_ = Clock::duration::zero();
+    run_start_ = Clock::now();
+    logger_ = std::make_unique<StatusLogger>(this, tree->rootNode());
+
+    auto visitor = [this](BT::TreeNode * node) {
+        auto & stats = nodes_[node->UID()];
+        stats.name = node->name();
+        stats.type = node->registrationName();
+      };
+    BT::applyRecursiveVisitor(tree->rootNode(), visitor);
+  }
+
+  // Called by the engine after every tick. started is when the tick began, and period the
+  // time the tick loop has for one tick.
+  void endTick(BT::Tree * tree, Clock::time_point started, std::chrono::milliseconds period)
+  {
+    const auto now = Clock::now();
+    ++ticks_;
+
+    // A RUNNING node is ticked on every tick of the tree until it finishes, which is counted
+    // by the status change
+    auto visitor = [this](BT::TreeNode * node) {
+        if (node->status() == BT::NodeStatus::RUNNING) {
+          ++nodes_[node->UID()].ticks;
+        }
+      };
+    BT::applyRecursiveVisitor(tree->rootNode(), visitor);
+
+    const auto overrun = (now - started) - period;
+    if (overrun > Clock::duration::zero()) {
+      ++overruns_;
+      if (overrun > max_overrun_) {
+        max_overrun_ = overrun;
+      }
+      events_.push_back({"tick overrun", "tick", started, now - started, kTreeTrack});
+    }
+  }
+
+  // Called by the action nodes when the result of a goal has been received
+  void addGoal(
+    const BT::TreeNode & node, Clock::time_point sent, Clock::time_point accepted,
+    Clock::time_point result)
+  {
+    auto & stats = nodes_[node.UID()];
+    ++stats.goals;
+    stats.accept_wait += accepted - sent;
+    stats.result_wait += result - accepted;
+    const uint32_t track = kServerTrack + node.UID();
+    events_.push_back({node.name() + " accept", "server", sent, accepted - sent, track});
+    events_.push_back({node.name() + " result", "server", accepted, result - accepted, track});
+  }
+
+  // Called by the engine when the run has finished or was canceled
+  void stopRun(const std::string & result)
+  {
+    const auto now = Clock::now();
+    // Nodes still RUNNING, e.g. on cancel, are counted up to the end of the run
+    for (const auto & running : running_since_) {
+      addRunning(running.first, running.second, now);
+    }
+    running_since_.clear();
+    logger_.reset();
+    ++runs_;
+
+    publishSummary(result, now - run_start_);
+    if (!trace_directory_.empty()) {
+      writeTrace(result, now);
+    }
+  }
+
+private:
+  struct NodeStats
+  {
+    std::string name;
+    std::string type;
+    uint64_t ticks{0};
+    Clock::duration running{Clock::duration::zero()};
+    uint64_t goals{0};
+    Clock::duration accept_wait{Clock::duration::zero()};
+    Clock::duration result_wait{Clock::duration::zero()};
+  };
+
+  struct TraceEvent
+  {
+    std::string name;
+    std::string category;
+    Clock::time_point start;
+    Clock::duration duration;
+    uint32_t track;
+  };
+
+  // The RUNNING spans of the tree nodes nest, so they share a track. Every action node gets a
+  // track of its own for the server waits.
+  static constexpr uint32_t kTreeTrack = 1;
+  static constexpr uint32_t kServerTrack = 1000;
+
+  class StatusLogger : public BT::StatusChangeLogger
+  {
+  public:
+    StatusLogger(TickProfiler * profiler, BT::TreeNode * root_node)
+    : BT::StatusChangeLogger(root_node), profiler_(profiler) {}
+
+    void callback(
+      BT::Duration, const BT::TreeNode & node, BT::NodeStatus prev_status,
+      BT::NodeStatus status) override
+    {
+      profiler_->statusChanged(node, prev_status, status);
+    }
+
+    void flush() override {}
+
+  private:
+    TickProfiler * profiler_;
+  };
+
+  void statusChanged(const BT::TreeNode & node, BT::NodeStatus prev_status, BT::NodeStatus status)
+  {
+    const auto now = Clock::now();
+    if (status == BT::NodeStatus::RUNNING) {
+      running_since_[node.UID()] = now;
+      return;
+    }
+
+    auto running = running_since_.find(node.UID());
+    if (running != running_since_.end()) {
+      addRunning(node.UID(), running->second, now);
+      running_since_.erase(running);
+    }
+    // The tick that finished the node, halting is not a tick
+    if (status != BT::NodeStatus::IDLE && prev_status != status) {
+      ++nodes_[node.UID()].ticks;
+    }
+  }
+
+  void addRunning(uint16_t uid, Clock::time_point since, Clock::time_point until)
+  {
+    auto & stats = nodes_[uid];
+    stats.running += until - since;
+    events_.push_back({stats.name, stats.type, since, until - since, kTreeTrack});
+  }
+
+  static double toMs(Clock::duration duration)
+  {
+    return std::chrono::duration<double, std::milli>(duration).count();
+  }
+
+  static diagnostic_msgs::msg::KeyValue keyValue(const std::string & key, const std::string & value)
+  {
+    diagnostic_msgs::msg::KeyValue kv;
+    kv.key = key;
+    kv.value = value;
+    return kv;
+  }
+
+  void publishSummary(const std::string & result, Clock::duration run_time)
+  {
+    diagnostic_msgs::msg::DiagnosticArray msg;
+    msg.header.stamp = node_->now();
+
+    diagnostic_msgs::msg::DiagnosticStatus loop;
+    loop.name = "bt_profile: tick loop";
+    loop.hardware_id = node_->get_name();
+    loop.level = overruns_ > 0 ? diagnostic_msgs::msg::DiagnosticStatus::WARN :
+      diagnostic_msgs::msg::DiagnosticStatus::OK;
+    loop.message = result;
+    loop.values.push_back(keyValue("run", std::to_string(runs_)));
+    loop.values.push_back(keyValue("run time ms", std::to_string(toMs(run_time))));
+    loop.values.push_back(keyValue("ticks", std::to_string(ticks_)));
+    loop.values.push_back(keyValue("overruns", std::to_string(overruns_)));
+    loop.values.push_back(keyValue("max overrun ms", std::to_string(toMs(max_overrun_))));
+    msg.status.push_back(loop);
+
+    for (const auto & entry : nodes_) {
+      const auto & stats = entry.second;
+      if (stats.ticks == 0) {
+        continue;
+      }
+      diagnostic_msgs::msg::DiagnosticStatus status;
+      status.name = "bt_profile: " + stats.name;
+      status.hardware_id = stats.type;
+      status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+      status.values.push_back(keyValue("ticks", std::to_string(stats.ticks)));
+      status.values.push_back(keyValue("running ms", std::to_string(toMs(stats.running))));
+      if (stats.goals > 0) {
+        status.values.push_back(keyValue("goals", std::to_string(stats.goals)));
+        status.values.push_back(keyValue("accept wait ms", std::to_string(toMs(stats.accept_wait))));
+        status.values.push_back(keyValue("result wait ms", std::to_string(toMs(stats.result_wait))));
+      }
+      msg.status.push_back(status);
+    }
+    publisher_->publish(msg);
+  }
+
+  static std::string escape(const std::string & text)
+  {
+    std::string escaped;
+    for (char c : text) {
+      if (c == '"' || c == '\\') {
+        escaped += '\\';
+        escaped += c;
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        char code[8];
+        std::snprintf(code, sizeof(code), "\\u%04x", c);
+        escaped += code;
+      } else {
+        escaped += c;
+      }
+    }
+    return escaped;
+  }
+
+  void writeTrace(const std::string & result, Clock::time_point end)
+  {
+    const auto wall_time = std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+    const std::string filename = trace_directory_ + "/" + trace_name_ + "_" + std::to_string(wall_time) +
+      "_" + std::to_string(runs_) + ".json";
+    std::ofstream file(filename);
+    if (!file.good()) {
+      RCLCPP_ERROR(node_->get_logger(), "Couldn't write BT profile: %s", filename.c_str());
+      return;
+    }
+
+    auto us = [this](Clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(time - run_start_).count();
+      };
+
+    file << "{\"traceEvents\":[\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << kTreeTrack <<
+      ",\"args\":{\"name\":\"tree\"}}";
+    for (const auto & entry : nodes_) {
+      if (entry.second.goals > 0) {
+        file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" <<
+          kServerTrack + entry.first << ",\"args\":{\"name\":\"" << escape(entry.second.name) <<
+          " server\"}}";
+      }
+    }
+    file << ",\n{\"name\":\"run\",\"cat\":\"run\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":0" <<
+      ",\"dur\":" << us(end) << ",\"args\":{\"result\":\"" << escape(result) <<
+      "\",\"ticks\":" << ticks_ << ",\"overruns\":" << overruns_ << "}}";
+    for (const auto & event : events_) {
+      file << ",\n{\"name\":\"" << escape(event.name) << "\",\"cat\":\"" <<
+        escape(event.category) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.track <<
+        ",\"ts\":" << us(event.start) << ",\"dur\":" <<
+        std::chrono::duration_cast<std::chrono::microseconds>(event.duration).count() << "}";
+    }
+    file << "\n]}\n";
+    RCLCPP_INFO(node_->get_logger(), "BT profile written to %s", filename.c_str());
+  }
+
+  rclcpp::Node::SharedPtr node_;
+  std::string trace_directory_;
+  std::string trace_name_;
+  rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr publisher_;
+  std::unique_ptr<StatusLogger> logger_;
+
+  uint64_t runs_{0};
+  Clock::time_point run_start_;
+  uint64_t ticks_{0};
+  uint64_t overruns_{0};
+  Clock::duration max_overrun_{Clock::duration::zero()};
+  std::map<uint16_t, NodeStats> nodes_;
+  std::map<uint16_t, Clock::time_point> running_since_;
+  std::vector<TraceEvent> events_;
+};
+
+}  // namespace kmr_behavior_tree
+
+#endif  // KMR_BEHAVIOR_TREE__TICK_PROFILER_HPP_
@@ -33,6 +33,9 @@ def generate_launch_description():
         get_package_share_directory('kmr_behaviortree'),
         'behavior_trees',
         xml_file_name)
+    # Built at startup as well, so they can be started by name on the start topic
+    xml_files = [os.path.join(get_package_share_directory('kmr_behaviortree'), 'behavior_trees', name)
+                 for name in ['full_tree.xml', 'mission_tree.xml', 'sweep_tree.xml', 'test.xml']]
     bt_param_dir = LaunchConfiguration(
         'bt_param_dir',
         default=os.path.join(
@@ -57,7 +60,7 @@ def generate_launch_description():
             executable="behavior_tree_node",
             name="behavior_tree_node",
             output='screen',
-            parameters=[{'bt_xml_filename': xml}, bt_param_dir],
+            parameters=[{'bt_xml_filename': xml, 'bt_xml_filenames': xml_files}, bt_param_dir],
             emulate_tty=True,
             ),
 
@@ -0,0 +1,112 @@
+// Copyright 2019 Nina Marie Wahl and Charlotte Heggem.
+// Copyright 2019 Norwegian University of Science and Technology.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "kmr_behaviortree/bt_action_node.hpp"
+#include "kmr_behaviortree/message_ports.hpp"
+#include "kmr_msgs/action/object_search.hpp"
+
+
+namespace kmr_behavior_tree
+{
+
+// Searches for an object until one is detected or the node is halted. Meant to run in a
+// Parallel node next to the moves through the search frames, which are preempted when the
+// search succeeds.
+class ContinuousObjectSearchAction : public BtActionNode<kmr_msgs::action::ObjectSearch>
+{
+public:
+  ContinuousObjectSearchAction(
+    const std::string & xml_tag_name,
+    const std::string & action_name,
+    const BT::NodeConfiguration & conf)
+  : BtActionNode<kmr_msgs::action::ObjectSearch>(xml_tag_name, action_name, conf)
+  {
+  }
+
+  void on_tick() override
+  {
+    goal_.continuous = true;
+    goal_.timeout = 0.0;
+    goal_.detection_threshold = 0.0;
+    getInput("timeout", goal_.timeout);
+    getInput("detection_threshold", goal_.detection_threshold);
+    best_probability_ = 0.0;
+    RCLCPP_INFO(node_->get_logger(),"Start continuous search for object");
+  }
+
+  void on_feedback(
+    const std::shared_ptr<const kmr_msgs::action::ObjectSearch::Feedback> feedback) override
+  {
+    float best = best_probability_;
+    while (feedback->probability > best &&
+      !best_probability_.compare_exchange_weak(best, feedback->probability))
+    {
+    }
+  }
+
+  BT::NodeStatus on_success() override
+  {
+    setOutput("object_pose", shareResultMember(result_.result, result_.result->pose));
+    RCLCPP_INFO(node_->get_logger(),"ObjectPose received");
+    return BT::NodeStatus::SUCCESS;
+  }
+
+  BT::NodeStatus on_aborted() override
+  {
+    RCLCPP_INFO(
+      node_->get_logger(),"No object found, best detection %.2f", best_probability_.load());
+    return BT::NodeStatus::FAILURE;
+  }
+
+  BT::NodeStatus on_cancelled() override
+  {
+    return BT::NodeStatus::FAILURE;
+  }
+
+  static BT::PortsList providedPorts()
+  {
+    return providedBasicPorts(
+      {
+        BT::OutputPort<PoseStampedPtr>("object_pose", "Pose of object found by object search"),
+        BT::InputPort<float>("timeout", "Seconds to search, the server default if not set"),
+        BT::InputPort<float>(
+          "detection_threshold", "Lowest accepted probability, the server default if not set"),
+      });
+  }
+
+private:
+  // Highest probability in the feedback, written by the executor
+  std::atomic<float> best_probability_{0.0};
+};
+
+}  // namespace kmr_behavior_tree
+
+#include "behaviortree_cpp_v3/bt_factory.h"
+BT_REGISTER_NODES(factory)
+{
+  BT::NodeBuilder builder =
+    [](const std::string & name, const BT::NodeConfiguration & config)
+    {
+      return std::make_unique<kmr_behavior_tree::ContinuousObjectSearchAction>(
+        name, "object_search", config);
+    };
+
+  factory.registerBuilder<kmr_behavior_tree::ContinuousObjectSearchAction>(
+    "ContinuousObjectSearch", builder);
+}
@@ -16,6 +16,7 @@
 
 #include "kmr_behaviortree/bt_action_node.hpp"
 #include "kmr_msgs/action/gripper.hpp"
+#include "std_msgs/msg/string.hpp"
 
 
 namespace kmr_behavior_tree
@@ -29,6 +30,9 @@ public:
     const BT::NodeConfiguration & conf)
   : BtActionNode<kmr_msgs::action::Gripper>(xml_tag_name, action_name, conf)
   {
+    // Tells run_moveit to add the object left in a carry area to the planning scene
+    carry_area_publisher_ = node_->create_publisher<std_msgs::msg::String>(
+      "/moveit/carry_area_occupied", rclcpp::QoS(10).transient_local());
   }
 
   void on_tick() override
@@ -45,6 +49,9 @@ public:
       current_frame = config().blackboard->get<std::string>("current_frame");
       if (current_frame.compare("carryarea1") == 0 || current_frame.compare("carryarea2") == 0 || current_frame.compare("carryarea3") == 0 ){
         config().blackboard->set(current_frame, false);
+        std_msgs::msg::String msg;
+        msg.data = current_frame;
+        carry_area_publisher_->publish(msg);
       }
     }else{
       RCLCPP_INFO(node_->get_logger(),"Gripper closed successfully");
@@ -62,6 +69,7 @@ public:
 
   private:
     std::string action;
+    rclcpp::Publisher<std_msgs::msg::String>::SharedPtr carry_area_publisher_;
 };
 
 }  // namespace kmr_behavior_tree
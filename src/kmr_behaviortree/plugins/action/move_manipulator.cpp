@@ -15,8 +15,9 @@
 // limitations under the License.
 
 #include "kmr_behaviortree/bt_action_node.hpp"
+#include "kmr_behaviortree/message_ports.hpp"
+#include "kmr_behaviortree/plan_prefetcher.hpp"
 #include "kmr_msgs/action/move_manipulator.hpp"
-#include "trajectory_msgs/msg/joint_trajectory.hpp"
 
 
 namespace kmr_behavior_tree
@@ -30,14 +31,24 @@ public:
     const BT::NodeConfiguration & conf)
   : BtActionNode<kmr_msgs::action::MoveManipulator>(xml_tag_name, action_name, conf)
   {
+    // Only present when planning ahead is enabled
+    config().blackboard->get<PlanPrefetcher::Ptr>("plan_prefetcher", prefetcher_);
   }
 
   void on_tick() override
   {
-    
-    getInput("path", goal_.path);
+    // The goal needs its own copy, the path on the blackboard is shared
+    JointTrajectoryPtr path;
+    if (getInput("path", path) && path) {
+      goal_.path = *path;
+    }
     getInput("move_to_frame", current_frame);
     RCLCPP_INFO(node_->get_logger(),"Start moving to %s", current_frame.c_str());
+
+    // Plan the next motion while this one is executed
+    if (prefetcher_ && !current_frame.empty()) {
+      prefetcher_->prefetchFrom(current_frame, goal_.path);
+    }
   }
 
   BT::NodeStatus on_success() override
@@ -53,12 +64,13 @@ public:
   {
     return providedBasicPorts(
       {
-        BT::InputPort<trajectory_msgs::msg::JointTrajectory>("path", "The path MoveIt has planned for the manipulator"),
+        BT::InputPort<JointTrajectoryPtr>("path", "The path MoveIt has planned for the manipulator"),
         BT::InputPort<std::string>("move_to_frame", "The frame the manipulator is currently moving to"),
       });
   }
   private:
     std::string current_frame;
+    PlanPrefetcher::Ptr prefetcher_;
 };
 
 }  // namespace kmr_behavior_tree
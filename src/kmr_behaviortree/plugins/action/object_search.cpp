@@ -15,6 +15,7 @@
 // limitations under the License.
 
 #include "kmr_behaviortree/bt_action_node.hpp"
+#include "kmr_behaviortree/message_ports.hpp"
 #include "kmr_msgs/action/object_search.hpp"
 #include "iostream"
 
@@ -39,7 +40,7 @@ public:
 
   BT::NodeStatus on_success() override
   {
-    setOutput("object_pose", result_.result->pose);
+    setOutput("object_pose", shareResultMember(result_.result, result_.result->pose));
     RCLCPP_INFO(node_->get_logger(),"ObjectPose received");
     return BT::NodeStatus::SUCCESS;
   }
@@ -54,7 +55,7 @@ public:
   {
     return providedBasicPorts(
       {
-        BT::OutputPort<geometry_msgs::msg::PoseStamped>("object_pose", "Pose of object found by object search"),
+        BT::OutputPort<PoseStampedPtr>("object_pose", "Pose of object found by object search"),
       });
   }
 };
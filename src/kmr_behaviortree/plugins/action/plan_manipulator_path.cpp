@@ -15,9 +15,9 @@
 // limitations under the License.
 
 #include "kmr_behaviortree/bt_action_node.hpp"
+#include "kmr_behaviortree/message_ports.hpp"
+#include "kmr_behaviortree/plan_prefetcher.hpp"
 #include "kmr_msgs/action/plan_to_frame.hpp"
-#include "trajectory_msgs/msg/joint_trajectory.hpp"
-#include <geometry_msgs/msg/pose_stamped.hpp>
 #include <iostream>
 
 namespace kmr_behavior_tree
@@ -31,6 +31,46 @@ public:
     const BT::NodeConfiguration & conf)
   : BtActionNode<kmr_msgs::action::PlanToFrame>(xml_tag_name, action_name, conf)
   {
+    // Only present when planning ahead is enabled
+    config().blackboard->get<PlanPrefetcher::Ptr>("plan_prefetcher", prefetcher_);
+  }
+
+  BT::NodeStatus tick() override
+  {
+    if (status() == BT::NodeStatus::IDLE) {
+      check_prefetched_ = prefetcher_ != nullptr;
+    }
+
+    if (check_prefetched_) {
+      std::string current_frame;
+      std::string frame;
+      JointTrajectoryPtr path;
+      getInput("plan_to_frame", frame);
+      config().blackboard->get("current_frame", current_frame);
+
+      switch (prefetcher_->take(current_frame, frame, path)) {
+        case PlanPrefetcher::Lookup::HIT:
+          RCLCPP_INFO(node_->get_logger(),"Using plan computed ahead from %s to %s", current_frame.c_str(), frame.c_str());
+          check_prefetched_ = false;
+          plan_to_frame = frame;
+          setOutput("manipulator_path", path);
+          setOutput("move_to_frame", plan_to_frame);
+          return BT::NodeStatus::SUCCESS;
+
+        case PlanPrefetcher::Lookup::PENDING:
+          // Wait for the plan which is already being computed instead of planning again
+          setStatus(BT::NodeStatus::RUNNING);
+          return BT::NodeStatus::RUNNING;
+
+        case PlanPrefetcher::Lookup::MISS:
+          // Plan as usual, starting the action from the beginning
+          check_prefetched_ = false;
+          setStatus(BT::NodeStatus::IDLE);
+          break;
+      }
+    }
+
+    return BtActionNode<kmr_msgs::action::PlanToFrame>::tick();
   }
 
   void on_tick() override
@@ -42,15 +82,16 @@ public:
     goal_.frame = plan_to_frame;
     RCLCPP_INFO(node_->get_logger(),"Start planning to %s", plan_to_frame.c_str());
     if (plan_to_frame == "object"){
-      geometry_msgs::msg::PoseStamped pose_msg;
-      getInput("object_pose",pose_msg);
-      goal_.pose = pose_msg;
+      PoseStampedPtr pose_msg;
+      if (getInput("object_pose", pose_msg) && pose_msg) {
+        goal_.pose = *pose_msg;
+      }
     }
   }
 
   BT::NodeStatus on_success() override
   {
-    setOutput("manipulator_path", result_.result->path);
+    setOutput("manipulator_path", shareResultMember(result_.result, result_.result->path));
     setOutput("move_to_frame", plan_to_frame);
     return BT::NodeStatus::SUCCESS;
   }
@@ -60,14 +101,22 @@ public:
     return providedBasicPorts(
       {
         BT::InputPort<std::string>("plan_to_frame", "The frame MoveIt should plan to"),
-        BT::InputPort<geometry_msgs::msg::PoseStamped>("object_pose", "Pose of the object manipulator should move to"),
-        BT::OutputPort<trajectory_msgs::msg::JointTrajectory>("manipulator_path", "The path MoveIt has planned for the manipulator"),
+        BT::InputPort<PoseStampedPtr>("object_pose", "Pose of the object manipulator should move to"),
+        BT::OutputPort<JointTrajectoryPtr>("manipulator_path", "The path MoveIt has planned for the manipulator"),
         BT::OutputPort<std::string>("move_to_frame", "Frame we should move to"),
       });
   }
 
+  void halt() override
+  {
+    check_prefetched_ = false;
+    BtActionNode<kmr_msgs::action::PlanToFrame>::halt();
+  }
+
   private:
     std::string plan_to_frame;
+    PlanPrefetcher::Ptr prefetcher_;
+    bool check_prefetched_{false};
 };
 
 }  // namespace kmr_behavior_tree
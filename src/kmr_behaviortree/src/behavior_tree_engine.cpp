@@ -14,8 +14,13 @@
 
 #include "kmr_behaviortree/behavior_tree_engine.hpp"
 
+#include <fstream>
+#include <functional>
 #include <memory>
+#include <stdexcept>
+#include <streambuf>
 #include <string>
+#include <utility>
 #include <vector>
 #include <iostream>
 
@@ -28,6 +33,7 @@ namespace kmr_behavior_tree
 {
 
 BehaviorTreeEngine::BehaviorTreeEngine(const std::vector<std::string> & plugin_libraries)
+: tick_notifier_(std::make_shared<TickNotifier>())
 {
   BT::SharedLibrary loader;
   for (const auto & p : plugin_libraries) {
@@ -35,31 +41,185 @@ BehaviorTreeEngine::BehaviorTreeEngine(const std::vector<std::string> & plugin_l
   }
 }
 
+BehaviorTreeEngine::~BehaviorTreeEngine()
+{
+  stopCallbackExecutor();
+}
+
+void
+BehaviorTreeEngine::startCallbackExecutor(rclcpp::Node::SharedPtr node, size_t number_of_threads)
+{
+  stopCallbackExecutor();
+
+  callback_executor_ = std::make_shared<rclcpp::executors::MultiThreadedExecutor>(
+    rclcpp::ExecutorOptions(), number_of_threads);
+  callback_executor_->add_node(node);
+  callback_thread_ = std::thread([executor = callback_executor_]() {executor->spin();});
+}
+
+void
+BehaviorTreeEngine::addCallbackNode(rclcpp::Node::SharedPtr node)
+{
+  if (!callback_executor_) {
+    throw std::runtime_error("The callback executor has not been started");
+  }
+  callback_executor_->add_node(node);
+}
+
+void
+BehaviorTreeEngine::stopCallbackExecutor()
+{
+  if (!callback_executor_) {
+    return;
+  }
+
+  callback_executor_->cancel();
+  if (callback_thread_.joinable()) {
+    callback_thread_.join();
+  }
+  callback_executor_.reset();
+}
+
 BtStatus
 BehaviorTreeEngine::run(
   BT::Tree * tree,
   std::function<void()> onLoop,
   std::function<bool()> cancelRequested,
   std::chrono::milliseconds loopTimeout)
+{
+  return run(tree, onLoop, cancelRequested, tick_profiler_, loopTimeout);
+}
+
+BtStatus
+BehaviorTreeEngine::run(
+  BT::Tree * tree,
+  std::function<void()> onLoop,
+  std::function<bool()> cancelRequested,
+  TickProfiler::Ptr profiler,
+  std::chrono::milliseconds loopTimeout)
 {
   rclcpp::WallRate loopRate(loopTimeout);
   BT::NodeStatus result = BT::NodeStatus::RUNNING;
+  if (profiler) {
+    profiler->startRun(tree);
+  }
 
   // Loop until something happens with ROS or the node completes
   while (rclcpp::ok() && result == BT::NodeStatus::RUNNING) {
     if (cancelRequested()) {
       tree->rootNode()->halt();
-      return BtStatus::CANCELED;
+      return finishRun(BtStatus::CANCELED, profiler);
     }
 
-    result = tree->rootNode()->executeTick();
+    result = tickOnce(tree, loopTimeout, profiler);
 
     onLoop();
 
     loopRate.sleep();
   }
 
-  return (result == BT::NodeStatus::SUCCESS) ? BtStatus::SUCCEEDED : BtStatus::FAILED;
+  return finishRun(
+    (result == BT::NodeStatus::SUCCESS) ? BtStatus::SUCCEEDED : BtStatus::FAILED, profiler);
+}
+
+BtStatus
+BehaviorTreeEngine::runEventDriven(
+  BT::Tree * tree,
+  std::function<void()> onLoop,
+  std::function<bool()> cancelRequested,
+  std::chrono::milliseconds loopTimeout)
+{
+  return runEventDriven(tree, onLoop, cancelRequested, tick_notifier_, tick_profiler_, loopTimeout);
+}
+
+BtStatus
+BehaviorTreeEngine::runEventDriven(
+  BT::Tree * tree,
+  std::function<void()> onLoop,
+  std::function<bool()> cancelRequested,
+  TickNotifier::Ptr notifier,
+  TickProfiler::Ptr profiler,
+  std::chrono::milliseconds loopTimeout)
+{
+  BT::NodeStatus result = BT::NodeStatus::RUNNING;
+  if (profiler) {
+    profiler->startRun(tree);
+  }
+
+  // Loop until something happens with ROS or the node completes
+  while (rclcpp::ok() && result == BT::NodeStatus::RUNNING) {
+    if (cancelRequested()) {
+      tree->rootNode()->halt();
+      return finishRun(BtStatus::CANCELED, profiler);
+    }
+
+    result = tickOnce(tree, loopTimeout, profiler);
+
+    onLoop();
+
+    // Sleep until a node asks for a new tick, but never longer than one loop period
+    if (result == BT::NodeStatus::RUNNING) {
+      notifier->waitFor(loopTimeout);
+    }
+  }
+
+  return finishRun(
+    (result == BT::NodeStatus::SUCCESS) ? BtStatus::SUCCEEDED : BtStatus::FAILED, profiler);
+}
+
+BT::NodeStatus
+BehaviorTreeEngine::tickOnce(
+  BT::Tree * tree, std::chrono::milliseconds loopTimeout,
+  const TickProfiler::Ptr & profiler)
+{
+  if (!profiler) {
+    return tree->rootNode()->executeTick();
+  }
+
+  const auto started = TickProfiler::Clock::now();
+  BT::NodeStatus result = tree->rootNode()->executeTick();
+  profiler->endTick(tree, started, loopTimeout);
+  return result;
+}
+
+BtStatus
+BehaviorTreeEngine::finishRun(BtStatus status, const TickProfiler::Ptr & profiler)
+{
+  if (profiler) {
+    switch (status) {
+      case BtStatus::SUCCEEDED:
+        profiler->stopRun("succeeded");
+        break;
+      case BtStatus::FAILED:
+        profiler->stopRun("failed");
+        break;
+      case BtStatus::CANCELED:
+        profiler->stopRun("canceled");
+        break;
+    }
+  }
+  return status;
+}
+
+std::vector<std::string>
+BehaviorTreeEngine::getStaticPlanFrames(BT::Tree * tree)
+{
+  std::vector<std::string> frames;
+  auto visitor = [&frames](BT::TreeNode * node) {
+      if (node->registrationName() != "PlanManipulatorPath") {
+        return;
+      }
+      const auto & ports = node->config().input_ports;
+      auto frame = ports.find("plan_to_frame");
+      if (frame == ports.end() || frame->second == "object" ||
+        BT::TreeNode::isBlackboardPointer(frame->second))
+      {
+        return;
+      }
+      frames.push_back(frame->second);
+    };
+  BT::applyRecursiveVisitor(tree->rootNode(), visitor);
+  return frames;
 }
 
 BT::Tree
@@ -72,4 +232,62 @@ BehaviorTreeEngine::buildTreeFromText(const std::string & xml_string, BT::Blackb
   return t;
 }
 
+BT::Tree *
+BehaviorTreeEngine::getTree(const std::string & xml_string, BT::Blackboard::Ptr blackboard)
+{
+  return getCachedTree(
+    xml_string, blackboard, [&]() {return buildTreeFromText(xml_string, blackboard);});
+}
+
+BT::Tree *
+BehaviorTreeEngine::getTreeFromFile(const std::string & filename, BT::Blackboard::Ptr blackboard)
+{
+  std::ifstream xml_file(filename);
+  if (!xml_file.good()) {
+    throw std::runtime_error("Couldn't open input XML file: " + filename);
+  }
+  const std::string xml_string(
+    (std::istreambuf_iterator<char>(xml_file)), std::istreambuf_iterator<char>());
+
+  return getCachedTree(
+    xml_string, blackboard, [&]() {
+      BT::XMLParser p(factory_);
+      p.loadFromFile(filename);
+      return p.instantiateTree(blackboard);
+    });
+}
+
+BT::Tree *
+BehaviorTreeEngine::getCachedTree(
+  const std::string & xml_string, BT::Blackboard::Ptr blackboard,
+  const std::function<BT::Tree()> & build)
+{
+  const size_t hash = std::hash<std::string>()(xml_string);
+  std::lock_guard<std::mutex> lock(tree_cache_mutex_);
+  auto range = tree_cache_.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second.blackboard == blackboard && it->second.xml_string == xml_string) {
+      return it->second.tree.get();
+    }
+  }
+
+  CachedTree cached;
+  cached.xml_string = xml_string;
+  cached.blackboard = blackboard;
+  cached.tree = std::make_unique<BT::Tree>(build());
+  return tree_cache_.emplace(hash, std::move(cached))->second.tree.get();
+}
+
+void
+BehaviorTreeEngine::resetTree(BT::Tree * tree)
+{
+  haltAllActions(tree->rootNode());
+  auto visitor = [](BT::TreeNode * node) {
+      if (node->status() != BT::NodeStatus::IDLE) {
+        node->setStatus(BT::NodeStatus::IDLE);
+      }
+    };
+  BT::applyRecursiveVisitor(tree->rootNode(), visitor);
+}
+
 }  // namespace kmr_behavior_tree
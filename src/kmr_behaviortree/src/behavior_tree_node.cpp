@@ -14,20 +14,27 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <fstream>
 #include <streambuf>
 #include <string>
+#include <thread>
 #include <vector>
 #include <iostream>
 #include <bits/stdc++.h>
-#include <stdio.h> 
+#include <stdio.h>
 
 #include <rclcpp/rclcpp.hpp>
 #include "std_msgs/msg/string.hpp"
 #include "rclcpp_action/rclcpp_action.hpp"
 #include "kmr_behaviortree/behavior_tree_engine.hpp"
+#include "kmr_behaviortree/client_registry.hpp"
+#include "kmr_behaviortree/plan_prefetcher.hpp"
 #include "geometry_msgs/msg/pose_stamped.hpp"
 #include <geometry_msgs/msg/pose_with_covariance_stamped.hpp>
 #include <nav2_msgs/action/navigate_to_pose.hpp>
@@ -37,142 +44,193 @@
 
 static const rclcpp::Logger LOGGER = rclcpp::get_logger("behavior_tree_node");
 
-class BehaviorTreeNode : public rclcpp::Node
+// One robot driven by the behavior_tree_node: its client node, blackboard, trees and goal list.
+// All robots share the engine of the node, so the plugins are only loaded once and the
+// callbacks of all robots are handled by the same executor. A robot without a name is the
+// single robot of the default mode, with its topics and actions outside any namespace.
+class Robot
 {
 public:
-BehaviorTreeNode()
-: Node("behavior_tree_node")
-{
-  RCLCPP_INFO(LOGGER, "Initialize node!");
-  start_subscriber_ = this->create_subscription<std_msgs::msg::String>("start_topic", 10,std::bind(&BehaviorTreeNode::start_callback, this, std::placeholders::_1));
-  initial_publisher_ = this->create_publisher<geometry_msgs::msg::PoseWithCovarianceStamped>("initialpose", 10);
-  action_client_ = rclcpp_action::create_client<nav2_msgs::action::NavigateToPose>(this->get_node_base_interface(),
-      this->get_node_graph_interface(),
-      this->get_node_logging_interface(),
-      this->get_node_waitables_interface(),
-      "navigate_to_pose");
-
-
-  const std::vector<std::string> plugin_libs = {
-    "move_gripper_action_bt_node",
-    "move_manipulator_action_bt_node",
-    "plan_manipulator_path_action_bt_node",
-    "object_search_action_bt_node",
-    "empty_frame_condition_bt_node",
-    "navigate_vehicle_bt_node",
+  struct Options
+  {
+    std::string name;
+    std::string home;
+    std::vector<std::string> goal_list;
+    std::string bt_xml_filename;
+    std::vector<std::string> bt_xml_filenames;
+    bool event_driven_ticks{false};
+    bool plan_lookahead{false};
+    bool tick_profiling{false};
+    std::string profile_directory;
   };
-  
-  declare_parameter("plugin_lib_names", plugin_libs);
-  declare_parameter("bt_xml_filename");
-  declare_parameter("WS1.position");
-  declare_parameter("WS1.orientation");
-  declare_parameter("WS2.position");
-  declare_parameter("WS2.orientation");
-  declare_parameter("WS3.position");
-  declare_parameter("WS3.orientation");
-  declare_parameter("HOME.position");
-  declare_parameter("HOME.orientation");
-  declare_parameter("goal_list");
 
-  
-  
-
-  goal_list = get_parameter("goal_list").as_string_array();
-  plugin_lib_names_ = get_parameter("plugin_lib_names").as_string_array();
-  // Create the class that registers our custom nodes and executes the BT
-  bt_ = std::make_unique<kmr_behavior_tree::BehaviorTreeEngine>(plugin_lib_names_);
-
-  auto options = rclcpp::NodeOptions().arguments(
-    {"--ros-args",
-      "-r", std::string("__node:=") + get_name() + "_client_node",
-      "--"});
-
-  RCLCPP_INFO(LOGGER,get_name());
-  // Support for handling the topic-based goal pose from rviz
-  client_node_ = std::make_shared<rclcpp::Node>("_", options);
+  Robot(
+    rclcpp::Node * parent, kmr_behavior_tree::BehaviorTreeEngine * bt, const Options & options,
+    std::function<void()> on_done)
+  : parent_(parent), bt_(bt), name_(options.name), home_(options.home),
+    goal_list(options.goal_list), event_driven_ticks_(options.event_driven_ticks),
+    on_done_(on_done),
+    logger_(rclcpp::get_logger(
+        options.name.empty() ? "behavior_tree_node" : "behavior_tree_node." + options.name)),
+    tick_notifier_(std::make_shared<kmr_behavior_tree::TickNotifier>())
+  {
+    // The stations of a robot may be others than those declared by the node
+    declareStation(home_);
+    for (const auto & station : goal_list) {
+      declareStation(station);
+    }
 
+    auto node_options = rclcpp::NodeOptions().arguments(
+      {"--ros-args",
+        "-r", std::string("__node:=") + parent_->get_name() + "_client_node",
+        "--"});
+
+    // Support for handling the topic-based goal pose from rviz
+    client_node_ = std::make_shared<rclcpp::Node>("_", name_, node_options);
+    action_client_ = rclcpp_action::create_client<nav2_msgs::action::NavigateToPose>(
+      client_node_, "navigate_to_pose");
+    start_subscriber_ = client_node_->create_subscription<std_msgs::msg::String>("start_topic", 10,std::bind(&Robot::start_callback, this, std::placeholders::_1));
+    tree_subscriber_ = client_node_->create_subscription<std_msgs::msg::String>("tree_topic", 10,std::bind(&Robot::tree_callback, this, std::placeholders::_1));
+    initial_publisher_ = client_node_->create_publisher<geometry_msgs::msg::PoseWithCovarianceStamped>("initialpose", 10);
+
+    // Create the blackboard that will be shared by all of the nodes in the tree
+    blackboard_ = BT::Blackboard::create();
+
+    // Put items on the blackboard
+    blackboard_->set<rclcpp::Node::SharedPtr>("node", client_node_); // NOLINT
+    auto client_registry = std::make_shared<kmr_behavior_tree::ClientRegistry>(client_node_);
+    blackboard_->set<kmr_behavior_tree::ClientRegistry::Ptr>("client_registry", client_registry);
+    if (event_driven_ticks_) {
+      blackboard_->set<kmr_behavior_tree::TickNotifier::Ptr>("tick_notifier", tick_notifier_);
+    }
+    // Time every run of the tree, published on bt_profile and written as a Chrome trace
+    if (options.tick_profiling) {
+      tick_profiler_ = std::make_shared<kmr_behavior_tree::TickProfiler>(
+        client_node_, options.profile_directory,
+        name_.empty() ? std::string("bt_profile") : "bt_profile_" + name_);
+      blackboard_->set<kmr_behavior_tree::TickProfiler::Ptr>("tick_profiler", tick_profiler_);
+    }
+    blackboard_->set<bool>("carryarea1", true);
+    blackboard_->set<bool>("carryarea2", true);
+    blackboard_->set<bool>("carryarea3", true);
+    blackboard_->set<std::string>("current_frame", "driveposition");
+
+    // Plan the next manipulator motion while the current one is executed
+    if (options.plan_lookahead) {
+      plan_prefetcher_ = std::make_shared<kmr_behavior_tree::PlanPrefetcher>(
+        client_node_, client_registry, tick_notifier_);
+      blackboard_->set<kmr_behavior_tree::PlanPrefetcher::Ptr>("plan_prefetcher", plan_prefetcher_);
+    }
 
-  // Create the blackboard that will be shared by all of the nodes in the tree
-  blackboard_ = BT::Blackboard::create();
+    // The other trees that can be named on the tree topic are built now, so switching to
+    // them later does not construct any nodes
+    bt_xml_filenames_ = options.bt_xml_filenames;
+    for (const auto & filename : bt_xml_filenames_) {
+      if (filename != options.bt_xml_filename) {
+        loadTree(filename);
+      }
+    }
+    bt_xml_filenames_.push_back(options.bt_xml_filename);
 
-  // Put items on the blackboard
-  blackboard_->set<rclcpp::Node::SharedPtr>("node", client_node_); // NOLINT
-  blackboard_->set<bool>("carryarea1", true);
-  blackboard_->set<bool>("carryarea2", true);
-  blackboard_->set<bool>("carryarea3", true);
-  blackboard_->set<std::string>("current_frame", "driveposition");
-  
-  std::string bt_xml_filename;
-  get_parameter("bt_xml_filename", bt_xml_filename);
+    // Create the Behavior Tree from the XML input
+    useTree(options.bt_xml_filename);
+    RCLCPP_INFO(logger_, "BehaviorTree successfully created");
 
+    // Publish initial pose to be the home position
+    geometry_msgs::msg::PoseWithCovarianceStamped initial;
+    const auto home_pose = create_pose(home_);
+    initial.header.frame_id = home_pose.header.frame_id;
+    initial.pose.pose = home_pose.pose;
 
-  std::ifstream xml_file(bt_xml_filename);
-  if (!xml_file.good()) {
-    RCLCPP_ERROR(LOGGER, "Couldn't open input XML file: %s", bt_xml_filename.c_str());
+    initial_publisher_->publish(initial);
+    RCLCPP_INFO(logger_, "Initial pose published");
   }
 
-  xml_string_ = std::string(std::istreambuf_iterator<char>(xml_file),std::istreambuf_iterator<char>());
-
-  RCLCPP_DEBUG(LOGGER, "Behavior Tree file: '%s'", bt_xml_filename.c_str());
-  RCLCPP_DEBUG(LOGGER, "Behavior Tree XML: %s", xml_string_.c_str());
-
-  // Create the Behavior Tree from the XML input
-  tree_ = bt_->buildTreeFromText(xml_string_, blackboard_);
-  RCLCPP_INFO(LOGGER, "BehaviorTree successfully created");
-
-  // Publish initial pose to be HOME position
-  std::string position;
-  float orientation;
-  get_parameter("HOME.position", position);
-  get_parameter("HOME.orientation", orientation);
-  
-  std::string delimiter = ",";
-  std::string x_token = position.substr(0, position.find(delimiter)); 
-  position.erase(0, position.find(delimiter) + delimiter.length());
-  std::string y_token = position.substr(0, position.find(delimiter)); 
-
-  float x = std::stof(x_token); 
-  float y = std::stof(y_token);
-
-  geometry_msgs::msg::PoseWithCovarianceStamped initial;
-  initial.header.frame_id = "map";
-  geometry_msgs::msg::Point point;
-  point.x = x;  
-  point.y =y;
-  initial.pose.pose.position = point;
-  initial.pose.pose.orientation = orientationAroundZAxis(orientation);
+  ~Robot()
+  {
+    stop();
+  }
 
-  initial_publisher_->publish(initial);
-  RCLCPP_INFO(LOGGER, "Initial pose published");
+  // Waits for the mission to end, which it does soon after shutdown. Must be called while the
+  // engine's executor is still running, as the mission waits for action responses.
+  void stop()
+  {
+    stopping_ = true;
+    if (mission_thread_.joinable()) {
+      mission_thread_.join();
+    }
+  }
 
-}
+  rclcpp::Node::SharedPtr getClientNode() {return client_node_;}
 
 private:
+  void declareStation(const std::string & station){
+    if (!parent_->has_parameter(station + ".position")) {
+      parent_->declare_parameter(station + ".position");
+      parent_->declare_parameter(station + ".orientation");
+    }
+  }
+
+  // Runs on the engine's executor, so the mission is started on a thread of its own and the
+  // callbacks of the other robots keep being handled
   void start_callback(std_msgs::msg::String::SharedPtr msg){
-    RCLCPP_INFO(LOGGER, "Start BT tree: '%s'", msg->data.c_str());
-    if (msg->data == "OK"){
-      start_bt();
+    RCLCPP_INFO(logger_, "Start BT tree: '%s'", msg->data.c_str());
+    if (stopping_) {
+      return;
+    }
+    if (msg->data != "OK"){
+      return;
+    }
+    if (running_) {
+      RCLCPP_WARN(logger_, "The behavior tree is already running");
+      return;
+    }
+
+    if (mission_thread_.joinable()) {
+      mission_thread_.join();
     }
+    running_ = true;
+    mission_thread_ = std::thread([this]() {
+        start_bt();
+        running_ = false;
+      });
+  }
 
+  // Chooses the tree run by the next start message, one of the trees in bt_xml_filenames. Runs
+  // on the same callback group as start_callback, so the two never run at the same time.
+  void tree_callback(std_msgs::msg::String::SharedPtr msg){
+    if (running_) {
+      RCLCPP_WARN(logger_, "The behavior tree is running, it can not be changed now");
+      return;
+    }
+    auto filename = std::find_if(bt_xml_filenames_.begin(), bt_xml_filenames_.end(),
+      [&msg](const std::string & filename) {
+        return msg->data == filename || msg->data == filename.substr(filename.find_last_of('/') + 1);
+      });
+    if (filename == bt_xml_filenames_.end()) {
+      RCLCPP_ERROR(logger_, "Unknown behavior tree: '%s'", msg->data.c_str());
+      return;
+    }
+    useTree(*filename);
+    RCLCPP_INFO(logger_, "Behavior tree '%s' is used from the next start", filename->c_str());
+  }
 
+  // Reads the tree from file. The engine only builds it the first time.
+  BT::Tree * loadTree(const std::string & bt_xml_filename){
+    RCLCPP_DEBUG(logger_, "Behavior Tree file: '%s'", bt_xml_filename.c_str());
+    // Parsed from the file, so that the trees can include the shared subtrees next to them
+    return bt_->getTreeFromFile(bt_xml_filename, blackboard_);
   }
 
-  void start_bt(){
-    bool res = initializeGoalPose();
-    if (!res){
-      geometry_msgs::msg::PoseStamped goal_pose;
-      goal_pose = create_pose("HOME");
-      bool nav_res = send_navigation_goal(goal_pose);
-      if (nav_res){
-        RCLCPP_INFO(LOGGER, "Navigated successfully home!");
-        exit(0);
-      }
-      else{
-        RCLCPP_INFO(LOGGER, "Failed to navigate back home!");
-        exit(0);
-      }
+  void useTree(const std::string & bt_xml_filename){
+    tree_ = loadTree(bt_xml_filename);
+    if (plan_prefetcher_) {
+      plan_prefetcher_->setFrameSequence(bt_->getStaticPlanFrames(tree_));
     }
+  }
 
+  // Runs the tree once for every station in the goal list, then drives home
+  void start_bt(){
     auto is_canceling = [this]() {
       return false;
         };
@@ -181,27 +239,54 @@ private:
     auto on_loop = [&]() {
         };
 
-    kmr_behavior_tree::BtStatus rc = bt_->run(&tree_, on_loop, is_canceling);
-    bt_->haltAllActions(tree_.rootNode());
+    while (rclcpp::ok() && !stopping_ && initializeGoalPose()) {
+      // Plans made ahead during the previous run may no longer fit the new station
+      if (plan_prefetcher_) {
+        plan_prefetcher_->clear();
+      }
+
+      kmr_behavior_tree::BtStatus rc;
+      if (event_driven_ticks_) {
+        rc = bt_->runEventDriven(tree_, on_loop, is_canceling, tick_notifier_, tick_profiler_);
+      } else {
+        rc = bt_->run(tree_, on_loop, is_canceling, tick_profiler_);
+      }
+      // The same tree is run for the next station, also after a failure
+      bt_->resetTree(tree_);
 
-    switch (rc) {
-      case kmr_behavior_tree::BtStatus::SUCCEEDED:
-        RCLCPP_INFO(get_logger(), "Object found and handled - succeeded");
-        start_bt();
-        break;
+      switch (rc) {
+        case kmr_behavior_tree::BtStatus::SUCCEEDED:
+          RCLCPP_INFO(logger_, "Object found and handled - succeeded");
+          break;
 
-      case kmr_behavior_tree::BtStatus::FAILED:
-        RCLCPP_ERROR(get_logger(), "Object found and handled - failed");
-        start_bt();
-        break;
+        case kmr_behavior_tree::BtStatus::FAILED:
+          RCLCPP_ERROR(logger_, "Object found and handled - failed");
+          break;
 
-      case kmr_behavior_tree::BtStatus::CANCELED:
-        RCLCPP_INFO(get_logger(), "Object found and handled - canceled");
-        break;
+        case kmr_behavior_tree::BtStatus::CANCELED:
+          RCLCPP_INFO(logger_, "Object found and handled - canceled");
+          return;
 
-      default:
-        throw std::logic_error("Invalid status return from BT");
+        default:
+          throw std::logic_error("Invalid status return from BT");
+      }
     }
+
+    // Interrupted by shutdown, nothing can be sent anymore
+    if (!rclcpp::ok() || stopping_) {
+      return;
+    }
+
+    geometry_msgs::msg::PoseStamped goal_pose;
+    goal_pose = create_pose(home_);
+    bool nav_res = send_navigation_goal(goal_pose);
+    if (nav_res){
+      RCLCPP_INFO(logger_, "Navigated successfully home!");
+    }
+    else{
+      RCLCPP_INFO(logger_, "Failed to navigate back home!");
+    }
+    on_done_();
   }
 
   bool initializeGoalPose(){
@@ -210,12 +295,13 @@ private:
       geometry_msgs::msg::PoseStamped goal_pose;
 
       goal_station = goal_list.front();
-      goal_list.erase(goal_list.begin()); 
+      goal_list.erase(goal_list.begin());
 
       goal_pose = create_pose(goal_station);
-      RCLCPP_INFO(get_logger(), "Starting BT with new goal");
+      RCLCPP_INFO(logger_, "Starting BT with new goal");
       // Update the goal pose on the blackboard
       blackboard_->set("current_goalpose", goal_pose);
+      tick_notifier_->notify();
       return true;
     } else{
       return false;
@@ -223,10 +309,10 @@ private:
   }
 
   bool send_navigation_goal(geometry_msgs::msg::PoseStamped pose){
-    RCLCPP_INFO(LOGGER, "Send navigation goal to drive home");
+    RCLCPP_INFO(logger_, "Send navigation goal to drive home");
     auto is_action_server_ready = action_client_->wait_for_action_server(std::chrono::seconds(5));
       if (!is_action_server_ready) {
-        RCLCPP_ERROR(LOGGER,"NavigateToPose action server is not available.");
+        RCLCPP_ERROR(logger_,"NavigateToPose action server is not available.");
         return false;
       }
 
@@ -239,26 +325,35 @@ private:
       send_goal_options.result_callback = [](auto) {};
 
       auto future_goal_handle = action_client_->async_send_goal(navigation_goal_, send_goal_options);
-      if (rclcpp::spin_until_future_complete(client_node_, future_goal_handle) != rclcpp::executor::FutureReturnCode::SUCCESS)
+      if (future_goal_handle.wait_for(std::chrono::seconds(5)) != std::future_status::ready)
       {
-        RCLCPP_ERROR(LOGGER, "Send goal call failed");
+        RCLCPP_ERROR(logger_, "Send goal call failed");
         return false;
       }
 
       // Get the goal handle and save so that we can check on completion in the timer callback
       rclcpp_action::ClientGoalHandle<nav2_msgs::action::NavigateToPose>::SharedPtr navigation_goal_handle_ = future_goal_handle.get();
       if (!navigation_goal_handle_) {
-        RCLCPP_ERROR(LOGGER, "Goal was rejected by server");
+        RCLCPP_ERROR(logger_, "Goal was rejected by server");
         return false;
       }
 
       // Wait for the server to be done with the goal
       auto result_future = action_client_->async_get_result(navigation_goal_handle_);
 
-      RCLCPP_INFO(LOGGER, "Waiting for result");
-      if (rclcpp::spin_until_future_complete(client_node_, result_future) != rclcpp::executor::FutureReturnCode::SUCCESS){
-        RCLCPP_ERROR(LOGGER, "get result call failed :(");
-        return false;
+      // The result is delivered by the engine's callback executor
+      RCLCPP_INFO(logger_, "Waiting for result");
+      while (result_future.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready) {
+        if (!rclcpp::ok() || stopping_) {
+          // Do not leave the robot driving after the node is gone
+          RCLCPP_WARN(logger_, "Shutting down, canceling the navigation goal");
+          try {
+            action_client_->async_cancel_goal(navigation_goal_handle_);
+          } catch (const std::exception & e) {
+            RCLCPP_ERROR(logger_, "Failed to cancel the navigation goal: %s", e.what());
+          }
+          return false;
+        }
       }
 
       rclcpp_action::ClientGoalHandle<nav2_msgs::action::NavigateToPose>::WrappedResult wrapped_result = result_future.get();
@@ -267,13 +362,13 @@ private:
         case rclcpp_action::ResultCode::SUCCEEDED:
           return true;
         case rclcpp_action::ResultCode::ABORTED:
-          RCLCPP_ERROR(LOGGER, "Goal was aborted");
+          RCLCPP_ERROR(logger_, "Goal was aborted");
           return false;
         case rclcpp_action::ResultCode::CANCELED:
-          RCLCPP_ERROR(LOGGER, "Goal was canceled");
+          RCLCPP_ERROR(logger_, "Goal was canceled");
           return false;
         default:
-          RCLCPP_ERROR(LOGGER, "Unknown result code");
+          RCLCPP_ERROR(logger_, "Unknown result code");
           return false;
       }
   }
@@ -283,27 +378,28 @@ private:
   q.setRPY(0, 0, angle);
   return tf2::toMsg(q);
   }
-  
+
+  // The stations are parameters of the node, shared by all robots
   geometry_msgs::msg::PoseStamped create_pose(std::string goal_station){
     std::string position;
     float orientation;
 
-    get_parameter(goal_station + "." + "position", position);
-    get_parameter(goal_station + "." + "orientation", orientation);
+    parent_->get_parameter(goal_station + "." + "position", position);
+    parent_->get_parameter(goal_station + "." + "orientation", orientation);
 
     std::string delimiter = ",";
-    std::string x_token = position.substr(0, position.find(delimiter)); 
+    std::string x_token = position.substr(0, position.find(delimiter));
     position.erase(0, position.find(delimiter) + delimiter.length());
     std::string y_token = position.substr(0, position.find(delimiter));
 
 
-    float x = std::stof(x_token); 
+    float x = std::stof(x_token);
     float y = std::stof(y_token);
-    
+
     geometry_msgs::msg::PoseStamped p;
     geometry_msgs::msg::Point point;
     p.header.frame_id = "map";
-        
+
     point.x = x;
     point.y = y;
     point.z = 0.0;
@@ -311,19 +407,150 @@ private:
     p.pose.orientation = orientationAroundZAxis(orientation);
     return p;
   }
-       
 
 
+
+  rclcpp::Node * parent_;
+  kmr_behavior_tree::BehaviorTreeEngine * bt_;
+  std::string name_;
+  std::string home_;
   rclcpp::Subscription<std_msgs::msg::String>::SharedPtr start_subscriber_;
+  rclcpp::Subscription<std_msgs::msg::String>::SharedPtr tree_subscriber_;
   rclcpp::Publisher<geometry_msgs::msg::PoseWithCovarianceStamped>::SharedPtr initial_publisher_;
   rclcpp_action::Client<nav2_msgs::action::NavigateToPose>::SharedPtr action_client_;
-  BT::Tree tree_;
+  // Owned by the engine's tree cache
+  BT::Tree * tree_;
   BT::Blackboard::Ptr blackboard_;
-  std::string xml_string_;
-  std::unique_ptr<kmr_behavior_tree::BehaviorTreeEngine> bt_;
-  std::vector<std::string> plugin_lib_names_;
+  std::vector<std::string> bt_xml_filenames_;
   std::vector<std::string> goal_list;
+  bool event_driven_ticks_;
+  std::function<void()> on_done_;
+  rclcpp::Logger logger_;
+  kmr_behavior_tree::TickNotifier::Ptr tick_notifier_;
+  kmr_behavior_tree::TickProfiler::Ptr tick_profiler_;
+  kmr_behavior_tree::PlanPrefetcher::Ptr plan_prefetcher_;
   rclcpp::Node::SharedPtr client_node_;
+  std::atomic<bool> running_{false};
+  std::atomic<bool> stopping_{false};
+  std::thread mission_thread_;
+};
+
+class BehaviorTreeNode : public rclcpp::Node
+{
+public:
+BehaviorTreeNode()
+: Node("behavior_tree_node")
+{
+  RCLCPP_INFO(LOGGER, "Initialize node!");
+
+
+  const std::vector<std::string> plugin_libs = {
+    "move_gripper_action_bt_node",
+    "move_manipulator_action_bt_node",
+    "plan_manipulator_path_action_bt_node",
+    "object_search_action_bt_node",
+    "continuous_object_search_action_bt_node",
+    "empty_frame_condition_bt_node",
+    "navigate_vehicle_bt_node",
+  };
+
+  declare_parameter("plugin_lib_names", plugin_libs);
+  declare_parameter("bt_xml_filename");
+  declare_parameter("bt_xml_filenames", std::vector<std::string>());
+  declare_parameter("WS1.position");
+  declare_parameter("WS1.orientation");
+  declare_parameter("WS2.position");
+  declare_parameter("WS2.orientation");
+  declare_parameter("WS3.position");
+  declare_parameter("WS3.orientation");
+  declare_parameter("HOME.position");
+  declare_parameter("HOME.orientation");
+  declare_parameter("goal_list");
+  declare_parameter("event_driven_ticks", false);
+  declare_parameter("plan_lookahead", false);
+  declare_parameter("tick_profiling", false);
+  declare_parameter("profile_directory", std::string(""));
+  // Fleet mode: one tree per robot in this process, each robot in the namespace of its name
+  declare_parameter("robots", std::vector<std::string>());
+  declare_parameter("callback_threads", 0);
+
+
+
+
+  plugin_lib_names_ = get_parameter("plugin_lib_names").as_string_array();
+  // Create the class that registers our custom nodes and executes the BT
+  bt_ = std::make_unique<kmr_behavior_tree::BehaviorTreeEngine>(plugin_lib_names_);
+
+  Robot::Options options;
+  get_parameter("bt_xml_filename", options.bt_xml_filename);
+  options.bt_xml_filenames = get_parameter("bt_xml_filenames").as_string_array();
+  options.event_driven_ticks = get_parameter("event_driven_ticks").as_bool();
+  options.plan_lookahead = get_parameter("plan_lookahead").as_bool();
+  options.tick_profiling = get_parameter("tick_profiling").as_bool();
+  options.profile_directory = get_parameter("profile_directory").as_string();
+
+  const auto robot_names = get_parameter("robots").as_string_array();
+  if (robot_names.empty()) {
+    options.home = "HOME";
+    options.goal_list = get_parameter("goal_list").as_string_array();
+    // The process is done when the single robot is back home
+    robots_.push_back(
+      std::make_unique<Robot>(
+        this, bt_.get(), options, []() {
+          RCLCPP_INFO(LOGGER, "The robot is back home");
+          rclcpp::shutdown();
+        }));
+  } else {
+    for (const auto & robot_name : robot_names) {
+      Robot::Options robot_options = options;
+      robot_options.name = robot_name;
+      robot_options.home = declare_parameter(robot_name + ".home", std::string("HOME"));
+      robot_options.goal_list =
+        declare_parameter(robot_name + ".goal_list", std::vector<std::string>{});
+      if (robot_options.goal_list.empty()) {
+        RCLCPP_WARN(LOGGER, "No %s.goal_list given, %s only drives home", robot_name.c_str(), robot_name.c_str());
+      }
+      robot_options.bt_xml_filename =
+        declare_parameter(robot_name + ".bt_xml_filename", options.bt_xml_filename);
+      robots_.push_back(
+        std::make_unique<Robot>(
+          this, bt_.get(), robot_options, [this]() {
+            // The others are still running, so only the last one stops the process
+            if (++robots_done_ == robots_.size()) {
+              RCLCPP_INFO(LOGGER, "All robots are back home");
+              rclcpp::shutdown();
+            }
+          }));
+    }
+    RCLCPP_INFO(LOGGER, "Fleet of %zu robots created", robots_.size());
+  }
+
+  // All start messages and action callbacks of all robots are handled by the engine's executor
+  bt_->startCallbackExecutor(
+    robots_.front()->getClientNode(),
+    static_cast<size_t>(get_parameter("callback_threads").as_int()));
+  for (size_t i = 1; i < robots_.size(); ++i) {
+    bt_->addCallbackNode(robots_[i]->getClientNode());
+  }
+}
+
+~BehaviorTreeNode()
+{
+  // The missions need the executor to get their action responses, so they are ended first.
+  // After that no more callbacks may reach the robots while they are destroyed.
+  for (auto & robot : robots_) {
+    robot->stop();
+  }
+  bt_->stopCallbackExecutor();
+  robots_.clear();
+}
+
+private:
+  // Declared before the robots, which use it until they are destroyed
+  std::unique_ptr<kmr_behavior_tree::BehaviorTreeEngine> bt_;
+  std::vector<std::string> plugin_lib_names_;
+  std::vector<std::unique_ptr<Robot>> robots_;
+  std::atomic<size_t> robots_done_{0};
 };
 
 
@@ -0,0 +1,527 @@
+// Copyright 2019 Nina Marie Wahl and Charlotte Heggem.
+// Copyright 2019 Norwegian University of Science and Technology.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs the behavior trees against mock action servers in the same process, and reports the
+// tick rate, cycle time, tick cost per node and allocations per tick. The results can be
+// written to a file and compared with an earlier run of the benchmark.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <set>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <rclcpp/rclcpp.hpp>
+#include "rclcpp_action/rclcpp_action.hpp"
+#include "ament_index_cpp/get_package_share_directory.hpp"
+#include "behaviortree_cpp_v3/loggers/abstract_logger.h"
+#include "kmr_behaviortree/behavior_tree_engine.hpp"
+#include "kmr_behaviortree/client_registry.hpp"
+#include "kmr_behaviortree/plan_prefetcher.hpp"
+#include "geometry_msgs/msg/pose_stamped.hpp"
+#include "kmr_msgs/action/gripper.hpp"
+#include "kmr_msgs/action/move_manipulator.hpp"
+#include "kmr_msgs/action/object_search.hpp"
+#include "kmr_msgs/action/plan_to_frame.hpp"
+#include "nav2_msgs/action/navigate_to_pose.hpp"
+
+// Allocations are counted per thread, so only those made by the thread ticking the tree are
+// reported
+static thread_local uint64_t allocations = 0;
+
+void * operator new(std::size_t size)
+{
+  ++allocations;
+  void * p = std::malloc(size == 0 ? 1 : size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void * p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+static const rclcpp::Logger LOGGER = rclcpp::get_logger("bt_benchmark");
+
+using Clock = std::chrono::steady_clock;
+
+// Server latency, drawn from a fixed, normal, uniform or exponential distribution
+class LatencyModel
+{
+public:
+  LatencyModel(const std::string & distribution, double mean_ms, double jitter_ms, unsigned seed)
+  : distribution_(distribution), mean_ms_(mean_ms), jitter_ms_(jitter_ms), generator_(seed)
+  {
+  }
+
+  std::chrono::microseconds sample()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    double ms = mean_ms_;
+    if (distribution_ == "normal" && jitter_ms_ > 0.0) {
+      ms = std::normal_distribution<double>(mean_ms_, jitter_ms_)(generator_);
+    } else if (distribution_ == "uniform") {
+      ms = std::uniform_real_distribution<double>(mean_ms_ - jitter_ms_, mean_ms_ + jitter_ms_)(
+        generator_);
+    } else if (distribution_ == "exponential" && mean_ms_ > 0.0) {
+      ms = std::exponential_distribution<double>(1.0 / mean_ms_)(generator_);
+    }
+    return std::chrono::microseconds(static_cast<int64_t>(std::max(ms, 0.0) * 1000.0));
+  }
+
+  bool chance(double probability)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::uniform_real_distribution<double>(0.0, 1.0)(generator_) < probability;
+  }
+
+private:
+  std::string distribution_;
+  double mean_ms_;
+  double jitter_ms_;
+  std::mt19937 generator_;
+  std::mutex mutex_;
+};
+
+// Accepts every goal and finishes it after a latency drawn from the model. The result is
+// filled in by make_result, which returns false to abort the goal.
+template<class ActionT>
+class MockActionServer
+{
+public:
+  using GoalHandle = rclcpp_action::ServerGoalHandle<ActionT>;
+  using ResultFunction =
+    std::function<bool (const typename ActionT::Goal &, typename ActionT::Result &)>;
+
+  MockActionServer(
+    rclcpp::Node::SharedPtr node, const std::string & action_name,
+    std::shared_ptr<LatencyModel> latency, ResultFunction make_result)
+  : latency_(latency), make_result_(make_result)
+  {
+    server_ = rclcpp_action::create_server<ActionT>(
+      node, action_name,
+      [](const rclcpp_action::GoalUUID &, std::shared_ptr<const typename ActionT::Goal>) {
+        return rclcpp_action::GoalResponse::ACCEPT_AND_EXECUTE;
+      },
+      [](const std::shared_ptr<GoalHandle>) {
+        return rclcpp_action::CancelResponse::ACCEPT;
+      },
+      [this](const std::shared_ptr<GoalHandle> goal_handle) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_.emplace_back([this, goal_handle]() {execute(goal_handle);});
+      });
+  }
+
+  ~MockActionServer()
+  {
+    stopping_ = true;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto & thread : threads_) {
+      thread.join();
+    }
+  }
+
+private:
+  void execute(const std::shared_ptr<GoalHandle> goal_handle)
+  {
+    const auto done = Clock::now() + latency_->sample();
+    auto result = std::make_shared<typename ActionT::Result>();
+    while (Clock::now() < done) {
+      if (stopping_) {
+        return;
+      }
+      if (goal_handle->is_canceling()) {
+        goal_handle->canceled(result);
+        return;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (make_result_(*goal_handle->get_goal(), *result)) {
+      goal_handle->succeed(result);
+    } else {
+      goal_handle->abort(result);
+    }
+  }
+
+  std::shared_ptr<LatencyModel> latency_;
+  ResultFunction make_result_;
+  typename rclcpp_action::Server<ActionT>::SharedPtr server_;
+  std::atomic<bool> stopping_{false};
+  std::mutex mutex_;
+  std::vector<std::thread> threads_;
+};
+
+// Collects the nodes ticked during one tick of the tree: those changing to a status other
+// than IDLE, and those left RUNNING, which are ticked without changing their status.
+// The callback runs during the tick, so it must not allocate.
+class TickedNodes : public BT::StatusChangeLogger
+{
+public:
+  explicit TickedNodes(BT::TreeNode * root_node)
+  : BT::StatusChangeLogger(root_node)
+  {
+    changed_.reserve(4096);
+  }
+
+  void callback(
+    BT::Duration, const BT::TreeNode & node, BT::NodeStatus, BT::NodeStatus status) override
+  {
+    if (status != BT::NodeStatus::IDLE && changed_.size() < changed_.capacity()) {
+      changed_.push_back(&node);
+    }
+  }
+
+  void flush() override {}
+
+  std::set<const BT::TreeNode *> take(BT::TreeNode * root_node)
+  {
+    std::set<const BT::TreeNode *> ticked(changed_.begin(), changed_.end());
+    changed_.clear();
+    auto visitor = [&ticked](BT::TreeNode * node) {
+        if (node->status() == BT::NodeStatus::RUNNING) {
+          ticked.insert(node);
+        }
+      };
+    BT::applyRecursiveVisitor(root_node, visitor);
+    return ticked;
+  }
+
+private:
+  std::vector<const BT::TreeNode *> changed_;
+};
+
+struct NodeCost
+{
+  uint64_t ticks{0};
+  double tick_us{0.0};
+};
+
+struct TreeResults
+{
+  std::vector<double> cycle_ms;
+  std::vector<double> tick_us;
+  uint64_t succeeded{0};
+  uint64_t allocations{0};
+  // By node name and type, since the trees have several nodes of the same type
+  std::map<std::string, NodeCost> nodes;
+};
+
+static double percentile(std::vector<double> values, double fraction)
+{
+  if (values.empty()) {
+    return 0.0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[static_cast<size_t>(fraction * (values.size() - 1))];
+}
+
+static double mean(const std::vector<double> & values)
+{
+  double sum = 0.0;
+  for (double value : values) {
+    sum += value;
+  }
+  return values.empty() ? 0.0 : sum / values.size();
+}
+
+// The metrics of one tree, in the order they are reported
+static std::vector<std::pair<std::string, double>> metrics(const TreeResults & results)
+{
+  double run_ms = 0.0;
+  for (double ms : results.cycle_ms) {
+    run_ms += ms;
+  }
+  const double ticks = static_cast<double>(results.tick_us.size());
+  return {
+    {"cycles", static_cast<double>(results.cycle_ms.size())},
+    {"succeeded", static_cast<double>(results.succeeded)},
+    {"cycle_ms_mean", mean(results.cycle_ms)},
+    {"cycle_ms_p50", percentile(results.cycle_ms, 0.5)},
+    {"cycle_ms_p95", percentile(results.cycle_ms, 0.95)},
+    {"cycle_ms_max", percentile(results.cycle_ms, 1.0)},
+    {"ticks_per_cycle", results.cycle_ms.empty() ? 0.0 : ticks / results.cycle_ms.size()},
+    {"ticks_per_s", run_ms > 0.0 ? ticks / (run_ms / 1000.0) : 0.0},
+    {"tick_us_mean", mean(results.tick_us)},
+    {"tick_us_p99", percentile(results.tick_us, 0.99)},
+    {"tick_us_max", percentile(results.tick_us, 1.0)},
+    {"allocations_per_tick", ticks > 0.0 ? results.allocations / ticks : 0.0},
+  };
+}
+
+// Reads the "<tree> <metric> <value>" lines written by an earlier run
+static std::map<std::string, double> readBaseline(const std::string & filename)
+{
+  std::map<std::string, double> baseline;
+  std::ifstream file(filename);
+  if (!file.good()) {
+    RCLCPP_ERROR(LOGGER, "Couldn't open baseline file: %s", filename.c_str());
+    return baseline;
+  }
+  std::string tree, metric;
+  double value;
+  while (file >> tree >> metric >> value) {
+    baseline[tree + " " + metric] = value;
+  }
+  return baseline;
+}
+
+int main(int argc, char * argv[])
+{
+  rclcpp::init(argc, argv);
+  auto node = std::make_shared<rclcpp::Node>("bt_benchmark");
+
+  const std::string share = ament_index_cpp::get_package_share_directory("kmr_behaviortree");
+  const std::vector<std::string> plugin_libs = {
+    "move_gripper_action_bt_node",
+    "move_manipulator_action_bt_node",
+    "plan_manipulator_path_action_bt_node",
+    "object_search_action_bt_node",
+    "continuous_object_search_action_bt_node",
+    "empty_frame_condition_bt_node",
+    "navigate_vehicle_bt_node",
+  };
+  const auto plugin_lib_names = node->declare_parameter("plugin_lib_names", plugin_libs);
+  const auto bt_xml_filenames = node->declare_parameter(
+    "bt_xml_filenames", std::vector<std::string>{
+      share + "/behavior_trees/full_tree.xml", share + "/behavior_trees/test.xml"});
+  const int cycles = node->declare_parameter("cycles", 20);
+  const bool event_driven_ticks = node->declare_parameter("event_driven_ticks", true);
+  const bool plan_lookahead = node->declare_parameter("plan_lookahead", false);
+  const auto loop_period = std::chrono::milliseconds(node->declare_parameter("loop_period_ms", 10));
+  const std::string distribution = node->declare_parameter("latency_distribution", std::string("normal"));
+  const int seed = node->declare_parameter("seed", 1);
+  const double object_found_probability = node->declare_parameter("object_found_probability", 1.0);
+  const std::string output_file = node->declare_parameter("output_file", std::string(""));
+  const std::string baseline_file = node->declare_parameter("baseline_file", std::string(""));
+
+  auto latency = [&node, &distribution, &seed](const std::string & server, double mean_ms) {
+      return std::make_shared<LatencyModel>(
+        distribution,
+        node->declare_parameter(server + ".latency_ms", mean_ms),
+        node->declare_parameter(server + ".jitter_ms", mean_ms / 10.0),
+        static_cast<unsigned>(seed + std::hash<std::string>()(server)));
+    };
+
+  // The mock servers run on a node and executor of their own, like the real servers would
+  auto server_node = std::make_shared<rclcpp::Node>("bt_benchmark_servers");
+  auto search_latency = latency("object_search", 200.0);
+
+  MockActionServer<kmr_msgs::action::PlanToFrame> plan_server(
+    server_node, "/moveit/frame", latency("plan_to_frame", 100.0),
+    [](const kmr_msgs::action::PlanToFrame::Goal &, kmr_msgs::action::PlanToFrame::Result & result) {
+      result.success = true;
+      result.path.joint_names = {"joint_a1", "joint_a2", "joint_a3", "joint_a4", "joint_a5",
+        "joint_a6", "joint_a7"};
+      result.path.points.resize(10);
+      for (auto & point : result.path.points) {
+        point.positions.assign(7, 0.0);
+        point.velocities.assign(7, 0.0);
+        point.accelerations.assign(7, 0.0);
+      }
+      return true;
+    });
+  MockActionServer<kmr_msgs::action::MoveManipulator> move_server(
+    server_node, "move_manipulator", latency("move_manipulator", 500.0),
+    [](const kmr_msgs::action::MoveManipulator::Goal &,
+    kmr_msgs::action::MoveManipulator::Result & result) {
+      result.success = true;
+      return true;
+    });
+  MockActionServer<kmr_msgs::action::Gripper> gripper_server(
+    server_node, "move_gripper", latency("move_gripper", 300.0),
+    [](const kmr_msgs::action::Gripper::Goal &, kmr_msgs::action::Gripper::Result & result) {
+      result.success = true;
+      return true;
+    });
+  MockActionServer<kmr_msgs::action::ObjectSearch> search_server(
+    server_node, "object_search", search_latency,
+    [search_latency, object_found_probability](
+      const kmr_msgs::action::ObjectSearch::Goal &,
+      kmr_msgs::action::ObjectSearch::Result & result) {
+      if (!search_latency->chance(object_found_probability)) {
+        result.error = "No object found";
+        return false;
+      }
+      result.success = true;
+      result.pose.header.frame_id = "camera_color_optical_frame";
+      result.pose.pose.position.z = 0.4;
+      result.pose.pose.orientation.w = 1.0;
+      return true;
+    });
+  MockActionServer<nav2_msgs::action::NavigateToPose> navigation_server(
+    server_node, "NavigateToPose", latency("navigate_to_pose", 2000.0),
+    [](const nav2_msgs::action::NavigateToPose::Goal &,
+    nav2_msgs::action::NavigateToPose::Result &) {
+      return true;
+    });
+
+  rclcpp::executors::MultiThreadedExecutor server_executor;
+  server_executor.add_node(server_node);
+  std::thread server_thread([&server_executor]() {server_executor.spin();});
+
+  // Set up the engine and blackboard the same way as behavior_tree_node
+  auto client_node = std::make_shared<rclcpp::Node>("bt_benchmark_client");
+  kmr_behavior_tree::BehaviorTreeEngine bt(plugin_lib_names);
+  bt.startCallbackExecutor(client_node);
+
+  auto blackboard = BT::Blackboard::create();
+  blackboard->set<rclcpp::Node::SharedPtr>("node", client_node);  // NOLINT
+  auto client_registry = std::make_shared<kmr_behavior_tree::ClientRegistry>(client_node);
+  blackboard->set<kmr_behavior_tree::ClientRegistry::Ptr>("client_registry", client_registry);
+  if (event_driven_ticks) {
+    blackboard->set<kmr_behavior_tree::TickNotifier::Ptr>("tick_notifier", bt.getTickNotifier());
+  }
+  kmr_behavior_tree::PlanPrefetcher::Ptr plan_prefetcher;
+  if (plan_lookahead) {
+    plan_prefetcher = std::make_shared<kmr_behavior_tree::PlanPrefetcher>(
+      client_node, client_registry, bt.getTickNotifier());
+    blackboard->set<kmr_behavior_tree::PlanPrefetcher::Ptr>("plan_prefetcher", plan_prefetcher);
+  }
+  geometry_msgs::msg::PoseStamped goal_pose;
+  goal_pose.header.frame_id = "map";
+  goal_pose.pose.orientation.w = 1.0;
+  blackboard->set("current_goalpose", goal_pose);
+
+  std::map<std::string, TreeResults> results;
+  for (const auto & filename : bt_xml_filenames) {
+    const std::string tree_name = filename.substr(filename.find_last_of('/') + 1);
+    BT::Tree * tree = bt.getTreeFromFile(filename, blackboard);
+    if (plan_prefetcher) {
+      plan_prefetcher->setFrameSequence(bt.getStaticPlanFrames(tree));
+    }
+    auto & tree_results = results[tree_name];
+
+    for (int cycle = 0; cycle <= cycles && rclcpp::ok(); ++cycle) {
+      blackboard->set<bool>("carryarea1", true);
+      blackboard->set<bool>("carryarea2", true);
+      blackboard->set<bool>("carryarea3", true);
+      blackboard->set<std::string>("current_frame", "driveposition");
+      if (plan_prefetcher) {
+        plan_prefetcher->clear();
+      }
+
+      // The engine checks for cancel right before every tick, and calls on_loop right after
+      TickedNodes ticked_nodes(tree->rootNode());
+      Clock::time_point tick_start;
+      uint64_t allocations_at_start = 0;
+      std::vector<double> tick_us;
+      uint64_t tick_allocations = 0;
+      std::map<std::string, NodeCost> nodes;
+
+      auto is_canceling = [&]() {
+          allocations_at_start = allocations;
+          tick_start = Clock::now();
+          return false;
+        };
+      auto on_loop = [&]() {
+          const double us =
+            std::chrono::duration<double, std::micro>(Clock::now() - tick_start).count();
+          tick_allocations += allocations - allocations_at_start;
+          tick_us.push_back(us);
+          // The cost of the tick is split evenly between the nodes ticked
+          const auto ticked = ticked_nodes.take(tree->rootNode());
+          for (const auto * ticked_node : ticked) {
+            auto & cost = nodes[ticked_node->name() + " (" + ticked_node->registrationName() + ")"];
+            ++cost.ticks;
+            cost.tick_us += us / ticked.size();
+          }
+        };
+
+      const auto started = Clock::now();
+      kmr_behavior_tree::BtStatus rc;
+      if (event_driven_ticks) {
+        rc = bt.runEventDriven(tree, on_loop, is_canceling, loop_period);
+      } else {
+        rc = bt.run(tree, on_loop, is_canceling, loop_period);
+      }
+      const double cycle_ms =
+        std::chrono::duration<double, std::milli>(Clock::now() - started).count();
+      bt.resetTree(tree);
+
+      // The first cycle waits for the servers to be discovered, and is left out
+      if (cycle == 0) {
+        continue;
+      }
+      tree_results.cycle_ms.push_back(cycle_ms);
+      tree_results.tick_us.insert(tree_results.tick_us.end(), tick_us.begin(), tick_us.end());
+      tree_results.allocations += tick_allocations;
+      if (rc == kmr_behavior_tree::BtStatus::SUCCEEDED) {
+        ++tree_results.succeeded;
+      }
+      for (const auto & entry : nodes) {
+        tree_results.nodes[entry.first].ticks += entry.second.ticks;
+        tree_results.nodes[entry.first].tick_us += entry.second.tick_us;
+      }
+    }
+  }
+
+  const auto baseline = baseline_file.empty() ?
+    std::map<std::string, double>() : readBaseline(baseline_file);
+  std::ostringstream output;
+  for (const auto & entry : results) {
+    std::printf("\n%s\n", entry.first.c_str());
+    for (const auto & metric : metrics(entry.second)) {
+      output << entry.first << " " << metric.first << " " << metric.second << "\n";
+      auto base = baseline.find(entry.first + " " + metric.first);
+      if (base != baseline.end() && base->second != 0.0) {
+        std::printf(
+          "  %-22s %12.2f  (baseline %.2f, %+.1f%%)\n", metric.first.c_str(), metric.second,
+          base->second, 100.0 * (metric.second - base->second) / base->second);
+      } else {
+        std::printf("  %-22s %12.2f\n", metric.first.c_str(), metric.second);
+      }
+    }
+    std::printf("  %-50s %10s %14s\n", "node", "ticks", "us per tick");
+    for (const auto & node_cost : entry.second.nodes) {
+      std::printf(
+        "  %-50s %10lu %14.2f\n", node_cost.first.c_str(),
+        static_cast<unsigned long>(node_cost.second.ticks),
+        node_cost.second.tick_us / node_cost.second.ticks);
+    }
+  }
+
+  if (!output_file.empty()) {
+    std::ofstream file(output_file);
+    file << output.str();
+    RCLCPP_INFO(LOGGER, "Results written to %s", output_file.c_str());
+  }
+
+  bt.stopCallbackExecutor();
+  server_executor.cancel();
+  server_thread.join();
+  rclcpp::shutdown();
+  return 0;
+}
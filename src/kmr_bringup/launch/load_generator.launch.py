@@ -0,0 +1,47 @@
+# Copyright 2019 Nina Marie Wahl and Charlotte Heggem.
+# Copyright 2019 Norwegian University of Science and Technology.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+from launch import LaunchDescription
+from launch.actions import DeclareLaunchArgument
+from launch.substitutions import LaunchConfiguration
+import launch_ros.actions
+
+
+def generate_launch_description():
+    robots = LaunchConfiguration('robots')
+    joint_state_rate = LaunchConfiguration('joint_state_rate')
+    odometry_rate = LaunchConfiguration('odometry_rate')
+    scan_rate = LaunchConfiguration('scan_rate')
+
+    return LaunchDescription([
+        DeclareLaunchArgument('robots', default_value='4'),
+        DeclareLaunchArgument('joint_state_rate', default_value='1000.0'),
+        DeclareLaunchArgument('odometry_rate', default_value='100.0'),
+        DeclareLaunchArgument('scan_rate', default_value='12.5'),
+
+        launch_ros.actions.Node(
+            package="kmr_bringup",
+            executable="dummy_joint_states",
+            name="dummy_joint_states",
+            output='screen',
+            parameters=[{'robots': robots,
+                         'namespace_prefix': 'robot',
+                         'joint_state_rate': joint_state_rate,
+                         'odometry_rate': odometry_rate,
+                         'scan_rate': scan_rate,
+                         'statistics_period': 5.0}],
+            ),
+
+    ])
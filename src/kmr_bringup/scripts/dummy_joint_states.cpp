@@ -1,4 +1,3 @@
-
 // Copyright 2019 Nina Marie Wahl and Charlotte Heggem.
 // Copyright 2019 Norwegian University of Science and Technology.
 //
@@ -14,16 +13,238 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+// Publishes fake sensor data for one or more robots. With the default parameters it publishes
+// the joint states of a single robot at 50 Hz, which is enough to visualize the manipulator.
+// For load testing it can emulate several robots, each in its own namespace, publishing joint
+// states, odometry and both laser scans at up to 1 kHz, and report the publish jitter.
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cmath>
-#include <iostream>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
-#include "rclcpp/clock.hpp"
 #include "rclcpp/rclcpp.hpp"
-#include "rclcpp/time_source.hpp"
 
+#include "nav_msgs/msg/odometry.hpp"
 #include "sensor_msgs/msg/joint_state.hpp"
+#include "sensor_msgs/msg/laser_scan.hpp"
+
+namespace
+{
+
+// Lateness of the publish calls compared to their schedule
+class PublishStatistics
+{
+public:
+  void add(double lateness_us)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    count_++;
+    sum_us_ += lateness_us;
+    sum_squared_us_ += lateness_us * lateness_us;
+    max_us_ = std::max(max_us_, lateness_us);
+  }
+
+  void addMissed(uint64_t missed)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    missed_ += missed;
+  }
+
+  // Logs and resets the statistics
+  void report(const rclcpp::Logger & logger, const std::string & topic, double period_s)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const double mean = count_ > 0 ? sum_us_ / count_ : 0.0;
+    const double variance = count_ > 0 ? sum_squared_us_ / count_ - mean * mean : 0.0;
+    RCLCPP_INFO(
+      logger, "%s: %.1f Hz, jitter mean %.1f us, std %.1f us, max %.1f us, %lu missed",
+      topic.c_str(), count_ / period_s, mean, std::sqrt(std::max(variance, 0.0)), max_us_,
+      static_cast<unsigned long>(missed_));
+    count_ = 0;
+    missed_ = 0;
+    sum_us_ = 0.0;
+    sum_squared_us_ = 0.0;
+    max_us_ = 0.0;
+  }
+
+private:
+  std::mutex mutex_;
+  uint64_t count_{0};
+  uint64_t missed_{0};
+  double sum_us_{0.0};
+  double sum_squared_us_{0.0};
+  double max_us_{0.0};
+};
+
+class StreamBase
+{
+public:
+  virtual ~StreamBase() = default;
+  virtual void stop() = 0;
+  virtual void report(double period_s) = 0;
+};
+
+// Publishes one topic at a fixed rate from its own thread. The message is allocated once and
+// updated in place, and is published by reference, so nothing is allocated while publishing.
+// No middleware can loan these messages, as they all have sequences of unbounded size.
+template<typename MessageT>
+class Stream : public StreamBase
+{
+public:
+  using Update = std::function<void (MessageT &, const rclcpp::Time &)>;
+
+  Stream(
+    const rclcpp::Node::SharedPtr & node, const std::string & topic, const rclcpp::QoS & qos,
+    double rate, MessageT && message, Update update)
+  : node_(node), message_(std::move(message)), update_(std::move(update)),
+    period_(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / rate)))
+  {
+    publisher_ = node_->create_publisher<MessageT>(topic, qos);
+    thread_ = std::thread(&Stream::run, this);
+  }
+
+  ~Stream() override
+  {
+    stop();
+  }
+
+  void stop() override
+  {
+    running_ = false;
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  void report(double period_s) override
+  {
+    statistics_.report(node_->get_logger(), publisher_->get_topic_name(), period_s);
+  }
+
+private:
+  void run()
+  {
+    auto next = std::chrono::steady_clock::now();
+    while (running_ && rclcpp::ok()) {
+      next += period_;
+      std::this_thread::sleep_until(next);
+
+      auto now = std::chrono::steady_clock::now();
+      statistics_.add(std::chrono::duration<double, std::micro>(now - next).count());
+      // Skips the deadlines that have already passed instead of publishing a burst
+      if (now - next > period_) {
+        const auto missed = (now - next) / period_;
+        statistics_.addMissed(missed);
+        next += missed * period_;
+      }
+
+      update_(message_, node_->now());
+      publisher_->publish(message_);
+    }
+  }
+
+  rclcpp::Node::SharedPtr node_;
+  typename rclcpp::Publisher<MessageT>::SharedPtr publisher_;
+  MessageT message_;
+  Update update_;
+  std::chrono::steady_clock::duration period_;
+  PublishStatistics statistics_;
+  std::atomic<bool> running_{true};
+  std::thread thread_;
+};
+
+sensor_msgs::msg::JointState makeJointState()
+{
+  sensor_msgs::msg::JointState msg;
+  msg.name = {"joint_a1", "joint_a2", "joint_a3", "joint_a4", "joint_a5", "joint_a6", "joint_a7"};
+  msg.position = {
+    -1.5810079050729513, 0.8167376905451679, -0.004375380628040148, -1.5857193233230227,
+    -7.76584250674877e-06, 0.7069321699035735, -0.8036188590817025};
+  return msg;
+}
+
+sensor_msgs::msg::LaserScan makeLaserScan(const std::string & frame_id)
+{
+  // Same format as the scans from kmr_communication
+  sensor_msgs::msg::LaserScan msg;
+  msg.header.frame_id = frame_id;
+  msg.angle_increment = static_cast<float>(0.5 * M_PI / 180.0);
+  msg.angle_min = static_cast<float>(-135.0 * M_PI / 180.0);
+  msg.angle_max = static_cast<float>(135.0 * M_PI / 180.0);
+  msg.range_min = 0.12f;
+  msg.range_max = 15.0f;
+  msg.ranges.resize(541);
+  return msg;
+}
+
+void addStreams(
+  const rclcpp::Node::SharedPtr & node, double joint_state_rate, double odometry_rate,
+  double scan_rate, std::vector<std::unique_ptr<StreamBase>> & streams)
+{
+  if (joint_state_rate > 0.0) {
+    auto counter = std::make_shared<double>(0.0);
+    streams.push_back(
+      std::make_unique<Stream<sensor_msgs::msg::JointState>>(
+        node, "joint_states", rclcpp::QoS(20), joint_state_rate, makeJointState(),
+        [counter](sensor_msgs::msg::JointState & msg, const rclcpp::Time & now) {
+          *counter += 0.000001;
+          for (auto & position : msg.position) {
+            position += *counter;
+          }
+          msg.position[3] += *counter;
+          msg.header.stamp = now;
+        }));
+  }
+
+  if (odometry_rate > 0.0) {
+    nav_msgs::msg::Odometry odometry;
+    odometry.header.frame_id = "odom";
+    odometry.child_frame_id = "base_footprint";
+    // Drives around a circle with a radius of 1 m at 0.2 m/s
+    odometry.twist.twist.linear.x = 0.2;
+    odometry.twist.twist.angular.z = 0.2;
+    streams.push_back(
+      std::make_unique<Stream<nav_msgs::msg::Odometry>>(
+        node, "odom", rclcpp::SensorDataQoS(), odometry_rate, std::move(odometry),
+        [](nav_msgs::msg::Odometry & msg, const rclcpp::Time & now) {
+          const double theta = 0.2 * now.seconds();
+          msg.pose.pose.position.x = std::sin(theta);
+          msg.pose.pose.position.y = 1.0 - std::cos(theta);
+          msg.pose.pose.orientation.z = std::sin(theta / 2);
+          msg.pose.pose.orientation.w = std::cos(theta / 2);
+          msg.header.stamp = now;
+        }));
+  }
+
+  if (scan_rate > 0.0) {
+    const std::vector<std::pair<std::string, std::string>> lasers = {
+      {"scan", "laser_B1_link"}, {"scan_2", "laser_B4_link"}};
+    for (const auto & laser : lasers) {
+      streams.push_back(
+        std::make_unique<Stream<sensor_msgs::msg::LaserScan>>(
+          node, laser.first, rclcpp::SensorDataQoS(), scan_rate, makeLaserScan(laser.second),
+          [](sensor_msgs::msg::LaserScan & msg, const rclcpp::Time & now) {
+            // A wall at a few metres which moves slowly, so consecutive scans differ
+            const double phase = now.seconds();
+            for (size_t i = 0; i < msg.ranges.size(); ++i) {
+              msg.ranges[i] = static_cast<float>(3.0 + std::sin(i * 0.02 + phase));
+            }
+            msg.header.stamp = now;
+          }));
+    }
+  }
+}
+
+}  // namespace
 
 int main(int argc, char * argv[])
 {
@@ -31,53 +252,50 @@ int main(int argc, char * argv[])
 
   auto node = rclcpp::Node::make_shared("dummy_joint_states");
 
-  auto joint_state_pub = node->create_publisher<sensor_msgs::msg::JointState>("/joint_states", 20);
+  const int robots = node->declare_parameter<int>("robots", 1);
+  const auto namespace_prefix = node->declare_parameter<std::string>("namespace_prefix", "robot");
+  const double joint_state_rate = node->declare_parameter<double>("joint_state_rate", 50.0);
+  const double odometry_rate = node->declare_parameter<double>("odometry_rate", 0.0);
+  const double scan_rate = node->declare_parameter<double>("scan_rate", 0.0);
+  const double statistics_period = node->declare_parameter<double>("statistics_period", 0.0);
 
-  rclcpp::WallRate loop_rate(50);
+  rclcpp::executors::SingleThreadedExecutor executor;
+  executor.add_node(node);
 
-  sensor_msgs::msg::JointState msg;
-    msg.name.push_back("joint_a1");
-    msg.name.push_back("joint_a2");
-    msg.name.push_back("joint_a3");
-    msg.name.push_back("joint_a4");
-    msg.name.push_back("joint_a5");
-    msg.name.push_back("joint_a6");
-    msg.name.push_back("joint_a7");
-
-    msg.position.push_back(-1.5810079050729513);
-    msg.position.push_back(0.8167376905451679);
-    msg.position.push_back(-0.004375380628040148);
-    msg.position.push_back(-1.5857193233230227);
-    msg.position.push_back(-7.76584250674877e-06);
-    msg.position.push_back(0.7069321699035735);
-    msg.position.push_back(-0.8036188590817025);
-
-
-  rclcpp::TimeSource ts(node);
-  rclcpp::Clock::SharedPtr clock = std::make_shared<rclcpp::Clock>(RCL_ROS_TIME);
-  ts.attachClock(clock);
-
-  auto counter = 0.0;
-  auto joint_value = 0.0;
-
-  while (rclcpp::ok()) {
-    counter += 0.000001;
-    joint_value = counter;
-    //joint_value_2 = std::sin(counter);
-
-
-    for (size_t i = 0; i < msg.name.size(); ++i) {
-      msg.position[i] = msg.position[i] +counter;
+  // A single robot publishes on the topics of the real robot. Several robots each get a node
+  // in the namespace <namespace_prefix>_<i>.
+  std::vector<rclcpp::Node::SharedPtr> robot_nodes;
+  if (robots <= 1) {
+    robot_nodes.push_back(node);
+  } else {
+    for (int i = 0; i < robots; ++i) {
+      robot_nodes.push_back(
+        rclcpp::Node::make_shared(
+          "dummy_joint_states", namespace_prefix + "_" + std::to_string(i)));
+      executor.add_node(robot_nodes.back());
     }
-    msg.position[3] = msg.position[3] +counter;
+  }
+
+  std::vector<std::unique_ptr<StreamBase>> streams;
+  for (const auto & robot_node : robot_nodes) {
+    addStreams(robot_node, joint_state_rate, odometry_rate, scan_rate, streams);
+  }
 
-    msg.header.stamp = clock->now();
+  rclcpp::TimerBase::SharedPtr statistics_timer;
+  if (statistics_period > 0.0) {
+    statistics_timer = node->create_wall_timer(
+      std::chrono::duration<double>(statistics_period), [&streams, statistics_period]() {
+        for (auto & stream : streams) {
+          stream->report(statistics_period);
+        }
+      });
+  }
 
-    joint_state_pub->publish(msg);
-    rclcpp::spin_some(node);
-    loop_rate.sleep();
-  } 
+  executor.spin();
 
+  for (auto & stream : streams) {
+    stream->stop();
+  }
   rclcpp::shutdown();
 
   return 0;
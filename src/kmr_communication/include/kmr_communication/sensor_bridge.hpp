@@ -0,0 +1,187 @@
+// Copyright 2019 Nina Marie Wahl and Charlotte Heggem.
+// Copyright 2019 Norwegian University of Science and Technology.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KMR_COMMUNICATION__SENSOR_BRIDGE_HPP_
+#define KMR_COMMUNICATION__SENSOR_BRIDGE_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
+#include "kmr_msgs/msg/kmp_statusdata.hpp"
+#include "kmr_msgs/msg/lbr_statusdata.hpp"
+#include "nav_msgs/msg/odometry.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "sensor_msgs/msg/joint_state.hpp"
+#include "sensor_msgs/msg/laser_scan.hpp"
+#include "tf2_ros/transform_broadcaster.h"
+
+namespace kmr_communication
+{
+
+// C++ port of ClockOffsetEstimator in nodes/latency.py, which documents the estimate. The two
+// must be kept the same, so the bridge stamps the messages as the separate Python nodes do.
+class ClockOffsetEstimator
+{
+public:
+  ClockOffsetEstimator(int64_t scale, size_t window);
+
+  // Returns the acquisition time of the message in ROS time, in ns
+  int64_t update(int64_t controller_time, int64_t receive_time);
+
+  // The current offset in ns, false before the first message
+  bool offset(int64_t & offset) const;
+
+private:
+  int64_t scale_;
+  size_t window_;
+  uint64_t count_{0};
+  // (message number, offset) with increasing offsets
+  std::deque<std::pair<uint64_t, int64_t>> minima_;
+  // The estimate is updated by the receiving thread and read by the diagnostics timer
+  mutable std::mutex mutex_;
+};
+
+// C++ port of LatencyHistogram in nodes/latency.py, with the same buckets and diagnostic keys
+class LatencyHistogram
+{
+public:
+  LatencyHistogram();
+
+  void add(int64_t latency_ns);
+
+  // Appends the latencies added since the last call to values, and starts over
+  void appendKeyValues(
+    const std::string & stage, std::vector<diagnostic_msgs::msg::KeyValue> & values);
+
+private:
+  static const std::vector<double> kBucketsMs;
+
+  void reset();
+
+  std::mutex mutex_;
+  std::vector<uint64_t> counts_;
+  double total_ms_{0.0};
+  double max_ms_{0.0};
+};
+
+// Receives all KMP and LBR sensor and status streams over the single connection of the
+// multiplexed sensor socket on the Sunrise side, and publishes them on the topics of
+// kmp_laserscan_node, kmp_odometry_node, kmp_statusdata_node, lbr_statusdata_node and
+// lbr_sensordata_node. The messages have the same format as on the separate connections,
+// and are told apart by their type.
+class SensorBridge : public rclcpp::Node
+{
+public:
+  explicit SensorBridge(const rclcpp::NodeOptions & options);
+  ~SensorBridge() override;
+
+private:
+  void run();
+
+  bool acceptConnection();
+
+  bool receiveExactly(uint8_t * data, size_t length);
+
+  void closeConnection();
+
+  void handlePayload(const std::vector<uint8_t> & payload, int64_t receive_time);
+
+  void handleTextMessage(const std::vector<std::string> & tokens, int64_t receive_time);
+
+  void publishLaserScan(
+    const std::string & timestamp, const std::string & laser_id, std::vector<float> && ranges,
+    int64_t receive_time);
+
+  void publishOdometry(const std::vector<std::string> & tokens, int64_t receive_time);
+
+  void publishKmpStatus(const std::string & data);
+
+  void publishLbrStatus(const std::string & data);
+
+  void publishLbrSensordata(const std::string & data);
+
+  // True if the last message of the stream had the same controller timestamp
+  bool isRepeated(const std::string & stream, const std::string & timestamp);
+
+  // Publishes the message counters of the streams and the latencies on /diagnostics, as
+  // BufferDiagnostics in nodes/ring_buffer.py does for the Python nodes
+  void publishDiagnostics();
+
+  // The latencies from the acquisition of a message to its receipt by the bridge, from then
+  // to the parsed message, and of the publish call. The bridge publishes from the receiving
+  // thread, so there is no queue stage as in the Python nodes.
+  struct StageLatencies
+  {
+    LatencyHistogram receive;
+    LatencyHistogram parse;
+    LatencyHistogram publish;
+  };
+
+  void addLatencies(
+    StageLatencies & latencies, int64_t acquisition_time, int64_t receive_time,
+    int64_t parse_time);
+
+  // Messages received per stream and how many of them were skipped as repeated
+  struct StreamCounters
+  {
+    uint64_t received = 0;
+    uint64_t repeated = 0;
+  };
+
+  std::string ip_;
+  int port_;
+  bool binary_laser_;
+
+  std::atomic<bool> running_{true};
+  std::atomic<int> server_fd_{-1};
+  std::atomic<int> connection_fd_{-1};
+  std::thread thread_;
+
+  // The FDI laser scan and odometry timestamps are in ms
+  ClockOffsetEstimator fdi_clock_;
+
+  // Controller timestamps of the last published messages, to skip repeated messages
+  std::map<std::string, std::string> last_timestamps_;
+
+  std::mutex counters_mutex_;
+  std::map<std::string, StreamCounters> stream_counters_;
+  std::atomic<uint64_t> parse_errors_{0};
+  std::atomic<uint64_t> connections_{0};
+  StageLatencies laser_latencies_;
+  StageLatencies odometry_latencies_;
+
+  rclcpp::Publisher<sensor_msgs::msg::LaserScan>::SharedPtr scan_publisher_1_;
+  rclcpp::Publisher<sensor_msgs::msg::LaserScan>::SharedPtr scan_publisher_2_;
+  rclcpp::Publisher<nav_msgs::msg::Odometry>::SharedPtr odometry_publisher_;
+  rclcpp::Publisher<kmr_msgs::msg::KmpStatusdata>::SharedPtr kmp_status_publisher_;
+  rclcpp::Publisher<kmr_msgs::msg::LbrStatusdata>::SharedPtr lbr_status_publisher_;
+  rclcpp::Publisher<sensor_msgs::msg::JointState>::SharedPtr joint_state_publisher_;
+  std::shared_ptr<tf2_ros::TransformBroadcaster> tf_broadcaster_;
+  rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr diagnostics_publisher_;
+  rclcpp::TimerBase::SharedPtr diagnostics_timer_;
+};
+
+}  // namespace kmr_communication
+
+#endif  // KMR_COMMUNICATION__SENSOR_BRIDGE_HPP_
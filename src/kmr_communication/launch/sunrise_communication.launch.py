@@ -22,6 +22,8 @@ from launch.actions import IncludeLaunchDescription
 from launch.launch_description_sources import PythonLaunchDescriptionSource
 from launch.substitutions import LaunchConfiguration
 import launch_ros.actions
+from launch_ros.actions import ComposableNodeContainer
+from launch_ros.descriptions import ComposableNode
 import sys
 from rclpy.utilities import remove_ros_args
 import argparse
@@ -34,6 +36,11 @@ def generate_launch_description(argv=sys.argv[1:]):
 
     robot = "KMR2"
 
+    # Multiplexed is 'true' to receive all sensor and status data over one connection, demultiplexed
+    # by the C++ sensor bridge, instead of one connection and process per stream. Set
+    # multiplexed_sensors in the Sunrise application to match.
+    multiplexed = 'false'
+
     param_dir = LaunchConfiguration(
         'param_dir',
         default=os.path.join(
@@ -41,6 +48,49 @@ def generate_launch_description(argv=sys.argv[1:]):
             'param',
             'bringup.yaml'))
 
+    command_nodes = [
+        launch_ros.actions.Node(
+            package="kmr_communication",
+            executable="kmp_commands_node.py",
+            name="kmp_commands_node",
+            output="screen",
+            emulate_tty=True,
+            arguments=['-c', connection_type_TCP,'-ro', robot],
+            parameters=[param_dir]),
+
+        launch_ros.actions.Node(
+            package="kmr_communication",
+            executable="lbr_commands_node.py",
+            name="lbr_commands_node",
+            output="screen",
+            emulate_tty=True,
+            arguments=['-c', connection_type_TCP, '-ro', robot],
+            parameters=[param_dir]),
+    ]
+
+    if multiplexed == 'true':
+        return LaunchDescription([
+            DeclareLaunchArgument(
+                'param_dir',
+                default_value=param_dir,
+                description='Full path to parameter file to load'),
+
+            ComposableNodeContainer(
+                name='sensor_bridge_container',
+                namespace='',
+                package='rclcpp_components',
+                executable='component_container',
+                composable_node_descriptions=[
+                    ComposableNode(
+                        package='kmr_communication',
+                        plugin='kmr_communication::SensorBridge',
+                        name='sensor_bridge',
+                        parameters=[param_dir, {'robot': robot}]),
+                ],
+                output='screen',
+                emulate_tty=True),
+        ] + command_nodes)
+
     return LaunchDescription([
         DeclareLaunchArgument(
             'param_dir',
@@ -61,15 +111,6 @@ def generate_launch_description(argv=sys.argv[1:]):
 #            arguments=['0','0','0','0','0','0','laser_B1_link','scan'],
 #           ),
 
-        launch_ros.actions.Node(
-            package="kmr_communication",
-            executable="kmp_commands_node.py",
-            name="kmp_commands_node",
-            output="screen",
-            emulate_tty=True,
-            arguments=['-c', connection_type_TCP,'-ro', robot],
-            parameters=[param_dir]),
-
         launch_ros.actions.Node(
            package="kmr_communication",
            executable="kmp_laserscan_node.py",
@@ -97,15 +138,6 @@ def generate_launch_description(argv=sys.argv[1:]):
            arguments=['-c', connection_type_TCP, '-ro', robot],
            parameters=[param_dir]),
 
-        launch_ros.actions.Node(
-            package="kmr_communication",
-            executable="lbr_commands_node.py",
-            name="lbr_commands_node",
-            output="screen",
-            emulate_tty=True,
-            arguments=['-c', connection_type_TCP, '-ro', robot],
-            parameters=[param_dir]),
-
         launch_ros.actions.Node(
             package="kmr_communication",
             executable="lbr_statusdata_node.py",
@@ -123,4 +155,4 @@ def generate_launch_description(argv=sys.argv[1:]):
             emulate_tty=True,
             arguments=['-c', connection_type_TCP, '-ro', robot],
             parameters=[param_dir]),
-    ])
+    ] + command_nodes)
@@ -16,6 +16,7 @@
 # limitations under the License.
 
 import _thread as thread
+import threading
 import time
 import os
 import sys
@@ -36,6 +37,8 @@ import argparse
 
 from tcpSocket import TCPSocket
 from udpSocket import UDPSocket
+from ring_buffer import BufferDiagnostics
+from latency import ClockOffsetEstimator, LatencyHistogram
 
 
 def cl_red(msge): return '\033[31m' + msge + '\033[0m'
@@ -48,6 +51,12 @@ class KmpLaserScanNode(Node):
         self.name='kmp_laserscan_node'
         self.declare_parameter('port')
         port = int(self.get_parameter('port').value)
+        # Offer the binary laser scan frames to the controller, see kmp_protocol.py
+        self.declare_parameter('binary_laser', True)
+        binary_laser = bool(self.get_parameter('binary_laser').value)
+        # Capacity of the socket buffers, see ring_buffer.py
+        self.declare_parameter('queue_size', 10)
+        queue_size = int(self.get_parameter('queue_size').value)
         if robot == 'KMR1':
             self.declare_parameter('KMR1/ip')
             ip = str(self.get_parameter('KMR1/ip').value)
@@ -58,40 +67,52 @@ class KmpLaserScanNode(Node):
             ip = None
 
         if connection_type == 'TCP':
-            self.soc = TCPSocket(ip, port,self.name)
+            self.soc = TCPSocket(ip, port,self.name, binary_laser, queue_size)
         elif connection_type == 'UDP':
-            self.soc = UDPSocket(ip, port,self.name)
+            self.soc = UDPSocket(ip, port,self.name, binary_laser, queue_size)
         else:
             self.soc = None
 
 
-        self.last_scan_timestamp = 0
-
-
         # Make Publishers for relevant data
         self.pub_laserscan1 = self.create_publisher(LaserScan, 'scan', qos_profile_sensor_data)
         self.pub_laserscan2 = self.create_publisher(LaserScan, 'scan_2', qos_profile_sensor_data)
 
 
+        # Scans are stamped with their acquisition time, the FDI timestamps are in ms
+        self.clock = ClockOffsetEstimator(scale=1000000)
+        self.latency = {'receive': LatencyHistogram(), 'queue': LatencyHistogram(),
+                        'parse': LatencyHistogram(), 'publish': LatencyHistogram()}
+
+        self.diagnostics = BufferDiagnostics(self, {'laserScanB1': self.soc.laserScanB1,
+                                                    'laserScanB4': self.soc.laserScanB4},
+                                             self.latency, self.clock)
+
         while not self.soc.isconnected:
-        	pass
+            time.sleep(0.01)
         self.get_logger().info('Node is ready')
 
+        # One publishing thread per scanner, each the only consumer of its buffer
+        self.last_scan_timestamp = {}
+        threading.Thread(target=self.publish_scans, args=(self.soc.laserScanB1,), daemon=True).start()
+        threading.Thread(target=self.publish_scans, args=(self.soc.laserScanB4,), daemon=True).start()
 
+    def publish_scans(self, buffer):
         while rclpy.ok() and self.soc.isconnected:
-            if len(self.soc.laserScanB1):
-                self.scan_callback(self.pub_laserscan1, self.soc.laserScanB1.pop(0))
-            if len(self.soc.laserScanB4):
-                self.scan_callback(self.pub_laserscan2, self.soc.laserScanB4.pop(0))
-
+            item = buffer.get(timeout=0.1)
+            if item is not None:
+                receive_time, values = item
+                self.scan_callback(values, receive_time)
 
 
-    def scan_callback(self, publisher, values):
-        if (len(values) == 4 and values[1] != self.last_scan_timestamp):
+    def scan_callback(self, values, receive_time):
+        if (len(values) == 4 and values[1] != self.last_scan_timestamp.get(values[2])):
+            dequeue_time = time.time_ns()
             kmr_timestamp = values[1]
-            self.last_scan_timestamp = kmr_timestamp
+            self.last_scan_timestamp[values[2]] = kmr_timestamp
+            acquisition_time = self.clock.update(kmr_timestamp, receive_time)
             scan = LaserScan()
-            scan.header.stamp = self.get_clock().now().to_msg()
+            scan.header.stamp = Time(sec=acquisition_time // 1000000000, nanosec=acquisition_time % 1000000000)
             if values[2] == '1801':
                 scan.header.frame_id = "laser_B1_link"
             elif values[2] == '1802':
@@ -102,14 +123,26 @@ class KmpLaserScanNode(Node):
             scan.range_min = 0.12
             scan.range_max = 15.0
             try:
-                scan.ranges = [float(s) for s in values[3].split(',') if len(s)>0]
+                if isinstance(values[3], str):
+                    scan.ranges = [float(s) for s in values[3].split(',') if len(s)>0]
+                else:
+                    # Already decoded from a binary frame
+                    scan.ranges = values[3]
             except ValueError as e:
                 print(values[3].split(','))
                 print("Error", e)
+            parse_time = time.time_ns()
             if scan.header.frame_id == "laser_B1_link":
                 self.pub_laserscan1.publish(scan)
             elif scan.header.frame_id == "laser_B4_link":
                 self.pub_laserscan2.publish(scan)
+            publish_time = time.time_ns()
+
+            # The receive latency is the transport delay above the smallest one in the clock window
+            self.latency['receive'].add(receive_time - acquisition_time)
+            self.latency['queue'].add(dequeue_time - receive_time)
+            self.latency['parse'].add(parse_time - dequeue_time)
+            self.latency['publish'].add(publish_time - parse_time)
 
 
 
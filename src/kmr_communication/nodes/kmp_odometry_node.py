@@ -16,6 +16,8 @@
 # limitations under the License.
 
 import _thread as thread
+import threading
+import time
 import sys
 import math
 import rclpy
@@ -30,6 +32,8 @@ import argparse
 
 from tcpSocket import TCPSocket
 from udpSocket import UDPSocket
+from ring_buffer import BufferDiagnostics
+from latency import ClockOffsetEstimator, LatencyHistogram
 
 
 def cl_red(msge): return '\033[31m' + msge + '\033[0m'
@@ -42,6 +46,9 @@ class KmpOdometryNode(Node):
         self.name='kmp_odometry_node'
         self.declare_parameter('port')
         port = int(self.get_parameter('port').value)
+        # Capacity of the socket buffers, see ring_buffer.py
+        self.declare_parameter('queue_size', 10)
+        queue_size = int(self.get_parameter('queue_size').value)
         if robot == 'KMR1':
             self.declare_parameter('KMR1/ip')
             ip = str(self.get_parameter('KMR1/ip').value)
@@ -53,9 +60,9 @@ class KmpOdometryNode(Node):
 
 
         if connection_type == 'TCP':
-            self.soc = TCPSocket(ip,port,self.name)
+            self.soc = TCPSocket(ip,port,self.name, queue_size=queue_size)
         elif connection_type == 'UDP':
-            self.soc=UDPSocket(ip,port,self.name)
+            self.soc=UDPSocket(ip,port,self.name, queue_size=queue_size)
         else:
             self.soc=None
 
@@ -67,17 +74,33 @@ class KmpOdometryNode(Node):
         # Create tf broadcaster
         self.tf_broadcaster = TransformBroadcaster(self)
 
+        # Odometry is stamped with its acquisition time, the FDI timestamps are in ms
+        self.clock = ClockOffsetEstimator(scale=1000000)
+        self.latency = {'receive': LatencyHistogram(), 'queue': LatencyHistogram(),
+                        'parse': LatencyHistogram(), 'publish': LatencyHistogram()}
+
+        self.diagnostics = BufferDiagnostics(self, {'odometry': self.soc.odometry},
+                                             self.latency, self.clock)
+
         while not self.soc.isconnected:
-            pass
+            time.sleep(0.01)
         self.get_logger().info('Node is ready')
 
+        threading.Thread(target=self.publish_odometry, daemon=True).start()
+
+    def publish_odometry(self):
         while rclpy.ok() and self.soc.isconnected:
-            self.odom_callback(self.pub_odometry, self.soc.odometry)
+            item = self.soc.odometry.get(timeout=0.1)
+            if item is not None:
+                receive_time, values = item
+                self.odom_callback(self.pub_odometry, values, receive_time)
 
-    def odom_callback(self, publisher, values):
+    def odom_callback(self, publisher, values, receive_time):
         if (len(values) == 8 and values[1] != self.last_odom_timestamp):
+            dequeue_time = time.time_ns()
             kmr_timestamp = values[1]
             self.last_odom_timestamp = kmr_timestamp
+            acquisition_time = self.clock.update(kmr_timestamp, receive_time)
 
             x = float(values[2].split(":")[1])
             y = float(values[3].split(":")[1])
@@ -88,7 +111,7 @@ class KmpOdometryNode(Node):
 
 
             odom = Odometry()
-            odom.header.stamp = self.get_clock().now().to_msg()
+            odom.header.stamp = Time(sec=acquisition_time // 1000000000, nanosec=acquisition_time % 1000000000)
             odom.header.frame_id = "odom"
 
             point = Point()
@@ -130,8 +153,16 @@ class KmpOdometryNode(Node):
             odom_tf.header.frame_id = odom.header.frame_id
             odom_tf.child_frame_id = odom.child_frame_id
             odom_tf.header.stamp = odom.header.stamp
+            parse_time = time.time_ns()
             self.tf_broadcaster.sendTransform(odom_tf)
             publisher.publish(odom)
+            publish_time = time.time_ns()
+
+            # The receive latency is the transport delay above the smallest one in the clock window
+            self.latency['receive'].add(receive_time - acquisition_time)
+            self.latency['queue'].add(dequeue_time - receive_time)
+            self.latency['parse'].add(parse_time - dequeue_time)
+            self.latency['publish'].add(publish_time - parse_time)
 
 
     def euler_to_quaternion(self, roll, pitch, yaw):
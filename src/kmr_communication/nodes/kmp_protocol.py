@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+
+# Copyright 2019 Nina Marie Wahl and Charlotte Heggem.
+# Copyright 2019 Norwegian University of Science and Technology.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Binary frames sent by the Sunrise controller instead of the text messages, when both sides
+# support them. The ROS side offers them when a connection is made, and the controller keeps
+# sending text if it does not understand the offer:
+#  - TCP: BINARY_LASER_OFFER is sent as the first line after the connection is accepted.
+#  - UDP: BINARY_LASER_OFFER is appended to the "hello KUKA" reply.
+#
+# A binary laser scan frame is, in network byte order:
+#   uint8   frame type (FRAME_LASER_SCAN)
+#   uint8   protocol version (PROTOCOL_VERSION)
+#   uint16  laser id (1801 or 1802)
+#   int64   controller timestamp in ms
+#   uint32  number of ranges
+#   float32 ranges[number of ranges]
+# Over TCP the frame has the same length prefix as the text messages. Text messages start
+# with '>', so the first byte tells the two apart.
+
+import array
+import struct
+import sys
+
+BINARY_LASER_OFFER = 'binary_laser'
+
+FRAME_LASER_SCAN = 0x01
+PROTOCOL_VERSION = 1
+
+LASER_SCAN_HEADER = struct.Struct('>BBHqI')
+
+
+def is_binary_frame(payload):
+    return len(payload) > 0 and payload[0] == FRAME_LASER_SCAN
+
+
+def decode_laser_scan(payload):
+    '''
+    Decodes a binary laser scan frame.
+    Returns the message in the same form as a split text message, with the ranges already
+    converted: ['laserScan', timestamp, laser id, ranges], or None if the frame is invalid.
+    @param payload: The frame, without the TCP length prefix.
+    @type payload: bytes
+    '''
+    if len(payload) < LASER_SCAN_HEADER.size:
+        return None
+    frame_type, version, laser_id, timestamp, count = LASER_SCAN_HEADER.unpack_from(payload)
+    if (frame_type != FRAME_LASER_SCAN or version != PROTOCOL_VERSION or
+            len(payload) != LASER_SCAN_HEADER.size + 4 * count):
+        return None
+
+    # array.array('f') is taken as it is by LaserScan.ranges
+    ranges = array.array('f')
+    ranges.frombytes(memoryview(payload)[LASER_SCAN_HEADER.size:])
+    if sys.byteorder == 'little':
+        ranges.byteswap()
+    return ['laserScan', str(timestamp), str(laser_id), ranges]
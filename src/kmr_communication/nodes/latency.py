@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+
+# Copyright 2019 Nina Marie Wahl and Charlotte Heggem.
+# Copyright 2019 Norwegian University of Science and Technology.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import bisect
+import collections
+import threading
+
+from diagnostic_msgs.msg import KeyValue
+
+
+class ClockOffsetEstimator:
+    '''
+    Maps controller timestamps to ROS time.
+    The difference between the receive time and the controller timestamp of a message is the
+    offset between the clocks plus the transport delay. The smallest difference within a sliding
+    window of messages is the offset plus the smallest delay, which is the best estimate that is
+    possible without round trips. The window lets the estimate follow drift between the clocks.
+    The sensor bridge (src/sensor_bridge.cpp) has a C++ port of this class and of
+    LatencyHistogram, which must be changed together with them.
+    @param scale: Nanoseconds per unit of the controller timestamps
+    @param window: Number of messages in the window
+    '''
+    def __init__(self, scale, window=500):
+        self.scale = scale
+        self.window = window
+        self.offset = None
+        # (message number, offset) with increasing offsets, the first is the smallest in the window
+        self.__minima = collections.deque()
+        self.__count = 0
+        self.__lock = threading.Lock()
+
+    def update(self, controller_time, receive_time):
+        '''
+        Adds a message to the estimate and returns its acquisition time in ROS time, in ns.
+        @param controller_time: The controller timestamp of the message
+        @param receive_time: The time.time_ns() at which the message was received
+        '''
+        controller_ns = int(controller_time) * self.scale
+        offset = receive_time - controller_ns
+        with self.__lock:
+            while self.__minima and self.__minima[-1][1] >= offset:
+                self.__minima.pop()
+            self.__minima.append((self.__count, offset))
+            if self.__minima[0][0] <= self.__count - self.window:
+                self.__minima.popleft()
+            self.__count += 1
+            self.offset = self.__minima[0][1]
+            return controller_ns + self.offset
+
+
+class LatencyHistogram:
+    '''
+    Latencies of one stage of the sensor pipeline, in buckets of BUCKETS_MS milliseconds.
+    The diagnostics report the latencies added since the last report.
+    '''
+    BUCKETS_MS = (1, 2, 5, 10, 20, 50, 100, 200, 500)
+
+    def __init__(self):
+        self.__lock = threading.Lock()
+        self.__reset()
+
+    def __reset(self):
+        self.__counts = [0] * (len(self.BUCKETS_MS) + 1)
+        self.__total = 0
+        self.__max = 0
+
+    def add(self, latency_ns):
+        latency_ms = latency_ns * 1e-6
+        with self.__lock:
+            self.__counts[bisect.bisect_left(self.BUCKETS_MS, latency_ms)] += 1
+            self.__total += latency_ms
+            self.__max = max(self.__max, latency_ms)
+
+    def key_values(self, stage):
+        with self.__lock:
+            counts, total, maximum = self.__counts, self.__total, self.__max
+            self.__reset()
+        count = sum(counts)
+        values = [KeyValue(key=stage + ' count', value=str(count)),
+                  KeyValue(key=stage + ' mean ms', value='%.2f' % (total / count if count else 0.0)),
+                  KeyValue(key=stage + ' max ms', value='%.2f' % maximum)]
+        lower = 0
+        for upper, bucket in zip(self.BUCKETS_MS + (None,), counts):
+            name = ('%d-%d ms' % (lower, upper)) if upper else ('>%d ms' % lower)
+            values.append(KeyValue(key=stage + ' ' + name, value=str(bucket)))
+            lower = upper
+        return values
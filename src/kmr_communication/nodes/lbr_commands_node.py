@@ -28,7 +28,7 @@ from kmr_msgs.msg import LbrStatusdata
 from kmr_msgs.action import MoveManipulator
 from tcpSocket import TCPSocket
 from udpSocket import UDPSocket
-from rclpy.action import ActionServer, GoalResponse
+from rclpy.action import ActionServer, CancelResponse, GoalResponse
 from rclpy.callback_groups import ReentrantCallbackGroup
 from rclpy.executors import MultiThreadedExecutor
 
@@ -68,7 +68,7 @@ class LbrCommandsNode(Node):
         sub_manipulator_vel = self.create_subscription(String, 'manipulator_vel', self.manipulatorVel_callback, 10)
         sub_shutdown = self.create_subscription(String, 'shutdown', self.shutdown_callback, 10)
         sub_statusdata=self.create_subscription(LbrStatusdata, 'lbr_statusdata', self.status_callback, 10,callback_group=self.callback_group)
-        self.path_server = ActionServer(self,MoveManipulator,'move_manipulator', self.move_manipulator_callback,callback_group=self.callback_group)
+        self.path_server = ActionServer(self,MoveManipulator,'move_manipulator', self.move_manipulator_callback,callback_group=self.callback_group,cancel_callback=self.cancel_callback)
 
         self.point_publisher = self.create_publisher(Float64, 'vinkel', 20)
 
@@ -102,10 +102,20 @@ class LbrCommandsNode(Node):
         while (not self.done_moving):
             pass
         result = MoveManipulator.Result()
+        if goal_handle.is_cancel_requested:
+            result.error = 'Path stopped'
+            goal_handle.canceled()
+            return result
         result.success = True
         goal_handle.succeed()
         return result
 
+    def cancel_callback(self, goal_handle):
+        # Stops the manipulator where it is, e.g. when a sweep is preempted by a detection. The
+        # goal ends when the robot reports the path as finished.
+        self.soc.send('setLBRmotion a0 0')
+        return CancelResponse.ACCEPT
+
     def path_callback(self, data):
         i=1
         for point in data.points:
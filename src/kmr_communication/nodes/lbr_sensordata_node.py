@@ -16,6 +16,7 @@
 # limitations under the License.
 
 import _thread as thread
+import threading
 import time
 import os
 import sys
@@ -38,6 +39,7 @@ import numpy as np
 
 from tcpSocket import TCPSocket
 from udpSocket import UDPSocket
+from ring_buffer import BufferDiagnostics
 
 
 def cl_red(msge): return '\033[31m' + msge + '\033[0m'
@@ -50,6 +52,9 @@ class LbrSensordataNode(Node):
         self.name='lbr_sensordate_node'
         self.declare_parameter('port')
         port = int(self.get_parameter('port').value)
+        # Capacity of the socket buffers, see ring_buffer.py
+        self.declare_parameter('queue_size', 10)
+        queue_size = int(self.get_parameter('queue_size').value)
         if robot == 'KMR1':
             self.declare_parameter('KMR1/ip')
             ip = str(self.get_parameter('KMR1/ip').value)
@@ -60,9 +65,9 @@ class LbrSensordataNode(Node):
             ip = None
 
         if connection_type == 'TCP':
-            self.soc = TCPSocket(ip, port,self.name)
+            self.soc = TCPSocket(ip, port,self.name, queue_size=queue_size)
         elif connection_type == 'UDP':
-            self.soc = UDPSocket(ip, port,self.name)
+            self.soc = UDPSocket(ip, port,self.name, queue_size=queue_size)
         else:
             self.soc = None
 
@@ -75,14 +80,20 @@ class LbrSensordataNode(Node):
         self.pub_lbr_sensordata = self.create_publisher(JointState, 'joint_states', 20)
         self.joint_names = ["joint_a1","joint_a2","joint_a3","joint_a4","joint_a5","joint_a6","joint_a7"]
 
+        self.diagnostics = BufferDiagnostics(self, {'lbr_sensordata': self.soc.lbr_sensordata})
+
         while not self.soc.isconnected:
-            pass
+            time.sleep(0.01)
         self.get_logger().info('Node is ready')
 
+        threading.Thread(target=self.publish_data, daemon=True).start()
+
+    def publish_data(self):
         while rclpy.ok() and self.soc.isconnected:
-            if len(self.soc.lbr_sensordata):
-                # lbr_sensordata is data received over the socket.
-                self.data_callback(self.pub_lbr_sensordata, self.soc.lbr_sensordata.pop(0))
+            # lbr_sensordata is data received over the socket.
+            item = self.soc.lbr_sensordata.get(timeout=0.1)
+            if item is not None:
+                self.data_callback(self.pub_lbr_sensordata, item[1])
 
     def data_callback(self, publisher, values):
         data=values[1]
@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+
+# Copyright 2019 Nina Marie Wahl and Charlotte Heggem.
+# Copyright 2019 Norwegian University of Science and Technology.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import collections
+import threading
+
+from diagnostic_msgs.msg import DiagnosticArray, DiagnosticStatus, KeyValue
+
+
+class RingBuffer:
+    '''
+    Bounded queue between the socket thread, which puts the received data, and the one node
+    thread that publishes it. When the buffer is full the oldest item is dropped, so a slow
+    publisher always gets the most recent data.
+    A deque with maxlen is a ring buffer where append and popleft are atomic, so the data itself
+    is passed without a lock. The event only wakes up the consumer when the buffer is empty.
+    '''
+    def __init__(self, capacity):
+        self.capacity = capacity
+        self.__items = collections.deque(maxlen=capacity)
+        self.__not_empty = threading.Event()
+
+        # Only written by the producer
+        self.pushed = 0
+        self.dropped = 0
+        self.high_water = 0
+
+    def put(self, item):
+        depth = len(self.__items)
+        if depth == self.capacity:
+            # The consumer may take an item in between, so this can count one drop too many
+            self.dropped += 1
+        else:
+            self.high_water = max(self.high_water, depth + 1)
+        self.__items.append(item)
+        self.pushed += 1
+        self.__not_empty.set()
+
+    def get(self, timeout=None):
+        '''
+        Returns the oldest item, or None if nothing was put within timeout seconds.
+        '''
+        try:
+            return self.__items.popleft()
+        except IndexError:
+            pass
+        # Items put before the clear are seen by the second try, items put after it set the event
+        self.__not_empty.clear()
+        try:
+            return self.__items.popleft()
+        except IndexError:
+            pass
+        if not self.__not_empty.wait(timeout):
+            return None
+        try:
+            return self.__items.popleft()
+        except IndexError:
+            return None
+
+    def depth(self):
+        return len(self.__items)
+
+
+class BufferDiagnostics:
+    '''
+    Publishes the depth and drop counters of the socket buffers of a node on /diagnostics,
+    together with the latencies of the pipeline stages of the node, if any.
+    @param buffers: Names and buffers, e.g. {'laserScanB1': soc.laserScanB1}
+    @param histograms: Stage names and LatencyHistograms, in pipeline order
+    @param clock: The ClockOffsetEstimator used to stamp the messages
+    '''
+    def __init__(self, node, buffers, histograms=None, clock=None, period=1.0):
+        self.node = node
+        self.buffers = buffers
+        self.histograms = histograms if histograms else {}
+        self.clock = clock
+        self.publisher = node.create_publisher(DiagnosticArray, '/diagnostics', 10)
+        self.timer = node.create_timer(period, self.publish)
+
+    def publish(self):
+        msg = DiagnosticArray()
+        msg.header.stamp = self.node.get_clock().now().to_msg()
+        for name, buffer in self.buffers.items():
+            status = DiagnosticStatus()
+            status.name = self.node.get_name() + ': ' + name + ' buffer'
+            status.hardware_id = self.node.get_name()
+            status.values = [
+                KeyValue(key='depth', value=str(buffer.depth())),
+                KeyValue(key='capacity', value=str(buffer.capacity)),
+                KeyValue(key='high_water', value=str(buffer.high_water)),
+                KeyValue(key='pushed', value=str(buffer.pushed)),
+                KeyValue(key='dropped', value=str(buffer.dropped))]
+            if buffer.dropped > 0:
+                status.level = DiagnosticStatus.WARN
+                status.message = 'Dropped ' + str(buffer.dropped) + ' of ' + str(buffer.pushed)
+            else:
+                status.level = DiagnosticStatus.OK
+                status.message = 'OK'
+            msg.status.append(status)
+        if self.histograms:
+            status = DiagnosticStatus()
+            status.name = self.node.get_name() + ': latency'
+            status.hardware_id = self.node.get_name()
+            status.level = DiagnosticStatus.OK
+            status.message = 'OK'
+            if self.clock is not None and self.clock.offset is not None:
+                status.values.append(KeyValue(key='clock offset ns', value=str(self.clock.offset)))
+            for stage, histogram in self.histograms.items():
+                status.values.extend(histogram.key_values(stage))
+            msg.status.append(status)
+        self.publisher.publish(msg)
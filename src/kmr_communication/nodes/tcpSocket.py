@@ -21,6 +21,9 @@ import os
 import rclpy
 import socket
 
+from kmp_protocol import BINARY_LASER_OFFER, is_binary_frame, decode_laser_scan
+from ring_buffer import RingBuffer
+
 
 def cl_black(msge): return '\033[30m' + msge + '\033[0m'
 def cl_red(msge): return '\033[31m' + msge + '\033[0m'
@@ -40,21 +43,23 @@ def cl_lightcyan(msge): return '\033[96m' + msge + '\033[0m'
 
 
 class TCPSocket:
-    def __init__(self, ip, port,node):
+    def __init__(self, ip, port,node, binary_laser=False, queue_size=10):
         self.BUFFER_SIZE = 4000
         self.isconnected = False
+        self.binary_laser = binary_laser
         self.node_name = node
         self.ip = ip
         self.port = port
         self.tcp = None
 
         #Data
-        self.odometry = []
-        self.laserScanB1 = []
-        self.laserScanB4 = []
+        # Streamed data goes through bounded buffers to the node, status data only keeps the latest
+        self.odometry = RingBuffer(queue_size)
+        self.laserScanB1 = RingBuffer(queue_size)
+        self.laserScanB4 = RingBuffer(queue_size)
         self.kmp_statusdata = None
         self.lbr_statusdata = None
-        self.lbr_sensordata = []
+        self.lbr_sensordata = RingBuffer(queue_size)
 
         threading.Thread(target=self.connect_to_socket).start()
 
@@ -79,33 +84,33 @@ class TCPSocket:
                 self.isconnected = True
             except:
                 t=0
+        if self.binary_laser:
+            self.send(BINARY_LASER_OFFER)
         time.sleep(1) 
 
         count = 0
         while self.isconnected:
             try:
-                last_read_time = time.time()  # Keep received time
                 data = self.recvmsg()
+                last_read_time = time.time_ns()  # Keep received time
+                payload = bytes(data[1:])  # skip the space after the length
+                if is_binary_frame(payload):
+                    self.add_laser_scan(decode_laser_scan(payload), last_read_time)
+                    continue
                 for pack in (data.decode("utf-8")).split(">"):  # parsing data pack
                     cmd_splt = pack.split()
                     if len(cmd_splt) and cmd_splt[0] == 'odometry':
-                        self.odometry = cmd_splt
+                        self.odometry.put((last_read_time, cmd_splt))
                         #print('odom')
                     if len(cmd_splt) and cmd_splt[0] == 'laserScan':
-                        if cmd_splt[2] == '1801':
-                            self.laserScanB1.append(cmd_splt)
-                            #print(count)
-                            count = count + 1
-
-                        elif cmd_splt[2] == '1802':
-                            self.laserScanB4.append(cmd_splt)
-                            count = count + 1
+                        self.add_laser_scan(cmd_splt, last_read_time)
+                        count = count + 1
                     if len(cmd_splt) and cmd_splt[0] == 'kmp_statusdata':
                         self.kmp_statusdata = cmd_splt
                     if len(cmd_splt) and cmd_splt[0] == 'lbr_statusdata':
                         self.lbr_statusdata = cmd_splt
                     if len(cmd_splt) and cmd_splt[0] == 'lbr_sensordata':
-                        self.lbr_sensordata.append(cmd_splt)
+                        self.lbr_sensordata.put((last_read_time, cmd_splt))
 
             except:
                 t = 0
@@ -120,6 +125,14 @@ class TCPSocket:
         rclpy.shutdown()
 
 
+    def add_laser_scan(self, scan, receive_time):
+        if scan is None:
+            return
+        if scan[2] == '1801':
+            self.laserScanB1.put((receive_time, scan))
+        elif scan[2] == '1802':
+            self.laserScanB4.put((receive_time, scan))
+
     def send(self, cmd):
         try:
             self.connection.sendall((cmd + '\r\n').encode("UTF-8"))
@@ -130,21 +143,21 @@ class TCPSocket:
         header_len = 10
         msglength=0
 
-        byt_len = ""
-        byt_len = self.connection.recv(header_len)
-        diff_header = header_len - len(byt_len)
-        while (diff_header > 0):
-            byt_len.extend(self.connection.recv(diff_header))
-            diff_header= header_len-len(byt_len)
+        byt_len = self.recv_exactly(header_len)
 
         msglength = int(byt_len.decode("utf-8")) + 1   #include crocodile and space
-        msg = ""
+        msg = bytearray()
 
         if(msglength>0 and msglength<5000):
-            msg = self.connection.recv(msglength)
-            diff_msg = msglength - len(msg)
-            while(diff_msg>0):
-                newmsg = self.connection.recv(diff_msg)
-                msg.extend(newmsg)
-                diff_msg = msglength - len(msg)
+            msg = self.recv_exactly(msglength)
         return msg
+
+    # recv may return less than asked for, in particular for the larger laser scan messages
+    def recv_exactly(self, length):
+        data = bytearray()
+        while len(data) < length:
+            chunk = self.connection.recv(length - len(data))
+            if not chunk:
+                raise ConnectionError('Connection closed')
+            data.extend(chunk)
+        return data
@@ -21,6 +21,9 @@ import os
 import rclpy
 import socket
 
+from kmp_protocol import BINARY_LASER_OFFER, is_binary_frame, decode_laser_scan
+from ring_buffer import RingBuffer
+
 
 
 
@@ -42,19 +45,21 @@ def cl_lightcyan(msge): return '\033[96m' + msge + '\033[0m'
 
 
 class UDPSocket:
-    def __init__(self,ip,port,node):
+    def __init__(self,ip,port,node, binary_laser=False, queue_size=10):
         self.BUFFER_SIZE = 4096
         self.isconnected = False
+        self.binary_laser = binary_laser
         self.node_name = node
         self.ip = ip
         self.port = port
         self.udp = None
 
         #Data
-        self.odometry = []
-        self.laserScanB1 = []
-        self.laserScanB4 = []
-        self.lbr_sensordata = []
+        # Streamed data goes through bounded buffers to the node, status data only keeps the latest
+        self.odometry = RingBuffer(queue_size)
+        self.laserScanB1 = RingBuffer(queue_size)
+        self.laserScanB4 = RingBuffer(queue_size)
+        self.lbr_sensordata = RingBuffer(queue_size)
         self.kmp_statusdata = None
         self.lbr_statusdata = None
 
@@ -84,7 +89,8 @@ class UDPSocket:
             except:
                 t=0
 
-        self.udp.sendto("hello KUKA".encode('utf-8'), self.client_address)
+        hello = "hello KUKA " + BINARY_LASER_OFFER if self.binary_laser else "hello KUKA"
+        self.udp.sendto(hello.encode('utf-8'), self.client_address)
 
 
         timee = time.time() #For debugging purposes
@@ -92,26 +98,25 @@ class UDPSocket:
         while self.isconnected:
             try:
                 data, self.client_address = self.udp.recvfrom(self.BUFFER_SIZE)
+                last_read_time = time.time_ns()  # Keep received time
+                if is_binary_frame(data):
+                    self.add_laser_scan(decode_laser_scan(data), last_read_time)
+                    continue
                 data = data.decode('utf-8')
-                last_read_time = time.time()  # Keep received time
                 # Process the received data package
                 cmd_splt=data.split(">")[1].split()
 
                 if len(cmd_splt) and cmd_splt[0] == 'odometry':
-                    self.odometry = cmd_splt
+                    self.odometry.put((last_read_time, cmd_splt))
                 if len(cmd_splt) and cmd_splt[0] == 'laserScan':
-                    if cmd_splt[2] == '1801':
-                        self.laserScanB1.append(cmd_splt)
-                        count = count + 1
-                    elif cmd_splt[2] == '1802':
-                        self.laserScanB4.append(cmd_splt)
-                        count = count + 1
+                    self.add_laser_scan(cmd_splt, last_read_time)
+                    count = count + 1
                 if len(cmd_splt) and cmd_splt[0] == 'kmp_statusdata':
                     self.kmp_statusdata = cmd_splt
                 if len(cmd_splt) and cmd_splt[0] == 'lbr_statusdata':
                     self.lbr_statusdata = cmd_splt
                 if len(cmd_splt) and cmd_splt[0] == 'lbr_sensordata':
-                    self.lbr_sensordata.append(cmd_splt)
+                    self.lbr_sensordata.put((last_read_time, cmd_splt))
 
             except:
                 t=0
@@ -120,6 +125,14 @@ class UDPSocket:
         self.udp.close()
         print(cl_lightred('Connection is closed!'))
 
+    def add_laser_scan(self, scan, receive_time):
+        if scan is None:
+            return
+        if scan[2] == '1801':
+            self.laserScanB1.put((receive_time, scan))
+        elif scan[2] == '1802':
+            self.laserScanB4.put((receive_time, scan))
+
     # Each send command runs as a thread. May need to control the maximum running time (valid time to send a command).
     def send(self, cmd):
         try:
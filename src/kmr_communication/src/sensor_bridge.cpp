@@ -0,0 +1,651 @@
+// Copyright 2019 Nina Marie Wahl and Charlotte Heggem.
+// Copyright 2019 Norwegian University of Science and Technology.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kmr_communication/sensor_bridge.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "geometry_msgs/msg/transform_stamped.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
+
+namespace kmr_communication
+{
+
+namespace
+{
+// See nodes/kmp_protocol.py
+const char kBinaryLaserOffer[] = "binary_laser";
+const uint8_t kFrameLaserScan = 0x01;
+const uint8_t kProtocolVersion = 1;
+const size_t kLaserScanHeaderSize = 16;
+
+const size_t kLengthPrefixSize = 10;
+const int64_t kMaxMessageLength = 65536;
+
+uint32_t readUint32(const uint8_t * data)
+{
+  return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+         (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+}
+
+std::vector<std::string> split(const std::string & text, char separator)
+{
+  std::vector<std::string> parts;
+  std::string part;
+  std::istringstream stream(text);
+  while (std::getline(stream, part, separator)) {
+    parts.push_back(part);
+  }
+  return parts;
+}
+
+std::vector<std::string> splitWhitespace(const std::string & text)
+{
+  std::vector<std::string> parts;
+  std::string part;
+  std::istringstream stream(text);
+  while (stream >> part) {
+    parts.push_back(part);
+  }
+  return parts;
+}
+
+// Comma separated values, skipping empty ones, as the Python nodes do
+template<typename T>
+std::vector<T> parseValues(const std::string & text)
+{
+  std::vector<T> values;
+  for (const auto & part : split(text, ',')) {
+    if (!part.empty()) {
+      values.push_back(static_cast<T>(std::stod(part)));
+    }
+  }
+  return values;
+}
+
+// "x:1.0" -> 1.0
+double valueOf(const std::string & element)
+{
+  return std::stod(element.substr(element.find(':') + 1));
+}
+
+builtin_interfaces::msg::Time toStamp(int64_t nanoseconds)
+{
+  return rclcpp::Time(nanoseconds, RCL_ROS_TIME);
+}
+
+int64_t wallTimeNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+}
+}  // namespace
+
+ClockOffsetEstimator::ClockOffsetEstimator(int64_t scale, size_t window)
+: scale_(scale), window_(window)
+{
+}
+
+int64_t ClockOffsetEstimator::update(int64_t controller_time, int64_t receive_time)
+{
+  const int64_t controller_ns = controller_time * scale_;
+  const int64_t offset = receive_time - controller_ns;
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (!minima_.empty() && minima_.back().second >= offset) {
+    minima_.pop_back();
+  }
+  minima_.emplace_back(count_, offset);
+  if (minima_.front().first + window_ <= count_) {
+    minima_.pop_front();
+  }
+  ++count_;
+  return controller_ns + minima_.front().second;
+}
+
+bool ClockOffsetEstimator::offset(int64_t & offset) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (minima_.empty()) {
+    return false;
+  }
+  offset = minima_.front().second;
+  return true;
+}
+
+const std::vector<double> LatencyHistogram::kBucketsMs = {1, 2, 5, 10, 20, 50, 100, 200, 500};
+
+LatencyHistogram::LatencyHistogram()
+{
+  reset();
+}
+
+void LatencyHistogram::reset()
+{
+  counts_.assign(kBucketsMs.size() + 1, 0);
+  total_ms_ = 0.0;
+  max_ms_ = 0.0;
+}
+
+void LatencyHistogram::add(int64_t latency_ns)
+{
+  const double latency_ms = latency_ns * 1e-6;
+  const auto bucket = std::lower_bound(kBucketsMs.begin(), kBucketsMs.end(), latency_ms) -
+    kBucketsMs.begin();
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++counts_[bucket];
+  total_ms_ += latency_ms;
+  max_ms_ = std::max(max_ms_, latency_ms);
+}
+
+void LatencyHistogram::appendKeyValues(
+  const std::string & stage, std::vector<diagnostic_msgs::msg::KeyValue> & values)
+{
+  std::vector<uint64_t> counts;
+  double total_ms, max_ms;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    counts = counts_;
+    total_ms = total_ms_;
+    max_ms = max_ms_;
+    reset();
+  }
+  uint64_t count = 0;
+  for (const auto bucket : counts) {
+    count += bucket;
+  }
+
+  auto append = [&values, &stage](const std::string & key, const std::string & value) {
+      diagnostic_msgs::msg::KeyValue key_value;
+      key_value.key = stage + " " + key;
+      key_value.value = value;
+      values.push_back(key_value);
+    };
+  char number[32];
+  append("count", std::to_string(count));
+  std::snprintf(number, sizeof(number), "%.2f", count > 0 ? total_ms / count : 0.0);
+  append("mean ms", number);
+  std::snprintf(number, sizeof(number), "%.2f", max_ms);
+  append("max ms", number);
+  int lower = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    if (i < kBucketsMs.size()) {
+      const int upper = static_cast<int>(kBucketsMs[i]);
+      append(std::to_string(lower) + "-" + std::to_string(upper) + " ms", std::to_string(counts[i]));
+      lower = upper;
+    } else {
+      append(">" + std::to_string(lower) + " ms", std::to_string(counts[i]));
+    }
+  }
+}
+
+SensorBridge::SensorBridge(const rclcpp::NodeOptions & options)
+: Node("sensor_bridge", options), fdi_clock_(1000000, 500)
+{
+  port_ = declare_parameter<int>("port", 30008);
+  const auto robot = declare_parameter<std::string>("robot", "KMR2");
+  ip_ = declare_parameter<std::string>(robot + "/ip", "192.168.10.250");
+  binary_laser_ = declare_parameter<bool>("binary_laser", true);
+
+  scan_publisher_1_ = create_publisher<sensor_msgs::msg::LaserScan>(
+    "scan", rclcpp::SensorDataQoS());
+  scan_publisher_2_ = create_publisher<sensor_msgs::msg::LaserScan>(
+    "scan_2", rclcpp::SensorDataQoS());
+  odometry_publisher_ = create_publisher<nav_msgs::msg::Odometry>(
+    "odom", rclcpp::SensorDataQoS());
+  kmp_status_publisher_ = create_publisher<kmr_msgs::msg::KmpStatusdata>("kmp_statusdata", 10);
+  lbr_status_publisher_ = create_publisher<kmr_msgs::msg::LbrStatusdata>("lbr_statusdata", 10);
+  joint_state_publisher_ = create_publisher<sensor_msgs::msg::JointState>("joint_states", 20);
+  tf_broadcaster_ = std::make_shared<tf2_ros::TransformBroadcaster>(this);
+
+  const auto diagnostics_period = declare_parameter<double>("diagnostics_period", 1.0);
+  diagnostics_publisher_ =
+    create_publisher<diagnostic_msgs::msg::DiagnosticArray>("/diagnostics", 10);
+  diagnostics_timer_ = create_wall_timer(
+    std::chrono::duration<double>(diagnostics_period),
+    std::bind(&SensorBridge::publishDiagnostics, this));
+
+  thread_ = std::thread(&SensorBridge::run, this);
+}
+
+SensorBridge::~SensorBridge()
+{
+  // Unblocks accept and recv in the receiving thread
+  running_ = false;
+  if (server_fd_ >= 0) {
+    ::shutdown(server_fd_, SHUT_RDWR);
+  }
+  if (connection_fd_ >= 0) {
+    ::shutdown(connection_fd_, SHUT_RDWR);
+  }
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  closeConnection();
+  if (server_fd_ >= 0) {
+    ::close(server_fd_);
+  }
+}
+
+void SensorBridge::run()
+{
+  RCLCPP_INFO(get_logger(), "Starting up sensor bridge on %s:%d", ip_.c_str(), port_);
+  while (running_ && rclcpp::ok()) {
+    if (!acceptConnection()) {
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+      continue;
+    }
+    RCLCPP_INFO(get_logger(), "Node is ready");
+    ++connections_;
+
+    if (binary_laser_) {
+      const std::string offer = std::string(kBinaryLaserOffer) + "\r\n";
+      if (::send(connection_fd_, offer.data(), offer.size(), MSG_NOSIGNAL) < 0) {
+        RCLCPP_WARN(get_logger(), "Could not offer binary laser scans: %s", std::strerror(errno));
+      }
+    }
+
+    while (running_) {
+      uint8_t prefix[kLengthPrefixSize];
+      if (!receiveExactly(prefix, sizeof(prefix))) {
+        break;
+      }
+      int64_t length = -1;
+      try {
+        length = std::stoll(std::string(reinterpret_cast<char *>(prefix), sizeof(prefix)));
+      } catch (const std::exception &) {
+      }
+      if (length < 0 || length > kMaxMessageLength) {
+        RCLCPP_ERROR(get_logger(), "Invalid message length, closing the connection");
+        break;
+      }
+
+      // Includes the space after the length
+      std::vector<uint8_t> payload(static_cast<size_t>(length) + 1);
+      if (!receiveExactly(payload.data(), payload.size())) {
+        break;
+      }
+      handlePayload(payload, wallTimeNs());
+    }
+    closeConnection();
+    if (running_) {
+      RCLCPP_WARN(get_logger(), "Connection is closed, waiting for the controller to reconnect");
+    }
+  }
+}
+
+bool SensorBridge::acceptConnection()
+{
+  if (server_fd_ < 0) {
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    const int reuse = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port_));
+    if (fd < 0 || ::inet_pton(AF_INET, ip_.c_str(), &address.sin_addr) != 1 ||
+      ::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+      ::listen(fd, 1) < 0)
+    {
+      RCLCPP_ERROR(
+        get_logger(), "Connection for KUKA cannot assign requested address: %s %d",
+        ip_.c_str(), port_);
+      if (fd >= 0) {
+        ::close(fd);
+      }
+      return false;
+    }
+    server_fd_ = fd;
+  }
+
+  const int fd = ::accept(server_fd_, nullptr, nullptr);
+  if (fd < 0) {
+    return false;
+  }
+  connection_fd_ = fd;
+  return true;
+}
+
+bool SensorBridge::receiveExactly(uint8_t * data, size_t length)
+{
+  size_t received = 0;
+  while (received < length) {
+    const ssize_t n = ::recv(connection_fd_, data + received, length - received, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    received += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+void SensorBridge::closeConnection()
+{
+  const int fd = connection_fd_.exchange(-1);
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
+void SensorBridge::handlePayload(const std::vector<uint8_t> & payload, int64_t receive_time)
+{
+  // Skip the space after the length
+  const uint8_t * data = payload.data() + 1;
+  const size_t size = payload.size() - 1;
+
+  if (size > 0 && data[0] == kFrameLaserScan) {
+    if (size < kLaserScanHeaderSize || data[1] != kProtocolVersion) {
+      ++parse_errors_;
+      return;
+    }
+    const uint16_t laser_id = static_cast<uint16_t>((data[2] << 8) | data[3]);
+    const int64_t timestamp = static_cast<int64_t>(
+      (static_cast<uint64_t>(readUint32(data + 4)) << 32) | readUint32(data + 8));
+    const uint32_t count = readUint32(data + 12);
+    if (size != kLaserScanHeaderSize + 4 * static_cast<size_t>(count)) {
+      ++parse_errors_;
+      return;
+    }
+    std::vector<float> ranges(count);
+    for (uint32_t i = 0; i < count; ++i) {
+      const uint32_t bits = readUint32(data + kLaserScanHeaderSize + 4 * i);
+      std::memcpy(&ranges[i], &bits, sizeof(bits));
+    }
+    publishLaserScan(
+      std::to_string(timestamp), std::to_string(laser_id), std::move(ranges), receive_time);
+    return;
+  }
+
+  const std::string text(reinterpret_cast<const char *>(data), size);
+  for (const auto & pack : split(text, '>')) {
+    const auto tokens = splitWhitespace(pack);
+    if (tokens.empty()) {
+      continue;
+    }
+    try {
+      handleTextMessage(tokens, receive_time);
+    } catch (const std::exception & e) {
+      ++parse_errors_;
+      RCLCPP_WARN_THROTTLE(
+        get_logger(), *get_clock(), 5000, "Could not parse %s message: %s",
+        tokens[0].c_str(), e.what());
+    }
+  }
+}
+
+void SensorBridge::handleTextMessage(
+  const std::vector<std::string> & tokens, int64_t receive_time)
+{
+  const auto & type = tokens[0];
+  if (type == "laserScan" && tokens.size() == 4) {
+    publishLaserScan(tokens[1], tokens[2], parseValues<float>(tokens[3]), receive_time);
+  } else if (type == "odometry" && tokens.size() == 8) {
+    publishOdometry(tokens, receive_time);
+  } else if (type == "kmp_statusdata" && tokens.size() > 1) {
+    publishKmpStatus(tokens[1]);
+  } else if (type == "lbr_statusdata" && tokens.size() > 1) {
+    publishLbrStatus(tokens[1]);
+  } else if (type == "lbr_sensordata" && tokens.size() > 1) {
+    publishLbrSensordata(tokens[1]);
+  }
+}
+
+bool SensorBridge::isRepeated(const std::string & stream, const std::string & timestamp)
+{
+  auto & last = last_timestamps_[stream];
+  const bool repeated = last == timestamp;
+  last = timestamp;
+  {
+    std::lock_guard<std::mutex> lock(counters_mutex_);
+    auto & counters = stream_counters_[stream];
+    ++counters.received;
+    if (repeated) {
+      ++counters.repeated;
+    }
+  }
+  return repeated;
+}
+
+void SensorBridge::addLatencies(
+  StageLatencies & latencies, int64_t acquisition_time, int64_t receive_time, int64_t parse_time)
+{
+  // The receive latency is the transport delay above the smallest one in the clock window
+  latencies.receive.add(receive_time - acquisition_time);
+  latencies.parse.add(parse_time - receive_time);
+  latencies.publish.add(wallTimeNs() - parse_time);
+}
+
+void SensorBridge::publishDiagnostics()
+{
+  diagnostic_msgs::msg::DiagnosticArray msg;
+  msg.header.stamp = now();
+
+  auto make_status = [this](const std::string & name) {
+      diagnostic_msgs::msg::DiagnosticStatus status;
+      status.name = std::string(get_name()) + ": " + name;
+      status.hardware_id = get_name();
+      status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+      status.message = "OK";
+      return status;
+    };
+  auto key_value = [](const std::string & key, const std::string & value) {
+      diagnostic_msgs::msg::KeyValue key_value;
+      key_value.key = key;
+      key_value.value = value;
+      return key_value;
+    };
+
+  auto connection = make_status("connection");
+  connection.values.push_back(key_value("connected", connection_fd_ >= 0 ? "true" : "false"));
+  connection.values.push_back(key_value("connections", std::to_string(connections_.load())));
+  connection.values.push_back(key_value("parse errors", std::to_string(parse_errors_.load())));
+  if (connection_fd_ < 0) {
+    connection.level = diagnostic_msgs::msg::DiagnosticStatus::WARN;
+    connection.message = "Waiting for the controller to connect";
+  }
+  {
+    std::lock_guard<std::mutex> lock(counters_mutex_);
+    for (const auto & stream : stream_counters_) {
+      connection.values.push_back(
+        key_value(stream.first + " received", std::to_string(stream.second.received)));
+      connection.values.push_back(
+        key_value(stream.first + " repeated", std::to_string(stream.second.repeated)));
+    }
+  }
+  msg.status.push_back(connection);
+
+  int64_t offset = 0;
+  const bool has_offset = fdi_clock_.offset(offset);
+  auto latency_status = [&](const std::string & name, StageLatencies & latencies) {
+      auto status = make_status(name + " latency");
+      if (has_offset) {
+        status.values.push_back(key_value("clock offset ns", std::to_string(offset)));
+      }
+      latencies.receive.appendKeyValues("receive", status.values);
+      latencies.parse.appendKeyValues("parse", status.values);
+      latencies.publish.appendKeyValues("publish", status.values);
+      return status;
+    };
+  msg.status.push_back(latency_status("laserScan", laser_latencies_));
+  msg.status.push_back(latency_status("odometry", odometry_latencies_));
+
+  diagnostics_publisher_->publish(msg);
+}
+
+void SensorBridge::publishLaserScan(
+  const std::string & timestamp, const std::string & laser_id, std::vector<float> && ranges,
+  int64_t receive_time)
+{
+  rclcpp::Publisher<sensor_msgs::msg::LaserScan>::SharedPtr publisher;
+  std::string frame_id;
+  if (laser_id == "1801") {
+    publisher = scan_publisher_1_;
+    frame_id = "laser_B1_link";
+  } else if (laser_id == "1802") {
+    publisher = scan_publisher_2_;
+    frame_id = "laser_B4_link";
+  } else {
+    return;
+  }
+  if (isRepeated("laserScan" + laser_id, timestamp)) {
+    return;
+  }
+
+  auto scan = std::make_unique<sensor_msgs::msg::LaserScan>();
+  const int64_t acquisition_time = fdi_clock_.update(std::stoll(timestamp), receive_time);
+  scan->header.stamp = toStamp(acquisition_time);
+  scan->header.frame_id = frame_id;
+  scan->angle_increment = static_cast<float>(0.5 * M_PI / 180.0);
+  scan->angle_min = static_cast<float>(-135.0 * M_PI / 180.0);
+  scan->angle_max = static_cast<float>(135.0 * M_PI / 180.0);
+  scan->range_min = 0.12f;
+  scan->range_max = 15.0f;
+  scan->ranges = std::move(ranges);
+  const int64_t parse_time = wallTimeNs();
+  publisher->publish(std::move(scan));
+  addLatencies(laser_latencies_, acquisition_time, receive_time, parse_time);
+}
+
+void SensorBridge::publishOdometry(const std::vector<std::string> & tokens, int64_t receive_time)
+{
+  if (isRepeated("odometry", tokens[1])) {
+    return;
+  }
+  const double x = valueOf(tokens[2]);
+  const double y = valueOf(tokens[3]);
+  const double theta = valueOf(tokens[4]);
+
+  auto odom = std::make_unique<nav_msgs::msg::Odometry>();
+  const int64_t acquisition_time = fdi_clock_.update(std::stoll(tokens[1]), receive_time);
+  odom->header.stamp = toStamp(acquisition_time);
+  odom->header.frame_id = "odom";
+  odom->child_frame_id = "base_footprint";
+  odom->pose.pose.position.x = x;
+  odom->pose.pose.position.y = y;
+  odom->pose.pose.orientation.z = std::sin(theta / 2);
+  odom->pose.pose.orientation.w = std::cos(theta / 2);
+  odom->twist.twist.linear.x = valueOf(tokens[5]);
+  odom->twist.twist.linear.y = valueOf(tokens[6]);
+  odom->twist.twist.angular.z = valueOf(tokens[7]);
+
+  geometry_msgs::msg::TransformStamped transform;
+  transform.header = odom->header;
+  transform.child_frame_id = odom->child_frame_id;
+  transform.transform.translation.x = x;
+  transform.transform.translation.y = y;
+  transform.transform.rotation = odom->pose.pose.orientation;
+  const int64_t parse_time = wallTimeNs();
+  tf_broadcaster_->sendTransform(transform);
+  odometry_publisher_->publish(std::move(odom));
+  addLatencies(odometry_latencies_, acquisition_time, receive_time, parse_time);
+}
+
+void SensorBridge::publishKmpStatus(const std::string & data)
+{
+  // ",<timestamp>,OperationMode:AUT,ReadyToMove:true,..."
+  const auto elements = split(data, ',');
+  if (elements.size() < 2 || isRepeated("kmp_statusdata", elements[1])) {
+    return;
+  }
+  kmr_msgs::msg::KmpStatusdata msg;
+  msg.header.stamp = now();
+  for (size_t i = 2; i < elements.size(); ++i) {
+    const auto separator = elements[i].find(':');
+    const auto key = elements[i].substr(0, separator);
+    const auto value = separator == std::string::npos ? "" : elements[i].substr(separator + 1);
+    if (key == "OperationMode") {
+      msg.operation_mode = value;
+    } else if (key == "ReadyToMove") {
+      msg.ready_to_move = value == "true";
+    } else if (key == "WarningField") {
+      msg.warning_field_clear = value == "true";
+    } else if (key == "ProtectionField") {
+      msg.protection_field_clear = value == "true";
+    } else if (key == "isKMPmoving") {
+      msg.is_kmp_moving = value == "true";
+    } else if (key == "KMPsafetyStop") {
+      msg.kmp_safetystop = value == "true";
+    }
+  }
+  kmp_status_publisher_->publish(msg);
+}
+
+void SensorBridge::publishLbrStatus(const std::string & data)
+{
+  const auto elements = split(data, ',');
+  if (elements.size() < 2 || isRepeated("lbr_statusdata", elements[1])) {
+    return;
+  }
+  kmr_msgs::msg::LbrStatusdata msg;
+  msg.header.stamp = now();
+  for (size_t i = 2; i < elements.size(); ++i) {
+    const auto separator = elements[i].find(':');
+    const auto key = elements[i].substr(0, separator);
+    const auto value = separator == std::string::npos ? "" : elements[i].substr(separator + 1);
+    if (key == "ReadyToMove") {
+      msg.ready_to_move = value == "true";
+    } else if (key == "isLBRmoving") {
+      msg.is_lbr_moving = value == "true";
+    } else if (key == "PathFinished") {
+      msg.path_finished = value == "true";
+    } else if (key == "LBRsafetyStop") {
+      msg.lbr_safetystop = value == "true";
+    }
+  }
+  lbr_status_publisher_->publish(msg);
+}
+
+void SensorBridge::publishLbrSensordata(const std::string & data)
+{
+  // ",<timestamp>,JointPosition:a1,...,a7,MeasuredTorque:a1,...,a7"
+  const auto elements = split(data, ',');
+  const auto position_start = data.find("JointPosition:");
+  const auto torque_start = data.find("MeasuredTorque:");
+  if (elements.size() < 2 || position_start == std::string::npos ||
+    torque_start == std::string::npos || isRepeated("lbr_sensordata", elements[1]))
+  {
+    return;
+  }
+  const auto position_begin = position_start + std::strlen("JointPosition:");
+
+  auto msg = std::make_unique<sensor_msgs::msg::JointState>();
+  msg->header.stamp = now();
+  msg->name = {"joint_a1", "joint_a2", "joint_a3", "joint_a4", "joint_a5", "joint_a6", "joint_a7"};
+  msg->position = parseValues<double>(data.substr(position_begin, torque_start - position_begin));
+  msg->effort = parseValues<double>(data.substr(torque_start + std::strlen("MeasuredTorque:")));
+  joint_state_publisher_->publish(std::move(msg));
+}
+
+}  // namespace kmr_communication
+
+RCLCPP_COMPONENTS_REGISTER_NODE(kmr_communication::SensorBridge)
@@ -0,0 +1,105 @@
+// Copyright 2020 Morten Melby Dahl.
+// Copyright 2020 Norwegian University of Science and Technology.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KMR_CONCATENATOR__LASER_CONCATENATOR_HPP_
+#define KMR_CONCATENATOR__LASER_CONCATENATOR_HPP_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Eigen/Dense"
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
+#include "message_filters/subscriber.h"
+#include "message_filters/sync_policies/approximate_time.h"
+#include "message_filters/synchronizer.h"
+#include "rclcpp/rclcpp.hpp"
+#include "sensor_msgs/msg/laser_scan.hpp"
+#include "sensor_msgs/msg/point_cloud2.hpp"
+#include "tf2_ros/buffer.h"
+#include "tf2_ros/transform_listener.h"
+
+namespace kmr_concatenator
+{
+
+// C++ version of concatenator_node.py. The two scans are projected and transformed to the
+// target frame in a single pass over each scan, using per-beam direction vectors that are
+// computed once per scan geometry, and the cloud is published without copying when the
+// subscriber lives in the same process.
+class LaserConcatenator : public rclcpp::Node
+{
+public:
+  explicit LaserConcatenator(const rclcpp::NodeOptions & options);
+
+private:
+  using LaserScan = sensor_msgs::msg::LaserScan;
+  using SyncPolicy = message_filters::sync_policies::ApproximateTime<LaserScan, LaserScan>;
+
+  // The fixed transform of one scanner and the beam directions of its scans in the target frame
+  struct Scanner
+  {
+    std::string frame;
+    bool has_transform{false};
+    Eigen::Matrix<float, 3, 4> transform;
+
+    float angle_min{0.0f};
+    float angle_increment{0.0f};
+    Eigen::Matrix3Xf directions;
+  };
+
+  void callback(const LaserScan::ConstSharedPtr & scan1, const LaserScan::ConstSharedPtr & scan2);
+
+  bool lookupTransform(Scanner & scanner);
+
+  void updateDirections(Scanner & scanner, const LaserScan & scan);
+
+  // Appends the valid points of scan to cloud, returns the number of points written
+  size_t projectScan(
+    Scanner & scanner, const LaserScan & scan, bool with_intensity,
+    sensor_msgs::msg::PointCloud2 & cloud, size_t offset);
+
+  void addLatency(const rclcpp::Duration & latency);
+
+  void publishDiagnostics();
+
+  std::string target_frame_;
+  bool simulated_{false};
+
+  Scanner scanner1_;
+  Scanner scanner2_;
+
+  std::shared_ptr<tf2_ros::Buffer> tf_buffer_;
+  std::shared_ptr<tf2_ros::TransformListener> tf_listener_;
+
+  message_filters::Subscriber<LaserScan> subscriber1_;
+  message_filters::Subscriber<LaserScan> subscriber2_;
+  std::shared_ptr<message_filters::Synchronizer<SyncPolicy>> synchronizer_;
+
+  rclcpp::Publisher<sensor_msgs::msg::PointCloud2>::SharedPtr publisher_;
+
+  // Latency from the acquisition of the first scan to the publication of the cloud, since the
+  // last report, in the same buckets as LatencyHistogram in kmr_communication
+  std::mutex latency_mutex_;
+  std::vector<uint64_t> latency_counts_;
+  double latency_total_ms_{0.0};
+  double latency_max_ms_{0.0};
+  rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr diagnostics_publisher_;
+  rclcpp::TimerBase::SharedPtr diagnostics_timer_;
+};
+
+}  // namespace kmr_concatenator
+
+#endif  // KMR_CONCATENATOR__LASER_CONCATENATOR_HPP_
@@ -22,6 +22,8 @@ from launch.actions import IncludeLaunchDescription
 from launch.launch_description_sources import PythonLaunchDescriptionSource
 from launch.substitutions import LaunchConfiguration
 import launch_ros.actions
+from launch_ros.actions import ComposableNodeContainer
+from launch_ros.descriptions import ComposableNode
 import sys
 from rclpy.utilities import remove_ros_args
 import argparse
@@ -33,6 +35,43 @@ def generate_launch_description(argv=sys.argv[1:]):
     # If true - 3D coordinates, if false - 2D coordinates from laser scanners.
     simulated = 'false'
 
+    # Native is 'true' to run the C++ concatenator and pointcloud_to_laserscan as components in
+    # one container, so the concatenated cloud is passed between them without copying.
+    native = 'false'
+
+    pointcloud_to_laserscan_parameters = [{'use_sim_time': True},
+                                          {'range_max' : 10.0},
+                                          {'range_min' : 0.3}]
+    pointcloud_to_laserscan_remappings = [('cloud_in', 'pc_concatenated'),
+                                          ('scan', 'scan_concatenated')]
+
+    if native == 'true':
+        return LaunchDescription([
+            ComposableNodeContainer(
+                name='concatenator_container',
+                namespace='',
+                package='rclcpp_components',
+                executable='component_container',
+                composable_node_descriptions=[
+                    ComposableNode(
+                        package='kmr_concatenator',
+                        plugin='kmr_concatenator::LaserConcatenator',
+                        name='laser_concatenator',
+                        parameters=[{'simulated': simulated == 'true'}],
+                        extra_arguments=[{'use_intra_process_comms': True}]),
+                    ComposableNode(
+                        package='pointcloud_to_laserscan',
+                        plugin='pointcloud_to_laserscan::PointCloudToLaserScanNode',
+                        name='pointcloud_to_laserscan',
+                        parameters=pointcloud_to_laserscan_parameters,
+                        remappings=pointcloud_to_laserscan_remappings,
+                        extra_arguments=[{'use_intra_process_comms': True}]),
+                ],
+                output='screen',
+                emulate_tty=True
+            )
+        ])
+
     return LaunchDescription([
         launch_ros.actions.Node(
             package="kmr_concatenator",
@@ -47,10 +86,7 @@ def generate_launch_description(argv=sys.argv[1:]):
             executable="pointcloud_to_laserscan_node",
             name="pointcloud_to_laserscan",
             output="screen",
-            parameters=[{'use_sim_time': True}, 
-            		 {'range_max' : 10.0},
-            		 {'range_min' : 0.3}],
-            remappings=[('cloud_in', 'pc_concatenated'),
-                        ('scan', 'scan_concatenated')]
+            parameters=pointcloud_to_laserscan_parameters,
+            remappings=pointcloud_to_laserscan_remappings
             )
     ])
@@ -1,10 +1,25 @@
 #!/usr/bin/env python3
 
+import array
 import numpy as np
 from laser_to_pointcloud import *
 
 class CloudTransform():
 
+    # Reflection about the x-axis of the goal frame, applied after the transforms
+    REFL_X = np.array([[-1, 0, 0, 0],
+                       [0, 1, 0, 0],
+                       [0, 0, 1, 0],
+                       [0, 0, 0, 1]])
+
+    def __init__(self):
+        # Only used to convert between PointCloud2 messages and NumPy arrays
+        self.projector = LaserToPointcloud()
+
+        # Data of the concatenated cloud, reused between scans. The published message refers
+        # to it instead of a copy, which is safe as rclpy serializes the message in publish.
+        self.__data = array.array('B')
+
     def transform_to_quat_vec(self, t):
         '''
         Makes a numpy array consisting of the quaternion and translation vector from the tf2 transform.
@@ -46,29 +61,82 @@ class CloudTransform():
                               Used only for header, which again is overwritten after the clouds are concatenated.
         @type original_scan: sensor_msgs.msg.LaserScan
         '''
-        T = transform_matrix
+        # Transform all points at once and reflect them about the x-axis of the goal frame.
+        # Had to multiply with a reflection matrix about the x-axis.
+        M = self.reflected_matrix(transform_matrix)
 
-        self.refl_x = np.array([[-1, 0, 0, 0],
-                                [0, 1, 0, 0],
-                                [0, 0, 1, 0],
-                                [0, 0, 0, 1]])
+        points_in = self.projector.cloud_to_array(cloud)
+        points_out = points_in.copy()
 
-        points_out = []
+        xyz = np.stack((points_in['x'], points_in['y'], points_in['z']))
+        xyz_out = M[:, :3] @ xyz + M[:, 3:]
+        points_out['x'] = xyz_out[0]
+        points_out['y'] = xyz_out[1]
+        points_out['z'] = xyz_out[2]
 
-        # Transform each point individually and reflects them about the x-axis of the goal frame.
-        # Had to multiply with a reflection matrix about the x-axis.
-        for p_in in LaserToPointcloud().read_points(cloud):
-            
-            # If generated in Gazebo, the points will have a z-coordinate. This sets that to 0.
-         
-            p_out = np.array((T @ [p_in[0], p_in[1], p_in[2], 1.0])) @ self.refl_x
-
-            #p_out = [p_out[0], p_out[1], p_out[2], p_in[3]]
-            if (simulated == False):
-                p_out = [p_out[0], p_out[1], p_out[2], p_in[3]]
-            else:
-                p_out = [p_out[0], p_out[1], p_out[2], p_out[3], p_in[4]]
-            points_out.append(p_out)
-
-        res = LaserToPointcloud().create_cloud(original_scan.header, cloud.fields, points_out)
+        # Clouds generated in Gazebo have an intensity channel, which is set to the
+        # homogeneous coordinate of the transformed point.
+        if simulated and 'intensity' in points_out.dtype.names:
+            points_out['intensity'] = 1.0
+
+        res = self.projector.create_cloud_from_array(original_scan.header, cloud.fields, points_out)
         return res
+
+    def reflected_matrix(self, transform_matrix):
+        '''
+        The 3x4 matrix that transforms points to the goal frame and reflects them about its x-axis.
+        @param transform_matrix: Transformation matrix from generate_transform.
+        @type transform_matrix: NumPy array
+        '''
+        return (self.REFL_X @ transform_matrix)[:3]
+
+    def concatenate_scans(self, scans, projectors, matrices, header, simulated=False,
+                          channel_options=LaserToPointcloud.ChannelOption.DEFAULT):
+        '''
+        Projects the scans, transforms them to the goal frame and concatenates them into one cloud.
+        The points are written directly into the data of the returned message, which is reused by
+        the next call, so the message must be published before this is called again.
+        @param scans: The LaserScan messages.
+        @type scans: list of sensor_msgs.msg.LaserScan
+        @param projectors: One LaserToPointcloud per scan, which keeps the beam angles of its laser.
+        @type projectors: list of LaserToPointcloud
+        @param matrices: One matrix from reflected_matrix per scan.
+        @type matrices: list of NumPy arrays
+        @param header: Header of the concatenated cloud.
+        @type header: std_msgs.msg.Header
+        '''
+        has_intensities = all(len(scan.intensities) == len(scan.ranges) and len(scan.ranges) > 0
+                              for scan in scans)
+        fields, dtype = projectors[0].getFields(channel_options, has_intensities)
+
+        counts = [projector.countPoints(scan) for scan, projector in zip(scans, projectors)]
+        total = sum(counts)
+
+        # The buffer can only be resized while no NumPy view of it exists
+        size = total * dtype.itemsize
+        if len(self.__data) > size:
+            del self.__data[size:]
+        elif len(self.__data) < size:
+            self.__data.frombytes(bytes(size - len(self.__data)))
+
+        points = np.frombuffer(self.__data, dtype=dtype)
+        offset = 0
+        for scan, projector, matrix, count in zip(scans, projectors, matrices, counts):
+            projector.projectLaserInto(scan, points[offset:offset + count], matrix)
+            offset += count
+
+        # Clouds generated in Gazebo have an intensity channel, which is set to the
+        # homogeneous coordinate of the transformed point.
+        if simulated and 'intensity' in dtype.names:
+            points['intensity'] = 1.0
+        del points
+
+        return PointCloud2(header=header,
+                           height=1,
+                           width=total,
+                           is_dense=False,
+                           is_bigendian=False,
+                           fields=fields,
+                           point_step=dtype.itemsize,
+                           row_step=size,
+                           data=self.__data)
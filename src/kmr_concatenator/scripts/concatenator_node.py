@@ -36,7 +36,7 @@ import struct
 import ctypes
 
 # Messages
-from std_msgs.msg import String
+from std_msgs.msg import String, Header
 from sensor_msgs.msg import LaserScan, PointCloud2, PointField
 import std_msgs
 
@@ -98,6 +98,13 @@ class LaserConcatenator(Node):
         self.T1 = CloudTransform().generate_transform(self.transform_B1)
         self.T4 = CloudTransform().generate_transform(self.transform_B4)
 
+        # One projector per laser, so each keeps its cached beam angles and buffers between scans
+        self.projector_1 = LaserToPointcloud()
+        self.projector_2 = LaserToPointcloud()
+        self.cloud_transform = CloudTransform()
+        self.M1 = self.cloud_transform.reflected_matrix(self.T1)
+        self.M4 = self.cloud_transform.reflected_matrix(self.T4)
+
         # Subscribes to the two laser scan topics. Might have to change QoS to 10 when subscribing to real laser readings.
         # if you are using Gazebo, final arguemtn should be qos_profile = rclpy.qos.qos_profile_sensor_data.
         self.subscriber_1 = Subscriber(self, LaserScan, 'scan', qos_profile = rclpy.qos.qos_profile_sensor_data)
@@ -114,20 +121,13 @@ class LaserConcatenator(Node):
 
 
     def callback(self, scan, scan2):
-        # Make two PointCloud2 messages from the scans
-        self.pc2_msg1 = LaserToPointcloud().projectLaser(scan)
-        self.pc2_msg2 = LaserToPointcloud().projectLaser(scan2)
-
-        # Transforms the clouds to the same frame.
-        self.pc2_msg1_transformed = CloudTransform().do_transform_cloud(self.pc2_msg1, self.T1, scan, self.simulated)
-        self.pc2_msg2_transformed = CloudTransform().do_transform_cloud(self.pc2_msg2, self.T4, scan, self.simulated)
-
-        # Combine the clouds
-        self.pc2_concatenated = LaserToPointcloud().concatenate_clouds(self.pc2_msg1_transformed, self.pc2_msg2_transformed)
-        self.pc2_concatenated.header.frame_id = self.transform_B1.header.frame_id
+        # Projects both scans straight into the combined cloud, in the same frame
+        header = Header(stamp=scan.header.stamp, frame_id=self.transform_B1.header.frame_id)
+        pc2_concatenated = self.cloud_transform.concatenate_scans(
+            [scan, scan2], [self.projector_1, self.projector_2], [self.M1, self.M4], header, self.simulated)
 
         # Publishes the combined cloud
-        self.publisher_.publish(self.pc2_concatenated)
+        self.publisher_.publish(pc2_concatenated)
 
 
 def main(argv=sys.argv[1:]):
@@ -1,5 +1,7 @@
 #!/usr/bin/env python3
 
+import sys
+import array
 import struct
 import ctypes
 import numpy as np
@@ -24,9 +26,24 @@ class LaserToPointcloud():
         DEFAULT   = (INTENSITY | INDEX)
 
     def __init__(self):
+        # Cache of the beam directions, only recomputed when the scan geometry changes.
+        # Keep one instance per laser frame to make use of it.
         self.__angle_min = 0.0
-        self.__angle_max = 0.0
-        self.__cos_sin_map = np.array([[]])
+        self.__angle_increment = 0.0
+        self.__cos_sin_map = np.array([[]], dtype=np.float32)
+        self.__indices = np.array([], dtype=np.int32)
+
+        # The beam directions multiplied with the rotation of the transform given to
+        # projectLaserInto, recomputed when the transform or the scan geometry changes
+        self.__matrix = None
+        self.__rotated = np.empty((3, 0), dtype=np.float32)
+
+        # Buffers reused between scans, grown when a scan has more beams than before
+        self.__fields_cache = {}
+        self.__output = None
+        self.__work = np.array([], dtype=np.float32)
+        self.__mask = np.array([], dtype=bool)
+        self.__in_range = np.array([], dtype=bool)
 
         self._DATATYPES = {}
         self._DATATYPES[PointField.INT8]    = ('b', 1)
@@ -38,6 +55,16 @@ class LaserToPointcloud():
         self._DATATYPES[PointField.FLOAT32] = ('f', 4)
         self._DATATYPES[PointField.FLOAT64] = ('d', 8)
 
+        self._NP_DATATYPES = {}
+        self._NP_DATATYPES[PointField.INT8]    = np.dtype('i1')
+        self._NP_DATATYPES[PointField.UINT8]   = np.dtype('u1')
+        self._NP_DATATYPES[PointField.INT16]   = np.dtype('<i2')
+        self._NP_DATATYPES[PointField.UINT16]  = np.dtype('<u2')
+        self._NP_DATATYPES[PointField.INT32]   = np.dtype('<i4')
+        self._NP_DATATYPES[PointField.UINT32]  = np.dtype('<u4')
+        self._NP_DATATYPES[PointField.FLOAT32] = np.dtype('<f4')
+        self._NP_DATATYPES[PointField.FLOAT64] = np.dtype('<f8')
+
     def projectLaser(self, scan_in,
             range_cutoff=-1.0, channel_options=ChannelOption.DEFAULT):
         """
@@ -57,145 +84,235 @@ class LaserToPointcloud():
 
     def __projectLaser(self, scan_in, range_cutoff, channel_options):
         N = len(scan_in.ranges)
+        has_intensities = len(scan_in.intensities) == N and N > 0
+        fields, dtype = self.getFields(channel_options, has_intensities)
+
+        if self.__output is None or self.__output.dtype != dtype or len(self.__output) < N:
+            self.__output = np.zeros(N, dtype=dtype)
+
+        count = self.countPoints(scan_in, range_cutoff)
+        points = self.__output[:count]
+        self.projectLaserInto(scan_in, points)
+
+        cloud_out = self.create_cloud_from_array(scan_in.header, fields, points)
+
+        return cloud_out
+
+
+    def countPoints(self, scan_in, range_cutoff=-1.0):
+        """
+        Finds the beams of the scan within range, and returns how many there are.
+        Must be called before projectLaserInto for the same scan.
+        Keyword arguments:
+        scan_in -- The input laser scan.
+        range_cutoff -- An additional range cutoff which can be
+            applied which is more limiting than max_range in the scan
+            (default -1.0).
+        """
+        N = len(scan_in.ranges)
+        self.__update_geometry(scan_in)
 
-        ranges = np.array(scan_in.ranges)
+        if len(self.__work) < N:
+            self.__work = np.empty(N, dtype=np.float32)
+            self.__mask = np.empty(N, dtype=bool)
+            self.__in_range = np.empty(N, dtype=bool)
 
+        if range_cutoff < 0:
+            range_cutoff = scan_in.range_max
+        else:
+            range_cutoff = min(range_cutoff, scan_in.range_max)
+
+        ranges = self.__as_float32(scan_in.ranges)
+        mask = self.__mask[:N]
+        np.less(ranges, range_cutoff, out=mask)
+        np.greater_equal(ranges, scan_in.range_min, out=self.__in_range[:N])
+        np.logical_and(mask, self.__in_range[:N], out=mask)
+        return int(np.count_nonzero(mask))
+
+
+    def projectLaserInto(self, scan_in, points, transform_matrix=None):
+        """
+        Writes the beams found by countPoints into points, without allocating.
+        Keyword arguments:
+        scan_in -- The input laser scan, the same as given to countPoints.
+        points -- Structured array with the dtype of getFields, and one element per point
+            counted by countPoints.
+        transform_matrix -- Homogeneous transformation matrix (3x4 or 4x4) applied to the
+            points, or None to keep them in the frame of the scan.
+        """
+        N = len(scan_in.ranges)
+        ranges = self.__as_float32(scan_in.ranges)
+        mask = self.__mask[:N]
+        work = self.__work[:N]
+
+        if transform_matrix is None:
+            np.multiply(ranges, self.__cos_sin_map[0], out=work)
+            np.compress(mask, work, out=points['x'])
+            np.multiply(ranges, self.__cos_sin_map[1], out=work)
+            np.compress(mask, work, out=points['y'])
+            points['z'] = 0
+        else:
+            # The points lie in the plane of the scan, so each coordinate is the range times the
+            # rotated beam direction plus the translation
+            self.__update_rotation(transform_matrix)
+            for axis, name in enumerate(('x', 'y', 'z')):
+                np.multiply(ranges, self.__rotated[axis], out=work)
+                np.add(work, transform_matrix[axis][3], out=work)
+                np.compress(mask, work, out=points[name])
+
+        names = points.dtype.names
+        if 'intensity' in names:
+            np.compress(mask, self.__as_float32(scan_in.intensities), out=points['intensity'])
+        if 'index' in names:
+            np.compress(mask, self.__indices, out=points['index'])
+        if 'distances' in names:
+            np.compress(mask, ranges, out=points['distances'])
+        if 'stamps' in names:
+            np.multiply(self.__indices, scan_in.time_increment, out=work)
+            np.compress(mask, work, out=points['stamps'])
+        if 'vp_x' in names:
+            points['vp_x'] = 0
+            points['vp_y'] = 0
+            points['vp_z'] = 0
+
+
+    def __update_geometry(self, scan_in):
+        N = len(scan_in.ranges)
         if (self.__cos_sin_map.shape[1] != N or
             self.__angle_min != scan_in.angle_min or
-            self.__angle_max != scan_in.angle_max):
+            self.__angle_increment != scan_in.angle_increment):
 
             self.__angle_min = scan_in.angle_min
-            self.__angle_max = scan_in.angle_max
-            
-            angles = scan_in.angle_min + np.arange(N) * scan_in.angle_increment
-            self.__cos_sin_map = np.array([np.cos(angles), np.sin(angles)])
+            self.__angle_increment = scan_in.angle_increment
 
-        output = ranges * self.__cos_sin_map
+            angles = scan_in.angle_min + np.arange(N) * scan_in.angle_increment
+            self.__cos_sin_map = np.array([np.cos(angles), np.sin(angles)], dtype=np.float32)
+            self.__indices = np.arange(N, dtype=np.int32)
+            self.__matrix = None
 
-        # Set the output cloud accordingly
-        cloud_out = PointCloud2()
 
-        fields = [PointField() for _ in range(3)]
+    def __update_rotation(self, transform_matrix):
+        if self.__matrix is not None and np.array_equal(self.__matrix, transform_matrix[:3]):
+            return
+        self.__matrix = np.array(transform_matrix[:3], dtype=np.float64)
+        self.__rotated = (self.__matrix[:, :2] @ self.__cos_sin_map).astype(np.float32)
 
-        fields[0].name = "x"
-        fields[0].offset = 0
-        fields[0].datatype = PointField.FLOAT32
-        fields[0].count = 1
 
-        fields[1].name = "y"
-        fields[1].offset = 4
-        fields[1].datatype = PointField.FLOAT32
-        fields[1].count = 1
+    @staticmethod
+    def __as_float32(values):
+        # The sequences of rclpy messages are array.arrays, which are viewed without copying
+        if isinstance(values, array.array) and values.typecode == 'f':
+            return np.frombuffer(values, dtype=np.float32)
+        return np.asarray(values, dtype=np.float32)
 
-        fields[2].name = "z"
-        fields[2].offset = 8
-        fields[2].datatype = PointField.FLOAT32
-        fields[2].count = 1
 
-        idx_intensity = idx_index = idx_distance =  idx_timestamp = -1
-        idx_vpx = idx_vpy = idx_vpz = -1
+    def getFields(self, channel_options, has_intensities):
+        """
+        Returns the PointFields and the matching NumPy dtype for the given channels.
+        Both are cached, as they are the same for every scan from a laser.
+        """
+        key = (channel_options, has_intensities)
+        if key in self.__fields_cache:
+            return self.__fields_cache[key]
 
-        offset = 12
+        names = ["x", "y", "z"]
+        datatypes = [PointField.FLOAT32] * 3
 
-        if (channel_options & self.ChannelOption.INTENSITY and
-            len(scan_in.intensities) > 0):
-            field_size = len(fields)
-            fields.append(PointField())
-            fields[field_size].name = "intensity"
-            fields[field_size].datatype = PointField.FLOAT32
-            fields[field_size].offset = offset
-            fields[field_size].count = 1
-            offset += 4
-            idx_intensity = field_size
+        if channel_options & self.ChannelOption.INTENSITY and has_intensities:
+            names.append("intensity")
+            datatypes.append(PointField.FLOAT32)
 
         if channel_options & self.ChannelOption.INDEX:
-            field_size = len(fields)
-            fields.append(PointField())
-            fields[field_size].name = "index"
-            fields[field_size].datatype = PointField.INT32
-            fields[field_size].offset = offset
-            fields[field_size].count = 1
-            offset += 4
-            idx_index = field_size
+            names.append("index")
+            datatypes.append(PointField.INT32)
 
         if channel_options & self.ChannelOption.DISTANCE:
-            field_size = len(fields)
-            fields.append(PointField())
-            fields[field_size].name = "distances"
-            fields[field_size].datatype = PointField.FLOAT32
-            fields[field_size].offset = offset
-            fields[field_size].count = 1
-            offset += 4
-            idx_distance = field_size
+            names.append("distances")
+            datatypes.append(PointField.FLOAT32)
 
         if channel_options & self.ChannelOption.TIMESTAMP:
-            field_size = len(fields)
-            fields.append(PointField())
-            fields[field_size].name = "stamps"
-            fields[field_size].datatype = PointField.FLOAT32
-            fields[field_size].offset = offset
-            fields[field_size].count = 1
-            offset += 4
-            idx_timestamp = field_size
+            names.append("stamps")
+            datatypes.append(PointField.FLOAT32)
 
         if channel_options & self.ChannelOption.VIEWPOINT:
-            field_size = len(fields)
-            fields.extend([PointField() for _ in range(3)])
-            fields[field_size].name = "vp_x"
-            fields[field_size].datatype = PointField.FLOAT32
-            fields[field_size].offset = offset
-            fields[field_size].count = 1
-            offset += 4
-            idx_vpx = field_size
-            field_size += 1
-
-            fields[field_size].name = "vp_y"
-            fields[field_size].datatype = PointField.FLOAT32
-            fields[field_size].offset = offset
-            fields[field_size].count = 1
-            offset += 4
-            idx_vpy = field_size
-            field_size += 1
-
-            fields[field_size].name = "vp_z"
-            fields[field_size].datatype = PointField.FLOAT32
-            fields[field_size].offset = offset
-            fields[field_size].count = 1
-            offset += 4
-            idx_vpz = field_size
+            names.extend(["vp_x", "vp_y", "vp_z"])
+            datatypes.extend([PointField.FLOAT32] * 3)
 
-        if range_cutoff < 0:
-            range_cutoff = scan_in.range_max
-        else:
-            range_cutoff = min(range_cutoff, scan_in.range_max)
+        fields = []
+        for i, (name, datatype) in enumerate(zip(names, datatypes)):
+            field = PointField()
+            field.name = name
+            field.offset = 4 * i
+            field.datatype = datatype
+            field.count = 1
+            fields.append(field)
 
-        points = []
-        for i in range(N):
-            ri = scan_in.ranges[i]
-            if ri < range_cutoff and ri >= scan_in.range_min:
-                point = output[:, i].tolist()
-                point.append(0)
+        result = (fields, self.get_dtype(fields))
+        self.__fields_cache[key] = result
+        return result
 
-                if idx_intensity != -1:
-                    point.append(scan_in.intensities[i])
 
-                if idx_index != -1:
-                    point.append(i)
+    def get_dtype(self, fields, point_step=None):
+        """
+        Makes a NumPy structured dtype matching the layout of a point with the given fields.
+        @param fields: The point cloud fields.
+        @type  fields: iterable of sensor_msgs.msg.PointField
+        @param point_step: Size of a point in bytes. Defaults to the end of the last field.
+        @type  point_step: int
+        """
+        names, formats, offsets = [], [], []
+        for field in fields:
+            if field.datatype not in self._NP_DATATYPES:
+                print('Skipping unknown PointField datatype [%d]' % field.datatype, file=sys.stderr)
+                continue
+            datatype = self._NP_DATATYPES[field.datatype]
+            names.append(field.name)
+            formats.append(datatype if field.count == 1 else (datatype, (field.count,)))
+            offsets.append(field.offset)
 
-                if idx_distance != -1:
-                    point.append(scan_in.ranges[i])
+        if point_step is None:
+            point_step = max([o + np.dtype(f).itemsize for o, f in zip(offsets, formats)] + [0])
 
-                if idx_timestamp != -1:
-                    point.append(i * scan_in.time_increment)
+        return np.dtype({'names': names, 'formats': formats, 'offsets': offsets, 'itemsize': point_step})
 
-                if idx_vpx != -1 and idx_vpy != -1 and idx_vpz != -1:
-                    point.extend([0 for _ in range(3)])
 
-                points.append(point)
+    def cloud_to_array(self, cloud):
+        """
+        Returns the points of a PointCloud2 message as a NumPy structured array, without copying.
+        @param cloud: The point cloud to read from.
+        @type  cloud: sensor_msgs.msg.PointCloud2
+        """
+        dtype = self.get_dtype(cloud.fields, cloud.point_step)
+        if cloud.is_bigendian:
+            dtype = dtype.newbyteorder('>')
+        return np.frombuffer(cloud.data, dtype=dtype, count=cloud.width * cloud.height)
 
-        cloud_out = self.create_cloud(scan_in.header, fields, points)
 
-        return cloud_out
+    def create_cloud_from_array(self, header, fields, points):
+        """
+        Create a sensor_msgs.msg.PointCloud2 message from a NumPy structured array.
+        @param header: The point cloud header.
+        @type  header: std_msgs.msg.Header
+        @param fields: The point cloud fields, matching the dtype of points.
+        @type  fields: iterable of sensor_msgs.msg.PointField
+        @param points: The points, one element per point.
+        @type  points: numpy.ndarray
+        @return: The point cloud.
+        @rtype:  sensor_msgs.msg.PointCloud2
+        """
+        # An array.array is taken as it is by the message, other sequences are checked element by element
+        data = array.array('B')
+        data.frombytes(np.ascontiguousarray(points).data)
+
+        return PointCloud2(header=header,
+                           height=1,
+                           width=len(points),
+                           is_dense=False,
+                           is_bigendian=False,
+                           fields=fields,
+                           point_step=points.dtype.itemsize,
+                           row_step=points.dtype.itemsize * len(points),
+                           data=data)
 
 
     def concatenate_clouds(self, cloud1, cloud2):
@@ -206,22 +323,14 @@ class LaserToPointcloud():
         @param cloud2: Cloud expressed in the goal frame.
         @type cloud2: sensor_msgs.msg.PointCloud2
         '''
-        points_1 = self.read_points(cloud1)
-        points_2 = self.read_points(cloud2)
-
-        points_concatenated = []
-
-        for point in points_1:
-            points_concatenated.append(point)
-
-        for point in points_2:
-            points_concatenated.append(point)
+        points_1 = self.cloud_to_array(cloud1)
+        # Both clouds come from projectLaser with the same channels, so they have the same layout
+        points_2 = self.cloud_to_array(cloud2)
 
-        header = cloud1.header
+        points_concatenated = np.concatenate((points_1, points_2))
 
-        fields = cloud1.fields
         # The header doesnt really matter, as it is changed later.
-        concatenated_cloud = self.create_cloud(cloud1.header, fields, points_concatenated)
+        concatenated_cloud = self.create_cloud_from_array(cloud1.header, cloud1.fields, points_concatenated)
         return concatenated_cloud
 
 
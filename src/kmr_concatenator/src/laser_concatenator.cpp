@@ -0,0 +1,295 @@
+// Copyright 2020 Morten Melby Dahl.
+// Copyright 2020 Norwegian University of Science and Technology.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kmr_concatenator/laser_concatenator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rclcpp_components/register_node_macro.hpp"
+#include "sensor_msgs/msg/point_field.hpp"
+
+namespace kmr_concatenator
+{
+
+namespace
+{
+const std::vector<double> kLatencyBucketsMs{1, 2, 5, 10, 20, 50, 100, 200, 500};
+
+// Same matrix as CloudTransform.generate_transform, including the sign of the x-coordinate
+// of the translation, followed by the reflection about the x-axis done in do_transform_cloud.
+Eigen::Matrix<float, 3, 4> toMatrix(const geometry_msgs::msg::TransformStamped & transform)
+{
+  const double q0 = transform.transform.rotation.x;
+  const double q1 = transform.transform.rotation.y;
+  const double q2 = transform.transform.rotation.z;
+  const double q3 = transform.transform.rotation.w;
+  const auto & v = transform.transform.translation;
+
+  Eigen::Matrix<double, 4, 4> T;
+  T << q1 * q1 + q2 * q2 - q3 * q3 - q0 * q0, 2 * (q2 * q3 - q1 * q0), 2 * (q2 * q0 + q1 * q3), -v.x,
+    2 * (q2 * q3 + q1 * q0), q1 * q1 - q2 * q2 + q3 * q3 - q0 * q0, 2 * (q3 * q0 - q1 * q2), v.y,
+    2 * (q2 * q0 - q1 * q3), 2 * (q3 * q0 + q1 * q2), q1 * q1 - q2 * q2 - q3 * q3 + q0 * q0, v.z,
+    0, 0, 0, 1.0;
+
+  Eigen::Matrix<double, 4, 4> reflection = Eigen::Matrix<double, 4, 4>::Identity();
+  reflection(0, 0) = -1.0;
+
+  return (reflection * T).topRows<3>().cast<float>();
+}
+
+void addField(
+  sensor_msgs::msg::PointCloud2 & cloud, const std::string & name, uint8_t datatype,
+  uint32_t offset)
+{
+  sensor_msgs::msg::PointField field;
+  field.name = name;
+  field.offset = offset;
+  field.datatype = datatype;
+  field.count = 1;
+  cloud.fields.push_back(field);
+}
+
+diagnostic_msgs::msg::KeyValue keyValue(const std::string & key, const std::string & value)
+{
+  diagnostic_msgs::msg::KeyValue key_value;
+  key_value.key = key;
+  key_value.value = value;
+  return key_value;
+}
+
+std::string formatMs(double ms)
+{
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%.2f", ms);
+  return buffer;
+}
+}  // namespace
+
+LaserConcatenator::LaserConcatenator(const rclcpp::NodeOptions & options)
+: Node("laser_concatenator", options)
+{
+  target_frame_ = declare_parameter<std::string>("target_frame", "base_footprint");
+  scanner1_.frame = declare_parameter<std::string>("scan_frame_1", "laser_B1_link");
+  scanner2_.frame = declare_parameter<std::string>("scan_frame_2", "laser_B4_link");
+  const auto queue_size = declare_parameter<int>("queue_size", 10);
+  const auto max_interval = declare_parameter<double>("max_interval", 0.01);
+  // As the -sim argument of concatenator_node.py, for the clouds of the lasers in Gazebo
+  simulated_ = declare_parameter<bool>("simulated", false);
+
+  tf_buffer_ = std::make_shared<tf2_ros::Buffer>(get_clock());
+  tf_listener_ = std::make_shared<tf2_ros::TransformListener>(*tf_buffer_);
+
+  publisher_ = create_publisher<sensor_msgs::msg::PointCloud2>(
+    "pc_concatenated", rclcpp::SensorDataQoS());
+
+  subscriber1_.subscribe(this, "scan", rmw_qos_profile_sensor_data);
+  subscriber2_.subscribe(this, "scan_2", rmw_qos_profile_sensor_data);
+
+  // Scans less than max_interval apart are concatenated, as in concatenator_node.py
+  SyncPolicy policy(queue_size);
+  policy.setMaxIntervalDuration(rclcpp::Duration::from_seconds(max_interval));
+  synchronizer_ = std::make_shared<message_filters::Synchronizer<SyncPolicy>>(
+    static_cast<const SyncPolicy &>(policy), subscriber1_, subscriber2_);
+  synchronizer_->registerCallback(
+    std::bind(
+      &LaserConcatenator::callback, this, std::placeholders::_1, std::placeholders::_2));
+
+  latency_counts_.assign(kLatencyBucketsMs.size() + 1, 0);
+  diagnostics_publisher_ = create_publisher<diagnostic_msgs::msg::DiagnosticArray>(
+    "/diagnostics", 10);
+  diagnostics_timer_ = create_wall_timer(
+    std::chrono::seconds(1), std::bind(&LaserConcatenator::publishDiagnostics, this));
+
+  RCLCPP_INFO(get_logger(), "Initialized laser scan synchronizer.");
+}
+
+bool LaserConcatenator::lookupTransform(Scanner & scanner)
+{
+  if (scanner.has_transform) {
+    return true;
+  }
+  try {
+    // The scanners are fixed to the base, so the transform is only looked up once
+    scanner.transform = toMatrix(
+      tf_buffer_->lookupTransform(target_frame_, scanner.frame, tf2::TimePointZero));
+    scanner.has_transform = true;
+    scanner.directions.resize(3, 0);
+    RCLCPP_INFO(
+      get_logger(), "Got transform from %s to %s", scanner.frame.c_str(), target_frame_.c_str());
+  } catch (const tf2::TransformException & e) {
+    RCLCPP_WARN_THROTTLE(
+      get_logger(), *get_clock(), 5000, "Error looking up transform: %s. "
+      "Did you remember to launch the publisher from kmr_bringup?", e.what());
+  }
+  return scanner.has_transform;
+}
+
+void LaserConcatenator::updateDirections(Scanner & scanner, const LaserScan & scan)
+{
+  const auto beams = static_cast<Eigen::Index>(scan.ranges.size());
+  if (scanner.directions.cols() == beams && scanner.angle_min == scan.angle_min &&
+    scanner.angle_increment == scan.angle_increment)
+  {
+    return;
+  }
+
+  // A point at range r along beam i ends up at translation + r * directions.col(i)
+  const Eigen::ArrayXf angles =
+    scan.angle_min + Eigen::ArrayXf::LinSpaced(beams, 0.0f, beams - 1.0f) * scan.angle_increment;
+  scanner.directions = scanner.transform.col(0) * angles.cos().matrix().transpose() +
+    scanner.transform.col(1) * angles.sin().matrix().transpose();
+  scanner.angle_min = scan.angle_min;
+  scanner.angle_increment = scan.angle_increment;
+}
+
+size_t LaserConcatenator::projectScan(
+  Scanner & scanner, const LaserScan & scan, bool with_intensity,
+  sensor_msgs::msg::PointCloud2 & cloud, size_t offset)
+{
+  updateDirections(scanner, scan);
+
+  const Eigen::Vector3f translation = scanner.transform.col(3);
+  const float range_min = scan.range_min;
+  const float range_max = scan.range_max;
+  const bool has_intensity = scan.intensities.size() == scan.ranges.size();
+
+  uint8_t * data = cloud.data.data() + offset * cloud.point_step;
+  size_t count = 0;
+  for (size_t i = 0; i < scan.ranges.size(); ++i) {
+    const float range = scan.ranges[i];
+    if (!(range < range_max && range >= range_min)) {
+      continue;
+    }
+
+    float values[4];
+    Eigen::Map<Eigen::Vector3f> point(values);
+    point = translation + range * scanner.directions.col(i);
+    // Clouds generated in Gazebo get the homogeneous coordinate as intensity, as in
+    // CloudTransform.do_transform_cloud
+    values[3] = simulated_ ? 1.0f : (has_intensity ? scan.intensities[i] : 0.0f);
+    const int32_t index = static_cast<int32_t>(i);
+
+    const size_t floats = with_intensity ? 4 : 3;
+    std::memcpy(data, values, floats * sizeof(float));
+    std::memcpy(data + floats * sizeof(float), &index, sizeof(index));
+    data += cloud.point_step;
+    ++count;
+  }
+  return count;
+}
+
+void LaserConcatenator::callback(
+  const LaserScan::ConstSharedPtr & scan1, const LaserScan::ConstSharedPtr & scan2)
+{
+  if (!lookupTransform(scanner1_) || !lookupTransform(scanner2_)) {
+    return;
+  }
+
+  // Same fields as LaserToPointcloud.projectLaser with the default channels
+  const bool with_intensity = !scan1->intensities.empty();
+  auto cloud = std::make_unique<sensor_msgs::msg::PointCloud2>();
+  cloud->header.stamp = scan1->header.stamp;
+  cloud->header.frame_id = target_frame_;
+  addField(*cloud, "x", sensor_msgs::msg::PointField::FLOAT32, 0);
+  addField(*cloud, "y", sensor_msgs::msg::PointField::FLOAT32, 4);
+  addField(*cloud, "z", sensor_msgs::msg::PointField::FLOAT32, 8);
+  uint32_t offset = 12;
+  if (with_intensity) {
+    addField(*cloud, "intensity", sensor_msgs::msg::PointField::FLOAT32, offset);
+    offset += 4;
+  }
+  addField(*cloud, "index", sensor_msgs::msg::PointField::INT32, offset);
+  cloud->point_step = offset + 4;
+
+  // Allocated once for the largest possible cloud, and shrunk to the valid points
+  cloud->data.resize((scan1->ranges.size() + scan2->ranges.size()) * cloud->point_step);
+  size_t points = projectScan(scanner1_, *scan1, with_intensity, *cloud, 0);
+  points += projectScan(scanner2_, *scan2, with_intensity, *cloud, points);
+  cloud->data.resize(points * cloud->point_step);
+
+  cloud->height = 1;
+  cloud->width = static_cast<uint32_t>(points);
+  cloud->row_step = cloud->point_step * cloud->width;
+  cloud->is_bigendian = false;
+  cloud->is_dense = false;
+
+  // The scans are stamped with their acquisition time by kmp_laserscan_node
+  const rclcpp::Time stamp(cloud->header.stamp, get_clock()->get_clock_type());
+  publisher_->publish(std::move(cloud));
+  addLatency(now() - stamp);
+}
+
+void LaserConcatenator::addLatency(const rclcpp::Duration & latency)
+{
+  const double latency_ms = latency.nanoseconds() * 1e-6;
+  const auto bucket = std::lower_bound(
+    kLatencyBucketsMs.begin(), kLatencyBucketsMs.end(), latency_ms) - kLatencyBucketsMs.begin();
+
+  std::lock_guard<std::mutex> lock(latency_mutex_);
+  ++latency_counts_[bucket];
+  latency_total_ms_ += latency_ms;
+  latency_max_ms_ = std::max(latency_max_ms_, latency_ms);
+}
+
+void LaserConcatenator::publishDiagnostics()
+{
+  diagnostic_msgs::msg::DiagnosticStatus status;
+  status.name = std::string(get_name()) + ": latency";
+  status.hardware_id = get_name();
+  status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+  status.message = "OK";
+  {
+    std::lock_guard<std::mutex> lock(latency_mutex_);
+    uint64_t count = 0;
+    for (const auto bucket : latency_counts_) {
+      count += bucket;
+    }
+    const std::string stage = "concatenation ";
+    status.values.push_back(keyValue(stage + "count", std::to_string(count)));
+    status.values.push_back(
+      keyValue(stage + "mean ms", formatMs(count ? latency_total_ms_ / count : 0.0)));
+    status.values.push_back(keyValue(stage + "max ms", formatMs(latency_max_ms_)));
+    int lower = 0;
+    for (size_t i = 0; i < latency_counts_.size(); ++i) {
+      std::string name;
+      if (i < kLatencyBucketsMs.size()) {
+        const int upper = static_cast<int>(kLatencyBucketsMs[i]);
+        name = std::to_string(lower) + "-" + std::to_string(upper) + " ms";
+        lower = upper;
+      } else {
+        name = ">" + std::to_string(lower) + " ms";
+      }
+      status.values.push_back(keyValue(stage + name, std::to_string(latency_counts_[i])));
+    }
+    std::fill(latency_counts_.begin(), latency_counts_.end(), 0);
+    latency_total_ms_ = 0.0;
+    latency_max_ms_ = 0.0;
+  }
+
+  diagnostic_msgs::msg::DiagnosticArray msg;
+  msg.header.stamp = now();
+  msg.status.push_back(status);
+  diagnostics_publisher_->publish(msg);
+}
+
+}  // namespace kmr_concatenator
+
+RCLCPP_COMPONENTS_REGISTER_NODE(kmr_concatenator::LaserConcatenator)
@@ -16,6 +16,7 @@
 # limitations under the License.
 
 import _thread as thread
+import threading
 import time
 import sys
 import numpy as np
@@ -25,7 +26,8 @@ from std_msgs.msg import String
 from geometry_msgs.msg import Point, Pose, Quaternion, Twist
 from builtin_interfaces.msg import Time
 from rclpy.qos import qos_profile_sensor_data
-from rclpy.action import ActionServer, GoalResponse
+from rclpy.action import ActionServer, CancelResponse, GoalResponse
+from rclpy.duration import Duration
 from rclpy.callback_groups import ReentrantCallbackGroup
 from rclpy.executors import MultiThreadedExecutor
 from kmr_msgs.action import ObjectSearch
@@ -37,6 +39,9 @@ from object_msgs.msg import ObjectInBox
 from object_msgs.msg import ObjectsInBoxes
 from geometry_msgs.msg import Point32
 from geometry_msgs.msg import PoseStamped
+import tf2_ros
+# Registers PoseStamped with Buffer.transform
+import tf2_geometry_msgs
 
 
 
@@ -46,14 +51,33 @@ class ObjectDetectionNode(Node):
     def __init__(self):
         super().__init__('object_detection_node')
         self.name='object_detection_node'
-        self.detection_threshold = 0.5
+        self.declare_parameter('detection_threshold', 0.5)
+        self.declare_parameter('search_timeout', 20.0)
+        # Upper limit for continuous searches, which normally end when the sweep is done
+        self.declare_parameter('continuous_search_timeout', 120.0)
+        # Detections made while the camera moves are given in this frame, which does not move
+        self.declare_parameter('continuous_search_frame', 'base_footprint')
+        self.detection_threshold = self.get_parameter('detection_threshold').value
+        self.continuous_search_frame = self.get_parameter('continuous_search_frame').value
         self.detected_object_pose = None
         self.isSearching = False
 
+        # Set by the detection callback when an object is found, and on cancel
+        self.search_done = threading.Event()
+        self.search_lock = threading.Lock()
+        self.search_goal_handle = None
+        self.search_threshold = self.detection_threshold
+
+        self.tf_buffer = tf2_ros.Buffer()
+        self.tf_listener = tf2_ros.TransformListener(self.tf_buffer, self)
+
         self.pipelinename = "object"
         self.callback_group = ReentrantCallbackGroup() 
 
-        self.object_detection_action_server = ActionServer(self,ObjectSearch,'object_search',self.object_search_callback, callback_group=self.callback_group)
+        # Found objects are added to the planning scene by run_moveit
+        self.detected_object_publisher = self.create_publisher(PoseStamped, '/moveit/detected_object', 10)
+
+        self.object_detection_action_server = ActionServer(self,ObjectSearch,'object_search',self.object_search_callback, callback_group=self.callback_group, cancel_callback=self.cancel_callback)
 
         self.client = self.create_client(PipelineSrv, '/openvino_toolkit/pipeline_service')
         self.request = PipelineSrv.Request()
@@ -68,39 +92,84 @@ class ObjectDetectionNode(Node):
 
 
     def detectedObject_callback(self, ObjectsInBoxes):
-        probability=0
+        # Only the objects of this message, the camera may have moved since the last one
+        instance = None
         for instance in ObjectsInBoxes.objects_in_boxes:
-            probability = instance.object.probability
             self.last_instance= instance
-        if(self.last_instance != None and self.isSearching):
-            if(self.last_instance.object.probability>=self.detection_threshold):
-                self.detected_object_pose = self.getBoundingBoxMidPoint(self.last_instance.min, self.last_instance.max)
-                print("OBJECT DETECTED")
+        if(instance == None or not self.isSearching):
+            return
+        probability = instance.object.probability
+        pose = self.getBoundingBoxMidPoint(instance.min, instance.max, ObjectsInBoxes.header.stamp)
+
+        with self.search_lock:
+            goal_handle = self.search_goal_handle
+            continuous = goal_handle != None and goal_handle.request.continuous
+        if continuous:
+            pose = self.toSearchFrame(pose)
+            if pose == None:
+                return
+            feedback = ObjectSearch.Feedback()
+            feedback.probability = probability
+            feedback.pose = pose
+            goal_handle.publish_feedback(feedback)
+
+        if(probability>=self.search_threshold):
+            with self.search_lock:
+                if not self.isSearching:
+                    return
+                self.detected_object_pose = pose
                 self.endSearch()
+            self.detected_object_publisher.publish(pose)
+            print("OBJECT DETECTED")
+            self.search_done.set()
+
+    def cancel_callback(self, goal_handle):
+        self.search_done.set()
+        return CancelResponse.ACCEPT
 
     def object_search_callback(self, goal_handle):
-        self.startSearch()
-        starttime = time.time()
+        request = goal_handle.request
+        timeout = request.timeout
+        if timeout <= 0:
+            timeout = self.get_parameter('continuous_search_timeout' if request.continuous else 'search_timeout').value
+        with self.search_lock:
+            self.search_threshold = request.detection_threshold if request.detection_threshold > 0 else self.detection_threshold
+            self.detected_object_pose = None
+            self.search_done.clear()
+            self.search_goal_handle = goal_handle
+            self.startSearch()
         self.get_logger().info('Executing goal...')
-        elapsed = 0
-        while (self.isSearching and elapsed<20):
-            elapsed = time.time() - starttime
-            pass
+
+        # Woken up by the first detection above the threshold, or by a cancel request
+        self.search_done.wait(timeout)
         print("done searching")
-        if self.isSearching:
-           self.endSearch()
+        with self.search_lock:
+            if self.isSearching:
+               self.endSearch()
+            self.search_goal_handle = None
+            pose = self.detected_object_pose
+            self.detected_object_pose = None
+
         result = ObjectSearch.Result()
-        if self.detected_object_pose != None:
+        if pose != None:
             result.success = True
-            result.pose = self.detected_object_pose
-            self.detected_object_pose = None
-        if result.success == True:
+            result.pose = pose
             goal_handle.succeed()
+        elif goal_handle.is_cancel_requested:
+            goal_handle.canceled()
         else:
             print("aborting goal")
+            result.error = 'No object found'
             goal_handle.abort()
         return result
 
+    def toSearchFrame(self, pose):
+        try:
+            return self.tf_buffer.transform(pose, self.continuous_search_frame, timeout=Duration(seconds=0.1))
+        except (tf2_ros.LookupException, tf2_ros.ConnectivityException, tf2_ros.ExtrapolationException) as e:
+            self.get_logger().warn('Could not transform detection to ' + self.continuous_search_frame + ': ' + str(e))
+            return None
+
     def startSearch(self):
         self.isSearching = True
         #self.send_pipeline_request("RUN_PIPELINE")
@@ -111,8 +180,9 @@ class ObjectDetectionNode(Node):
         #self.send_pipeline_request("PAUSE_PIPELINE")
 
 
-    def getBoundingBoxMidPoint(self,min,max):
+    def getBoundingBoxMidPoint(self,min,max,stamp):
         midpoint = PoseStamped()
+        midpoint.header.stamp = stamp
         midpoint.pose.position.x = min.x - (min.x-max.x)/2
         midpoint.pose.position.y = min.y - (min.y-max.y)/2
         midpoint.pose.position.z = min.z - (min.z-max.z)/2
@@ -0,0 +1,76 @@
+/* Author: Nina Marie Wahl
+   Desc: Cache of planned trajectories to the named frames of the manipulator
+*/
+
+#ifndef KMR_MOVEIT2__PLAN_CACHE_HPP_
+#define KMR_MOVEIT2__PLAN_CACHE_HPP_
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit/robot_state/robot_state.h>
+#include <trajectory_msgs/msg/joint_trajectory.hpp>
+
+namespace kmr_moveit2
+{
+// Plans are stored per (start state bucket, goal frame, planning scene hash). The start state
+// is bucketed by rounding the joint positions of the planning group to bucket_size, and the
+// scene hash changes whenever collision objects are added, moved or removed.
+class PlanCache
+{
+public:
+  PlanCache(const std::string& group, double bucket_size, const std::string& file_name);
+
+  // Returns true and fills in trajectory if there is a plan for the given start and goal
+  bool lookup(const moveit::core::RobotState& start_state, const std::string& goal_frame, std::size_t scene_hash,
+              trajectory_msgs::msg::JointTrajectory& trajectory) const;
+
+  void insert(const moveit::core::RobotState& start_state, const std::string& goal_frame, std::size_t scene_hash,
+              const trajectory_msgs::msg::JointTrajectory& trajectory);
+
+  void erase(const moveit::core::RobotState& start_state, const std::string& goal_frame, std::size_t scene_hash);
+
+  // Persist the cache to file_name, so that it survives restarts. All return false on errors.
+  // The file is written next to file_name and renamed over it, so it is never left half
+  // written.
+  bool load();
+  bool save();
+  // Only writes the file if plans were inserted or erased since it was last written
+  bool saveIfChanged();
+
+  std::size_t size() const;
+
+  static std::size_t hashScene(const planning_scene::PlanningScene& scene);
+
+private:
+  struct Key
+  {
+    std::vector<int32_t> start_bucket;
+    std::string goal_frame;
+    std::size_t scene_hash;
+
+    bool operator<(const Key& other) const;
+  };
+
+  // Called with mutex_ held
+  bool writeFile();
+
+  Key makeKey(const moveit::core::RobotState& start_state, const std::string& goal_frame,
+              std::size_t scene_hash) const;
+
+  std::string group_;
+  double bucket_size_;
+  std::string file_name_;
+
+  mutable std::mutex mutex_;
+  std::map<Key, trajectory_msgs::msg::JointTrajectory> entries_;
+  bool changed_ = false;
+};
+
+}  // namespace kmr_moveit2
+
+#endif  // KMR_MOVEIT2__PLAN_CACHE_HPP_
@@ -0,0 +1,90 @@
+/* Author: Nina Marie Wahl
+   Desc: Runs the same planning request on several planning components in parallel
+*/
+
+#ifndef KMR_MOVEIT2__PLAN_RACER_HPP_
+#define KMR_MOVEIT2__PLAN_RACER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <moveit/moveit_cpp/moveit_cpp.h>
+#include <moveit/moveit_cpp/planning_component.h>
+
+namespace kmr_moveit2
+{
+// Every racer has its own PlanningComponent, as a PlanningComponent can not run several plans
+// at once. The racers are spread over the planning pipelines of the group, and OMPL uses a new
+// random seed for every request, so the racers on the same pipeline explore different paths.
+class PlanRacer
+{
+public:
+  using PlanningComponent = moveit::planning_interface::PlanningComponent;
+
+  enum class Mode
+  {
+    FIRST_SUCCESS,  // Return the first valid trajectory
+    BEST            // Return the shortest trajectory found before the deadline
+  };
+
+  PlanRacer(const moveit::planning_interface::MoveItCppPtr& moveit_cpp, const std::string& group,
+            std::size_t racers, Mode mode, std::chrono::duration<double> deadline);
+
+  // Waits for the racers that are still planning, as their threads use the racers
+  ~PlanRacer();
+
+  // configure is called once per racer to set the goal and the start state of its
+  // PlanningComponent. At most max_racers take part in the race, all of them if it is 0.
+  // Returns an unsuccessful solution if no racer found a plan in time.
+  PlanningComponent::PlanSolution plan(const std::function<void(PlanningComponent&)>& configure,
+                                       const PlanningComponent::PlanRequestParameters& parameters,
+                                       std::size_t max_racers = 0);
+
+  static Mode modeFromString(const std::string& mode);
+
+private:
+  struct Racer
+  {
+    std::shared_ptr<PlanningComponent> component;
+    std::string pipeline;
+    // Set while a plan is running. The planning pipelines can not be interrupted, so racers
+    // that lost the last race may still be planning, and are left out until they are done.
+    std::shared_ptr<std::atomic<bool>> busy;
+    // The thread of the last plan, joined before the next plan or when the racer is destroyed
+    std::thread thread;
+  };
+
+  // Signalled by the planning threads when their racer is no longer busy
+  struct Idle
+  {
+    std::mutex mutex;
+    std::condition_variable cv;
+  };
+
+  // Shared between a race and its planning threads, which may outlive the race
+  struct Race;
+
+  // Starts a plan on up to max_racers racers that are not busy, returns how many were started
+  std::size_t startRacers(const std::shared_ptr<Race>& race,
+                          const std::function<void(PlanningComponent&)>& configure,
+                          const PlanningComponent::PlanRequestParameters& parameters, std::size_t max_racers);
+
+  bool anyRacerIdle() const;
+  bool anyRacerBusy() const;
+
+  std::vector<Racer> racers_;
+  std::shared_ptr<Idle> idle_;
+  Mode mode_;
+  std::chrono::duration<double> deadline_;
+};
+
+}  // namespace kmr_moveit2
+
+#endif  // KMR_MOVEIT2__PLAN_RACER_HPP_
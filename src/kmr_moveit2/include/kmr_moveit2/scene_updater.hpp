@@ -0,0 +1,64 @@
+/* Author: Nina Marie Wahl
+   Desc: Keeps detected objects and occupied carry areas in the planning scene
+*/
+
+#ifndef KMR_MOVEIT2__SCENE_UPDATER_HPP_
+#define KMR_MOVEIT2__SCENE_UPDATER_HPP_
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <geometry_msgs/msg/pose_stamped.hpp>
+#include <moveit/planning_scene_monitor/planning_scene_monitor.h>
+#include <moveit_msgs/msg/collision_object.hpp>
+#include <rclcpp/rclcpp.hpp>
+#include <std_msgs/msg/string.hpp>
+
+namespace kmr_moveit2
+{
+// Objects found by object_detection_node and objects left in the carry areas by the behavior
+// tree are added to the planning scene as collision objects. The changes received between two
+// updates are applied together under one short write lock, at most rate times per second, and
+// the planning scene monitor only publishes the diff.
+class SceneUpdater
+{
+public:
+  // object_size is the height and radius of the cylinder used for the objects
+  SceneUpdater(const rclcpp::Node::SharedPtr& node, const planning_scene_monitor::PlanningSceneMonitorPtr& monitor,
+               double rate, const std::vector<double>& object_size);
+
+  // Removed at once, for instance before planning a grasp of the object
+  void remove(const std::string& id);
+
+  static constexpr const char* DETECTED_OBJECT = "detected_object";
+
+private:
+  void detectionCallback(const geometry_msgs::msg::PoseStamped::SharedPtr msg);
+
+  void carryAreaCallback(const std_msgs::msg::String::SharedPtr msg);
+
+  void update();
+
+  moveit_msgs::msg::CollisionObject makeObject(const std::string& id,
+                                               const geometry_msgs::msg::PoseStamped& pose) const;
+
+  planning_scene_monitor::PlanningSceneMonitorPtr monitor_;
+  std::vector<double> object_size_;
+
+  std::mutex mutex_;
+  // Only the latest change of every object is applied
+  std::map<std::string, moveit_msgs::msg::CollisionObject> pending_objects_;
+  // The object in an occupied carry area is placed where the gripper released it
+  std::set<std::string> pending_carry_areas_;
+
+  rclcpp::Subscription<geometry_msgs::msg::PoseStamped>::SharedPtr detection_subscriber_;
+  rclcpp::Subscription<std_msgs::msg::String>::SharedPtr carry_area_subscriber_;
+  rclcpp::TimerBase::SharedPtr timer_;
+};
+
+}  // namespace kmr_moveit2
+
+#endif  // KMR_MOVEIT2__SCENE_UPDATER_HPP_
@@ -0,0 +1,22 @@
+/* Author: Nina Marie Wahl
+   Desc: Removes the waypoints of planned trajectories that the controller can interpolate
+*/
+
+#ifndef KMR_MOVEIT2__TRAJECTORY_COMPRESSION_HPP_
+#define KMR_MOVEIT2__TRAJECTORY_COMPRESSION_HPP_
+
+#include <trajectory_msgs/msg/joint_trajectory.hpp>
+
+namespace kmr_moveit2
+{
+// Keeps the first and last waypoint, and the fewest waypoints in between so that every removed
+// waypoint is within tolerance (rad, for every joint) of the interpolation in time between the
+// kept waypoints around it. The kept waypoints are unchanged, with their velocities,
+// accelerations and times, and the Sunrise controller fits its spline through them. A
+// tolerance of 0 or less leaves the trajectory as it is.
+trajectory_msgs::msg::JointTrajectory compressTrajectory(const trajectory_msgs::msg::JointTrajectory& trajectory,
+                                                         double tolerance);
+
+}  // namespace kmr_moveit2
+
+#endif  // KMR_MOVEIT2__TRAJECTORY_COMPRESSION_HPP_
@@ -0,0 +1,47 @@
+/* Author: Nina Marie Wahl
+   Desc: Replays planned trajectories as robot states for RViz in the background
+*/
+
+#ifndef KMR_MOVEIT2__TRAJECTORY_VISUALIZER_HPP_
+#define KMR_MOVEIT2__TRAJECTORY_VISUALIZER_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <moveit_msgs/msg/display_robot_state.hpp>
+#include <rclcpp/rclcpp.hpp>
+
+namespace kmr_moveit2
+{
+// The trajectory is replayed in real time on its own thread, publishing at most rate robot
+// states per second. A new trajectory replaces the one being replayed.
+class TrajectoryVisualizer
+{
+public:
+  TrajectoryVisualizer(const rclcpp::Publisher<moveit_msgs::msg::DisplayRobotState>::SharedPtr& publisher,
+                       double rate);
+  ~TrajectoryVisualizer();
+
+  // Returns at once, the trajectory is copied
+  void visualize(const robot_trajectory::RobotTrajectory& trajectory);
+
+private:
+  void run();
+
+  rclcpp::Publisher<moveit_msgs::msg::DisplayRobotState>::SharedPtr publisher_;
+  std::chrono::duration<double> period_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  robot_trajectory::RobotTrajectoryPtr next_trajectory_;
+  bool shutting_down_ = false;
+  std::thread thread_;
+};
+
+}  // namespace kmr_moveit2
+
+#endif  // KMR_MOVEIT2__TRAJECTORY_VISUALIZER_HPP_
@@ -0,0 +1,283 @@
+/* Author: Nina Marie Wahl
+   Desc: Cache of planned trajectories to the named frames of the manipulator
+*/
+
+#include <kmr_moveit2/plan_cache.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <tuple>
+#include <utility>
+
+#include <rclcpp/rclcpp.hpp>
+#include <rclcpp/serialization.hpp>
+#include <rclcpp/serialized_message.hpp>
+
+static const rclcpp::Logger LOGGER = rclcpp::get_logger("plan_cache");
+
+// Written first in the cache file, bump it when the file layout changes
+static const uint32_t FILE_VERSION = 1;
+
+namespace
+{
+// FNV-1a, so that the scene hash is the same across restarts of the node
+void hashBytes(std::size_t& hash, const void* data, std::size_t length)
+{
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (std::size_t i = 0; i < length; ++i)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+}
+
+// Poses are rounded to 0.1 mm, so that noise in republished objects does not change the hash
+void hashValue(std::size_t& hash, double value)
+{
+  const int64_t rounded = static_cast<int64_t>(std::llround(value * 1e4));
+  hashBytes(hash, &rounded, sizeof(rounded));
+}
+
+template <class T>
+void write(std::ofstream& file, const T& value)
+{
+  file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <class T>
+bool read(std::ifstream& file, T& value)
+{
+  return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+// Upper bounds for the lengths read from the file, so a corrupt file can not make load()
+// allocate arbitrary amounts of memory
+const uint64_t MAX_BUCKET_SIZE = 64;
+const uint64_t MAX_FRAME_NAME_LENGTH = 1024;
+const uint64_t MAX_TRAJECTORY_BYTES = 64 * 1024 * 1024;
+
+// Reads a length of up to max elements of element_size bytes, which must also fit in the rest
+// of the file
+bool readLength(std::ifstream& file, uint64_t file_size, uint64_t max, uint64_t element_size, uint64_t& length)
+{
+  if (!read(file, length) || length > max)
+    return false;
+  const auto position = file.tellg();
+  return position >= 0 && length * element_size <= file_size - static_cast<uint64_t>(position);
+}
+}  // namespace
+
+namespace kmr_moveit2
+{
+bool PlanCache::Key::operator<(const Key& other) const
+{
+  return std::tie(goal_frame, scene_hash, start_bucket) <
+         std::tie(other.goal_frame, other.scene_hash, other.start_bucket);
+}
+
+PlanCache::PlanCache(const std::string& group, double bucket_size, const std::string& file_name)
+  : group_(group), bucket_size_(bucket_size), file_name_(file_name)
+{
+}
+
+PlanCache::Key PlanCache::makeKey(const moveit::core::RobotState& start_state, const std::string& goal_frame,
+                                  std::size_t scene_hash) const
+{
+  Key key;
+  key.goal_frame = goal_frame;
+  key.scene_hash = scene_hash;
+
+  std::vector<double> positions;
+  start_state.copyJointGroupPositions(group_, positions);
+  key.start_bucket.reserve(positions.size());
+  for (const double position : positions)
+    key.start_bucket.push_back(static_cast<int32_t>(std::lround(position / bucket_size_)));
+  return key;
+}
+
+bool PlanCache::lookup(const moveit::core::RobotState& start_state, const std::string& goal_frame,
+                       std::size_t scene_hash, trajectory_msgs::msg::JointTrajectory& trajectory) const
+{
+  const Key key = makeKey(start_state, goal_frame, scene_hash);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it == entries_.end())
+    return false;
+  trajectory = it->second;
+  return true;
+}
+
+void PlanCache::insert(const moveit::core::RobotState& start_state, const std::string& goal_frame,
+                       std::size_t scene_hash, const trajectory_msgs::msg::JointTrajectory& trajectory)
+{
+  const Key key = makeKey(start_state, goal_frame, scene_hash);
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_[key] = trajectory;
+  changed_ = true;
+}
+
+void PlanCache::erase(const moveit::core::RobotState& start_state, const std::string& goal_frame,
+                      std::size_t scene_hash)
+{
+  const Key key = makeKey(start_state, goal_frame, scene_hash);
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (entries_.erase(key) > 0)
+    changed_ = true;
+}
+
+std::size_t PlanCache::size() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+std::size_t PlanCache::hashScene(const planning_scene::PlanningScene& scene)
+{
+  std::size_t hash = 14695981039346656037ULL;
+  const auto& world = scene.getWorld();
+  // getObjectIds() is sorted, as the objects are kept in a std::map
+  for (const auto& id : world->getObjectIds())
+  {
+    hashBytes(hash, id.data(), id.size());
+    const auto object = world->getObject(id);
+    for (std::size_t i = 0; i < object->shapes_.size(); ++i)
+    {
+      const int type = object->shapes_[i]->type;
+      hashBytes(hash, &type, sizeof(type));
+      const Eigen::Isometry3d& pose = object->shape_poses_[i];
+      for (int j = 0; j < 3; ++j)
+        hashValue(hash, pose.translation()[j]);
+      const Eigen::Quaterniond rotation(pose.rotation());
+      hashValue(hash, rotation.x());
+      hashValue(hash, rotation.y());
+      hashValue(hash, rotation.z());
+      hashValue(hash, rotation.w());
+    }
+  }
+  return hash;
+}
+
+bool PlanCache::save()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return writeFile();
+}
+
+bool PlanCache::saveIfChanged()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return !changed_ || writeFile();
+}
+
+bool PlanCache::writeFile()
+{
+  const std::string temporary = file_name_ + ".tmp";
+  std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+  if (!file)
+  {
+    RCLCPP_WARN(LOGGER, "Could not open %s for writing", temporary.c_str());
+    return false;
+  }
+
+  rclcpp::Serialization<trajectory_msgs::msg::JointTrajectory> serialization;
+  write(file, FILE_VERSION);
+  write(file, static_cast<uint64_t>(entries_.size()));
+  for (const auto& entry : entries_)
+  {
+    const Key& key = entry.first;
+    write(file, static_cast<uint64_t>(key.start_bucket.size()));
+    file.write(reinterpret_cast<const char*>(key.start_bucket.data()), key.start_bucket.size() * sizeof(int32_t));
+    write(file, static_cast<uint64_t>(key.goal_frame.size()));
+    file.write(key.goal_frame.data(), key.goal_frame.size());
+    write(file, static_cast<uint64_t>(key.scene_hash));
+
+    rclcpp::SerializedMessage serialized;
+    serialization.serialize_message(&entry.second, &serialized);
+    const auto& buffer = serialized.get_rcl_serialized_message();
+    write(file, static_cast<uint64_t>(buffer.buffer_length));
+    file.write(reinterpret_cast<const char*>(buffer.buffer), buffer.buffer_length);
+  }
+  file.close();
+
+  if (!file || std::rename(temporary.c_str(), file_name_.c_str()) != 0)
+  {
+    RCLCPP_WARN(LOGGER, "Could not write the plan cache to %s", file_name_.c_str());
+    std::remove(temporary.c_str());
+    return false;
+  }
+  changed_ = false;
+  RCLCPP_DEBUG(LOGGER, "Saved %zu plans to %s", entries_.size(), file_name_.c_str());
+  return true;
+}
+
+bool PlanCache::load()
+{
+  std::ifstream file(file_name_, std::ios::binary | std::ios::ate);
+  if (!file)
+  {
+    RCLCPP_INFO(LOGGER, "No plan cache found at %s", file_name_.c_str());
+    return false;
+  }
+  const uint64_t file_size = static_cast<uint64_t>(file.tellg());
+  file.seekg(0);
+
+  uint32_t version = 0;
+  uint64_t count = 0;
+  if (!read(file, version) || version != FILE_VERSION || !read(file, count))
+  {
+    RCLCPP_WARN(LOGGER, "Ignoring plan cache %s with unknown format", file_name_.c_str());
+    return false;
+  }
+
+  rclcpp::Serialization<trajectory_msgs::msg::JointTrajectory> serialization;
+  std::map<Key, trajectory_msgs::msg::JointTrajectory> entries;
+  for (uint64_t i = 0; i < count; ++i)
+  {
+    Key key;
+    uint64_t length = 0;
+    if (!readLength(file, file_size, MAX_BUCKET_SIZE, sizeof(int32_t), length))
+      break;
+    key.start_bucket.resize(length);
+    if (!file.read(reinterpret_cast<char*>(key.start_bucket.data()), length * sizeof(int32_t)))
+      break;
+    if (!readLength(file, file_size, MAX_FRAME_NAME_LENGTH, 1, length))
+      break;
+    key.goal_frame.resize(length);
+    if (!file.read(&key.goal_frame[0], length))
+      break;
+    uint64_t scene_hash = 0;
+    if (!read(file, scene_hash) || !readLength(file, file_size, MAX_TRAJECTORY_BYTES, 1, length))
+      break;
+    key.scene_hash = static_cast<std::size_t>(scene_hash);
+
+    rclcpp::SerializedMessage serialized(length);
+    auto& buffer = serialized.get_rcl_serialized_message();
+    if (!file.read(reinterpret_cast<char*>(buffer.buffer), length))
+      break;
+    buffer.buffer_length = length;
+    try
+    {
+      serialization.deserialize_message(&serialized, &entries[key]);
+    }
+    catch (const std::exception& e)
+    {
+      RCLCPP_WARN(LOGGER, "Could not read plan from %s: %s", file_name_.c_str(), e.what());
+      return false;
+    }
+  }
+
+  if (entries.size() != count)
+  {
+    RCLCPP_WARN(LOGGER, "Ignoring truncated or corrupt plan cache %s", file_name_.c_str());
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_ = std::move(entries);
+  RCLCPP_INFO(LOGGER, "Loaded %zu plans from %s", entries_.size(), file_name_.c_str());
+  return true;
+}
+
+}  // namespace kmr_moveit2
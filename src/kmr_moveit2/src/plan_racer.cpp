@@ -0,0 +1,166 @@
+/* Author: Nina Marie Wahl
+   Desc: Runs the same planning request on several planning components in parallel
+*/
+
+#include <kmr_moveit2/plan_racer.hpp>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <rclcpp/rclcpp.hpp>
+
+static const rclcpp::Logger LOGGER = rclcpp::get_logger("plan_racer");
+
+namespace kmr_moveit2
+{
+// Shared between a race and its planning threads, which may outlive the race
+struct PlanRacer::Race
+{
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::size_t running = 0;
+  PlanRacer::PlanningComponent::PlanSolution best;
+  bool found = false;
+};
+
+PlanRacer::PlanRacer(const moveit::planning_interface::MoveItCppPtr& moveit_cpp, const std::string& group,
+                     std::size_t racers, Mode mode, std::chrono::duration<double> deadline)
+  : idle_(std::make_shared<Idle>()), mode_(mode), deadline_(deadline)
+{
+  const auto pipeline_names = moveit_cpp->getPlanningPipelineNames(group);
+  const std::vector<std::string> pipelines(pipeline_names.begin(), pipeline_names.end());
+  for (std::size_t i = 0; i < racers; ++i)
+  {
+    Racer racer;
+    racer.component = std::make_shared<PlanningComponent>(group, moveit_cpp);
+    if (!pipelines.empty())
+      racer.pipeline = pipelines[i % pipelines.size()];
+    racer.busy = std::make_shared<std::atomic<bool>>(false);
+    racers_.push_back(std::move(racer));
+  }
+  RCLCPP_INFO(LOGGER, "Racing %zu planners on %zu pipelines", racers, pipelines.size());
+}
+
+PlanRacer::~PlanRacer()
+{
+  if (anyRacerBusy())
+    RCLCPP_INFO(LOGGER, "Waiting for the planners that are still running");
+  for (auto& racer : racers_)
+    if (racer.thread.joinable())
+      racer.thread.join();
+}
+
+PlanRacer::Mode PlanRacer::modeFromString(const std::string& mode)
+{
+  return mode == "best" ? Mode::BEST : Mode::FIRST_SUCCESS;
+}
+
+bool PlanRacer::anyRacerIdle() const
+{
+  for (const auto& racer : racers_)
+    if (!racer.busy->load())
+      return true;
+  return false;
+}
+
+bool PlanRacer::anyRacerBusy() const
+{
+  for (const auto& racer : racers_)
+    if (racer.busy->load())
+      return true;
+  return false;
+}
+
+std::size_t PlanRacer::startRacers(const std::shared_ptr<Race>& race,
+                                   const std::function<void(PlanningComponent&)>& configure,
+                                   const PlanningComponent::PlanRequestParameters& parameters,
+                                   std::size_t max_racers)
+{
+  std::size_t started = 0;
+  for (auto& racer : racers_)
+  {
+    if (max_racers > 0 && started == max_racers)
+      break;
+    bool idle = false;
+    if (!racer.busy->compare_exchange_strong(idle, true))
+      continue;
+    // The thread of its last plan has already let go of the racer, so this does not block
+    if (racer.thread.joinable())
+      racer.thread.join();
+
+    configure(*racer.component);
+    PlanningComponent::PlanRequestParameters racer_parameters = parameters;
+    if (!racer.pipeline.empty())
+      racer_parameters.planning_pipeline = racer.pipeline;
+
+    {
+      std::lock_guard<std::mutex> lock(race->mutex);
+      ++race->running;
+    }
+    ++started;
+    const Mode mode = mode_;
+    racer.thread = std::thread([race, component = racer.component, busy = racer.busy, racer_parameters, mode,
+                                idle = idle_]() {
+      const auto solution = component->plan(racer_parameters);
+      {
+        std::lock_guard<std::mutex> lock(race->mutex);
+        --race->running;
+        if (solution &&
+            (!race->found ||
+             (mode == Mode::BEST && solution.trajectory->getDuration() < race->best.trajectory->getDuration())))
+        {
+          race->best = solution;
+          race->found = true;
+        }
+      }
+      {
+        std::lock_guard<std::mutex> lock(idle->mutex);
+        busy->store(false);
+      }
+      race->cv.notify_all();
+      idle->cv.notify_all();
+    });
+  }
+  return started;
+}
+
+PlanRacer::PlanningComponent::PlanSolution
+PlanRacer::plan(const std::function<void(PlanningComponent&)>& configure,
+                const PlanningComponent::PlanRequestParameters& parameters, std::size_t max_racers)
+{
+  auto race = std::make_shared<Race>();
+  race->best.error_code.val = moveit_msgs::msg::MoveItErrorCodes::PLANNING_FAILED;
+  const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::duration_cast<std::chrono::steady_clock::duration>(deadline_);
+
+  // Racers that lost an earlier race may all still be planning. The request waits for one of
+  // them instead of failing, as it would most likely have been solved.
+  while (startRacers(race, configure, parameters, max_racers) == 0)
+  {
+    RCLCPP_INFO(LOGGER, "All planners are still busy with an earlier request, waiting");
+    std::unique_lock<std::mutex> lock(idle_->mutex);
+    if (!idle_->cv.wait_until(lock, deadline, [this]() { return anyRacerIdle(); }))
+    {
+      RCLCPP_WARN(LOGGER, "No planner became free within %.2f s", deadline_.count());
+      race->best.error_code.val = moveit_msgs::msg::MoveItErrorCodes::TIMED_OUT;
+      return race->best;
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(race->mutex);
+  race->cv.wait_until(lock, deadline, [this, &race]() {
+    return race->running == 0 || (mode_ == Mode::FIRST_SUCCESS && race->found);
+  });
+
+  if (!race->found && race->running > 0)
+  {
+    RCLCPP_WARN(LOGGER, "No plan found within %.2f s", deadline_.count());
+    race->best.error_code.val = moveit_msgs::msg::MoveItErrorCodes::TIMED_OUT;
+  }
+  // Racers still planning finish in the background, and their solutions are dropped
+  return race->best;
+}
+
+}  // namespace kmr_moveit2
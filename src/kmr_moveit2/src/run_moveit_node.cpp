@@ -40,6 +40,14 @@
 */
 
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <thread>
 #include <rclcpp/rclcpp.hpp>
 #include <moveit/moveit_cpp/moveit_cpp.h>
@@ -56,6 +64,11 @@
 #include <moveit_msgs/msg/motion_plan_response.hpp>
 #include <std_msgs/msg/string.hpp>
 #include <kmr_msgs/action/plan_to_frame.hpp>
+#include <kmr_moveit2/plan_cache.hpp>
+#include <kmr_moveit2/plan_racer.hpp>
+#include <kmr_moveit2/scene_updater.hpp>
+#include <kmr_moveit2/trajectory_compression.hpp>
+#include <kmr_moveit2/trajectory_visualizer.hpp>
 #include "rclcpp_action/rclcpp_action.hpp"
 #include "iostream"
 
@@ -64,6 +77,8 @@ static const rclcpp::Logger LOGGER = rclcpp::get_logger("moveit_cpp_demo");
 class RunMoveIt
 {
 public:
+  using GoalHandle = rclcpp_action::ServerGoalHandle<kmr_msgs::action::PlanToFrame>;
+
   RunMoveIt(const rclcpp::Node::SharedPtr& node)
     : node_(node)
     , robot_state_publisher_(node_->create_publisher<moveit_msgs::msg::DisplayRobotState>("display_robot_state", 1))
@@ -77,15 +92,107 @@ public:
   {
   }
 
+  ~RunMoveIt()
+  {
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      shutting_down_ = true;
+    }
+    queue_cv_.notify_all();
+    for (auto& worker : workers_)
+      worker.join();
+    if (prefetch_worker_.joinable())
+      prefetch_worker_.join();
+    // Waits for the planners that lost a race and are still running
+    plan_racer_.reset();
+    if (plan_cache_)
+      plan_cache_->saveIfChanged();
+  }
+
   void init()
   {
     RCLCPP_INFO(LOGGER, "Initialize MoveItCpp");
     moveit_cpp_ = std::make_shared<moveit::planning_interface::MoveItCpp>(node_);
-    moveit_cpp_->getPlanningSceneMonitor()->setPlanningScenePublishingFrequency(100);
+
+    // The monitor publishes diffs of the scene, at most this many per second
+    double publishing_frequency;
+    node_->get_parameter_or("scene_updates.publishing_frequency", publishing_frequency, 10.0);
+    moveit_cpp_->getPlanningSceneMonitor()->setPlanningScenePublishingFrequency(publishing_frequency);
 
     RCLCPP_INFO(LOGGER, "Initialize PlanningComponent");
     arm = std::make_shared<moveit::planning_interface::PlanningComponent>("manipulator", moveit_cpp_);
 
+    node_->get_parameter_or("plan_cache.enabled", plan_cache_enabled_, true);
+    if (plan_cache_enabled_)
+    {
+      double bucket_size;
+      std::string file_name;
+      node_->get_parameter_or("plan_cache.bucket_size", bucket_size, 0.01);
+      node_->get_parameter_or("plan_cache.file", file_name, std::string(""));
+      if (file_name.empty())
+      {
+        const char* home = std::getenv("HOME");
+        file_name = std::string(home ? home : ".") + "/.ros/run_moveit_plan_cache.bin";
+      }
+      plan_cache_ = std::make_shared<kmr_moveit2::PlanCache>("manipulator", bucket_size, file_name);
+      plan_cache_->load();
+
+      // New plans are written out in batches, and once more on shutdown
+      double save_period;
+      node_->get_parameter_or("plan_cache.save_period", save_period, 30.0);
+      plan_cache_timer_ = node_->create_wall_timer(std::chrono::duration<double>(save_period),
+                                                   [cache = plan_cache_]() { cache->saveIfChanged(); });
+    }
+
+    node_->get_parameter_or("plan_racing.enabled", plan_racing_enabled_, false);
+    if (plan_racing_enabled_)
+    {
+      int racers;
+      std::string mode;
+      double deadline;
+      node_->get_parameter_or("plan_racing.racers", racers, 4);
+      node_->get_parameter_or("plan_racing.mode", mode, std::string("first"));
+      node_->get_parameter_or("plan_racing.deadline", deadline, 5.0);
+      plan_racer_ = std::make_shared<kmr_moveit2::PlanRacer>(
+          moveit_cpp_, "manipulator", racers, kmr_moveit2::PlanRacer::modeFromString(mode),
+          std::chrono::duration<double>(deadline));
+    }
+
+    bool scene_updates_enabled;
+    node_->get_parameter_or("scene_updates.enabled", scene_updates_enabled, true);
+    if (scene_updates_enabled)
+    {
+      double update_rate;
+      std::vector<double> object_size;
+      node_->get_parameter_or("scene_updates.rate", update_rate, 10.0);
+      node_->get_parameter_or("scene_updates.object_size", object_size, std::vector<double>{ 0.01, 0.03 });
+      scene_updater_ = std::make_shared<kmr_moveit2::SceneUpdater>(node_, moveit_cpp_->getPlanningSceneMonitor(),
+                                                                   update_rate, object_size);
+    }
+
+    node_->get_parameter_or("trajectory_compression.tolerance", compression_tolerance_, 0.0);
+
+    bool visualize_trajectory;
+    double visualization_rate;
+    node_->get_parameter_or("visualize_trajectory", visualize_trajectory, true);
+    node_->get_parameter_or("visualization_rate", visualization_rate, 10.0);
+    if (visualize_trajectory)
+      visualizer_ = std::make_shared<kmr_moveit2::TrajectoryVisualizer>(robot_state_publisher_, visualization_rate);
+
+    // Every worker has its own PlanningComponent, so that goals planned at the same time do not
+    // change the goal and start state of each other
+    int planning_workers;
+    node_->get_parameter_or("planning_workers", planning_workers, 2);
+    for (int i = 0; i < std::max(planning_workers, 1); ++i)
+    {
+      auto component = std::make_shared<moveit::planning_interface::PlanningComponent>("manipulator", moveit_cpp_);
+      workers_.emplace_back(&RunMoveIt::workerLoop, this, component, false);
+    }
+    // Goals planned ahead get a worker of their own, so a burst of them from the plan prefetcher
+    // never holds up the goals for the current state of the robot
+    auto prefetch_component = std::make_shared<moveit::planning_interface::PlanningComponent>("manipulator", moveit_cpp_);
+    prefetch_worker_ = std::thread(&RunMoveIt::workerLoop, this, prefetch_component, true);
+
     // A little delay before running the plan
     rclcpp::sleep_for(std::chrono::seconds(1));
 
@@ -99,59 +206,14 @@ public:
       std::bind(&RunMoveIt::handle_cancel, this,  std::placeholders::_1),
       std::bind(&RunMoveIt::handle_accepted, this,  std::placeholders::_1));
 
-    moveit_msgs::msg::CollisionObject collision_object;
-    collision_object.header.frame_id = "base_footprint";
-    collision_object.id = "box";
-
-
-    shape_msgs::msg::SolidPrimitive box;
-    box.type = box.BOX;
-    box.dimensions = { 0.05, 0.3, 0.1 };
-
-    geometry_msgs::msg::Pose box_pose;
-    box_pose.position.x = -0.05;
-    box_pose.position.y = 0.0;
-    box_pose.position.z = 1.0;
-
-    shape_msgs::msg::SolidPrimitive box2;
-    box2.type = box2.BOX;
-    box2.dimensions = { 0.3, 0.05, 0.1 };
-
-    geometry_msgs::msg::Pose box2_pose;
-    box2_pose.position.x = 0.0;
-    box2_pose.position.y = 0.15;
-    box2_pose.position.z = 1.0;
-
-    shape_msgs::msg::SolidPrimitive box3;
-    box3.type = box3.BOX;
-    box3.dimensions = { 0.05, 0.3, 0.1 };
-
-    geometry_msgs::msg::Pose box3_pose;
-    box3_pose.position.x = 0.0;
-    box3_pose.position.y = 0.40;
-    box3_pose.position.z = 1.0;
-
-    shape_msgs::msg::SolidPrimitive snus;
-    snus.type = snus.CYLINDER;
-    snus.dimensions = {0.01, 0.03};
-
-    // collision_object.primitives.push_back(box);
-    // collision_object.primitive_poses.push_back(box_pose);
-    // collision_object.primitives.push_back(box2);
-    // collision_object.primitive_poses.push_back(box2_pose);
-    //collision_object.primitives.push_back(box3);
-    //collision_object.primitive_poses.push_back(box3_pose);
-
     ::planning_interface::MotionPlanRequest req;
     moveit::core::RobotStatePtr start_state = moveit_cpp_->getCurrentState();
     start_state->update();
     moveit::core::robotStateToRobotStateMsg(*start_state, req.start_state);
 
-    // Add object to planning scene
     {  // Lock PlanningScene
       planning_scene_monitor::LockedPlanningSceneRW scene(moveit_cpp_->getPlanningSceneMonitor());
       scene->setCurrentState(*start_state);
-      //scene->processCollisionObjectMsg(collision_object);
     }  // Unlock PlanningScene
   
 
@@ -175,27 +237,40 @@ public:
   }
 
 private:
+  // Shown in the background, so the trajectory is sent for execution without waiting for it
   void visualizeTrajectory(const robot_trajectory::RobotTrajectory& trajectory)
   {
-    moveit_msgs::msg::DisplayRobotState waypoint;
-    const auto start_time = node_->now();
-    for (size_t i = 0; i < trajectory.getWayPointCount(); ++i)
-    {
-      moveit::core::robotStateToRobotStateMsg(trajectory.getWayPoint(i), waypoint.state);
-      const auto waypoint_time =
-          start_time + rclcpp::Duration::from_seconds(trajectory.getWayPointDurationFromStart(i));
-      const auto now = node_->now();
-      if (waypoint_time > now)
-        rclcpp::sleep_for(std::chrono::nanoseconds((waypoint_time - now).nanoseconds()));
-
-      robot_state_publisher_->publish(waypoint);
-    }
+    if (visualizer_)
+      visualizer_->visualize(trajectory);
+  }
+
+  // The cached path is moved to start exactly at start_state, which is in the same bucket as
+  // the state it was planned from, and checked for collisions in the current planning scene.
+  bool isCachedPathValid(const moveit::core::RobotState& start_state, trajectory_msgs::msg::JointTrajectory& path)
+  {
+    if (path.points.empty())
+      return false;
+
+    const moveit::core::JointModelGroup* group = start_state.getJointModelGroup("manipulator");
+    if (path.joint_names != group->getActiveJointModelNames())
+      return false;
+    start_state.copyJointGroupPositions(group, path.points.front().positions);
+
+    moveit_msgs::msg::RobotTrajectory trajectory_msg;
+    trajectory_msg.joint_trajectory = path;
+    robot_trajectory::RobotTrajectory trajectory(moveit_cpp_->getRobotModel(), "manipulator");
+    trajectory.setRobotTrajectoryMsg(start_state, trajectory_msg);
+
+    planning_scene_monitor::LockedPlanningSceneRO scene(moveit_cpp_->getPlanningSceneMonitor());
+    return scene->isPathValid(trajectory, "manipulator");
   }
 
   void frame_callback(std_msgs::msg::String::SharedPtr msg){
-    RCLCPP_INFO(LOGGER, "Frame Received: %s", msg->data);
-    arm->setGoal(msg->data);
-    move();
+    RCLCPP_INFO(LOGGER, "Frame Received: %s", msg->data.c_str());
+    move([&msg](moveit::planning_interface::PlanningComponent& component) {
+      component.setGoal(msg->data);
+      component.setStartStateToCurrentState();
+    });
   }
 
   void goalpose_callback(geometry_msgs::msg::PoseStamped::SharedPtr msg)
@@ -204,31 +279,48 @@ private:
     std::cout << msg->pose.position.x << std::endl;
     std::cout << msg->pose.position.y << std::endl;
     std::cout << msg->pose.position.z << std::endl;
-    arm->setGoal(*msg,"gripper_middle_point");
-    move();
-    
-  }
+    move([&msg](moveit::planning_interface::PlanningComponent& component) {
+      component.setGoal(*msg, "gripper_middle_point");
+      component.setStartStateToCurrentState();
+    });
 
-  void move(){
-    RCLCPP_INFO(LOGGER, "Plan to goal");
+  }
 
-    default_parameters.planning_attempts = 1;
-    default_parameters.planning_time = 5.0;
-    default_parameters.max_velocity_scaling_factor = 1.0;
-    default_parameters.max_acceleration_scaling_factor = 1.0;
+  // configure sets the goal and the start state of the planning component. With plan racing
+  // enabled it is applied to every racer (at most max_racers of them, 0 for all), otherwise only
+  // to component.
+  moveit::planning_interface::PlanningComponent::PlanSolution
+  plan(moveit::planning_interface::PlanningComponent& component,
+       const std::function<void(moveit::planning_interface::PlanningComponent&)>& configure,
+       std::size_t max_racers = 0)
+  {
+    moveit::planning_interface::PlanningComponent::PlanRequestParameters parameters;
+    parameters.planning_attempts = 1;
+    parameters.planning_time = 5.0;
+    parameters.max_velocity_scaling_factor = 1.0;
+    parameters.max_acceleration_scaling_factor = 1.0;
 
-    planning_pipeline_names = moveit_cpp_->getPlanningPipelineNames("manipulator");
+    const auto planning_pipeline_names = moveit_cpp_->getPlanningPipelineNames("manipulator");
     if (!planning_pipeline_names.empty())
-      default_parameters.planning_pipeline = *planning_pipeline_names.begin();
-    const auto plan_solution = arm->plan(default_parameters);
+      parameters.planning_pipeline = *planning_pipeline_names.begin();
+
+    if (plan_racer_)
+      return plan_racer_->plan(configure, parameters, max_racers);
+    configure(component);
+    return component.plan(parameters);
+  }
+
+  void move(const std::function<void(moveit::planning_interface::PlanningComponent&)>& configure){
+    RCLCPP_INFO(LOGGER, "Plan to goal");
+
+    const auto plan_solution = plan(*arm, configure);
     if (plan_solution)
     {
-      visualizeTrajectory(*plan_solution.trajectory);
-
       RCLCPP_INFO(LOGGER, "Sending the trajectory for execution");
       moveit_msgs::msg::RobotTrajectory robot_trajectory;
       plan_solution.trajectory->getRobotTrajectoryMsg(robot_trajectory);
       trajectory_publisher_->publish(robot_trajectory.joint_trajectory);
+      visualizeTrajectory(*plan_solution.trajectory);
     }
   }
 
@@ -246,48 +338,192 @@ private:
     (void)goal_handle;
     return rclcpp_action::CancelResponse::ACCEPT;
   }
-  void handle_accepted(const std::shared_ptr<rclcpp_action::ServerGoalHandle<kmr_msgs::action::PlanToFrame>> goal_handle)
+  // A goal for the current state of the robot makes all such goals received before it obsolete,
+  // so only the latest one is planned. Goals planned ahead from a given start state are queued
+  // separately, as the plan prefetcher of the behavior tree asks for several of them at once.
+  // They are not preempted while queued, but the one being planned is preempted by any new goal
+  // for the current state, which is needed first.
+  struct QueuedGoal
+  {
+    std::shared_ptr<GoalHandle> goal_handle;
+    uint64_t generation;  // 0 if the goal can not be preempted
+  };
+
+  void handle_accepted(const std::shared_ptr<GoalHandle> goal_handle)
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    const bool preemptable = goal_handle->get_goal()->start_state.name.empty();
+    if (preemptable)
+    {
+      ++live_generation_;
+      for (auto it = goal_queue_.begin(); it != goal_queue_.end();)
+      {
+        if (isPreempted(*it))
+        {
+          abortPreempted(it->goal_handle);
+          it = goal_queue_.erase(it);
+        }
+        else
+          ++it;
+      }
+      goal_queue_.push_back({ goal_handle, live_generation_.load() });
+    }
+    else
+      prefetch_queue_.push_back({ goal_handle, 0 });
+    // The foreground and prefetch workers wait on the same condition variable
+    queue_cv_.notify_all();
+  }
+
+  bool isPreempted(const QueuedGoal& queued) const
+  {
+    return queued.generation != 0 && queued.generation != live_generation_;
+  }
+
+  void abortPreempted(const std::shared_ptr<GoalHandle>& goal_handle)
+  {
+    auto result = std::make_shared<kmr_msgs::action::PlanToFrame::Result>();
+    result->success = false;
+    goal_handle->abort(result);
+    RCLCPP_INFO(LOGGER, "Goal Preempted");
+  }
+
+  // Ends a goal which has been canceled, or made obsolete by a newer goal. Returns true if the
+  // goal was ended.
+  bool endIfStale(const QueuedGoal& queued, const std::shared_ptr<kmr_msgs::action::PlanToFrame::Result>& result)
+  {
+    if (queued.goal_handle->is_canceling())
+    {
+      result->success = false;
+      queued.goal_handle->canceled(result);
+      RCLCPP_INFO(LOGGER, "Goal Canceled");
+      return true;
+    }
+    if (isPreempted(queued))
+    {
+      abortPreempted(queued.goal_handle);
+      return true;
+    }
+    return false;
+  }
+
+  void workerLoop(std::shared_ptr<moveit::planning_interface::PlanningComponent> component, bool prefetch)
   {
-    std::thread{std::bind(&RunMoveIt::execute, this, std::placeholders::_1), goal_handle}.detach();
+    auto& queue = prefetch ? prefetch_queue_ : goal_queue_;
+    while (true)
+    {
+      QueuedGoal queued;
+      {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        queue_cv_.wait(lock, [this, &queue]() { return shutting_down_ || !queue.empty(); });
+        if (shutting_down_)
+          return;
+        queued = queue.front();
+        queue.pop_front();
+        // From now on the goal is obsolete as soon as a goal for the current state comes in
+        if (prefetch)
+          queued.generation = live_generation_;
+      }
+      execute(queued, *component);
+    }
   }
 
-   void execute(const std::shared_ptr<rclcpp_action::ServerGoalHandle<kmr_msgs::action::PlanToFrame>> goal_handle)
+  void execute(const QueuedGoal& queued, moveit::planning_interface::PlanningComponent& component)
   {
+    const auto& goal_handle = queued.goal_handle;
     RCLCPP_INFO(LOGGER, "Executing goal");
     rclcpp::Rate loop_rate(1);
     const auto goal = goal_handle->get_goal();
     
     auto result = std::make_shared<kmr_msgs::action::PlanToFrame::Result>();
 
+    // The goal may have been canceled or preempted while it waited in the queue
+    if (endIfStale(queued, result))
+      return;
+
     if (goal->frame == "object"){
+        // The grasp would be in collision with the detected object
+        if (scene_updater_)
+          scene_updater_->remove(kmr_moveit2::SceneUpdater::DETECTED_OBJECT);
         RCLCPP_INFO(LOGGER, "GoalPose Received:");
         std::cout << goal->pose.pose.position.x << std::endl;
         std::cout << goal->pose.pose.position.y << std::endl;
         std::cout << goal->pose.pose.position.z << std::endl;
         std::cout << goal->pose.header.frame_id << std::endl;
         pose_publisher_->publish(goal->pose);
-        arm->setGoal(goal->pose,"gripper_middle_point");
     }else{
         RCLCPP_INFO(LOGGER, "GoalFrame Received: %s", (goal->frame).c_str());
-        arm->setGoal(goal->frame);
     }
 
-    default_parameters.planning_attempts = 1;
-    default_parameters.planning_time = 5.0;
-    default_parameters.max_velocity_scaling_factor = 1.0;
-    default_parameters.max_acceleration_scaling_factor = 1.0;
+    // Plans requested ahead of time start where the trajectory currently executed ends
+    moveit::core::RobotState start_state(*moveit_cpp_->getCurrentState());
+    const bool planned_ahead = !goal->start_state.name.empty();
+    if (planned_ahead){
+        start_state.setVariablePositions(goal->start_state.name, goal->start_state.position);
+        start_state.update();
+    }
 
-    planning_pipeline_names = moveit_cpp_->getPlanningPipelineNames("manipulator");
-    if (!planning_pipeline_names.empty())
-      default_parameters.planning_pipeline = *planning_pipeline_names.begin();
-    const auto plan_solution = arm->plan(default_parameters);
+    auto configure = [&goal, &start_state, planned_ahead](moveit::planning_interface::PlanningComponent& component) {
+      if (goal->frame == "object")
+        component.setGoal(goal->pose, "gripper_middle_point");
+      else
+        component.setGoal(goal->frame);
+      if (planned_ahead)
+        component.setStartState(start_state);
+      else
+        component.setStartStateToCurrentState();
+    };
+
+    // Plans between the named frames are cached, those to detected objects are not
+    const bool use_cache = plan_cache_ && goal->frame != "object";
+    std::size_t scene_hash = 0;
+    if (use_cache)
+    {
+      {
+        planning_scene_monitor::LockedPlanningSceneRO scene(moveit_cpp_->getPlanningSceneMonitor());
+        scene_hash = kmr_moveit2::PlanCache::hashScene(*scene);
+      }
+      trajectory_msgs::msg::JointTrajectory cached_path;
+      if (plan_cache_->lookup(start_state, goal->frame, scene_hash, cached_path))
+      {
+        if (isCachedPathValid(start_state, cached_path))
+        {
+          RCLCPP_INFO(LOGGER, "Using cached plan to %s", (goal->frame).c_str());
+          if (endIfStale(queued, result))
+            return;
+          result->success = true;
+          result->path = kmr_moveit2::compressTrajectory(cached_path, compression_tolerance_);
+          goal_handle->succeed(result);
+          RCLCPP_INFO(LOGGER, "Goal Succeeded");
+          // Plans made ahead are only returned to the client, which sends them when the current
+          // motion is done
+          if (!planned_ahead)
+            trajectory_publisher_->publish(result->path);
+          return;
+        }
+        RCLCPP_INFO(LOGGER, "Cached plan to %s is in collision, planning again", (goal->frame).c_str());
+        plan_cache_->erase(start_state, goal->frame, scene_hash);
+      }
+    }
+
+    // Planning runs in the background, so that cancel requests and newer goals are answered
+    // while the planner is still busy. The planner can not be interrupted, so the worker still
+    // waits for it to finish before it takes the next goal.
+    // Goals planned ahead race on a single planner, leaving the others to the current goals
+    auto planning = std::async(std::launch::async, [this, &component, &configure, planned_ahead]() {
+      return plan(component, configure, planned_ahead ? 1 : 0);
+    });
+    while (planning.wait_for(std::chrono::milliseconds(50)) != std::future_status::ready)
+    {
+      if (goal_handle->is_canceling() || isPreempted(queued))
+        break;
+    }
 
     // Check if there is a cancel request
-    if (goal_handle->is_canceling()) {
-      goal_handle->canceled(result);
-      RCLCPP_INFO(LOGGER, "Goal Canceled");
+    if (endIfStale(queued, result)) {
+      planning.wait();
       return;
     }
+    const auto plan_solution = planning.get();
 
     if (plan_solution)
     {
@@ -295,15 +531,27 @@ private:
       if (rclcpp::ok()) {
         moveit_msgs::msg::RobotTrajectory robot_trajectory;
         plan_solution.trajectory->getRobotTrajectoryMsg(robot_trajectory);
+        // Cached also if the goal has become obsolete, the plan itself is still valid
+        if (use_cache)
+          plan_cache_->insert(start_state, goal->frame, scene_hash, robot_trajectory.joint_trajectory);
         result->success = true;
-        result->path = robot_trajectory.joint_trajectory;
+        // The cache keeps the full trajectory, so cached plans are checked for collisions at
+        // every waypoint
+        result->path = kmr_moveit2::compressTrajectory(robot_trajectory.joint_trajectory, compression_tolerance_);
+        RCLCPP_INFO(LOGGER, "Trajectory with %zu waypoints, %zu sent", robot_trajectory.joint_trajectory.points.size(),
+                    result->path.points.size());
+        // A newer goal may have come in while the trajectory was prepared, this one is then
+        // not executed
+        if (endIfStale(queued, result))
+          return;
         goal_handle->succeed(result);
         RCLCPP_INFO(LOGGER, "Goal Succeeded");
-        visualizeTrajectory(*plan_solution.trajectory);
-        RCLCPP_INFO(LOGGER, "Sending the trajectory for execution");
-        moveit_msgs::msg::RobotTrajectory robot_trajectory2;
-        plan_solution.trajectory->getRobotTrajectoryMsg(robot_trajectory2);
-        trajectory_publisher_->publish(robot_trajectory2.joint_trajectory);
+        if (!planned_ahead)
+        {
+          RCLCPP_INFO(LOGGER, "Sending the trajectory for execution");
+          trajectory_publisher_->publish(result->path);
+          visualizeTrajectory(*plan_solution.trajectory);
+        }
         }
 
     }
@@ -324,9 +572,25 @@ private:
   rclcpp::Subscription<std_msgs::msg::String>::SharedPtr frame_subscriber_;
   moveit::planning_interface::MoveItCppPtr moveit_cpp_;
   std::shared_ptr<moveit::planning_interface::PlanningComponent> arm;
-  std::set<std::string> planning_pipeline_names;
-  moveit::planning_interface::PlanningComponent::PlanRequestParameters default_parameters;
   rclcpp_action::Server<kmr_msgs::action::PlanToFrame>::SharedPtr action_server_;
+  bool plan_cache_enabled_;
+  std::shared_ptr<kmr_moveit2::PlanCache> plan_cache_;
+  rclcpp::TimerBase::SharedPtr plan_cache_timer_;
+  bool plan_racing_enabled_;
+  std::shared_ptr<kmr_moveit2::PlanRacer> plan_racer_;
+  std::shared_ptr<kmr_moveit2::TrajectoryVisualizer> visualizer_;
+  std::shared_ptr<kmr_moveit2::SceneUpdater> scene_updater_;
+  double compression_tolerance_ = 0.0;
+
+  std::vector<std::thread> workers_;
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cv_;
+  std::deque<QueuedGoal> goal_queue_;
+  std::thread prefetch_worker_;
+  std::deque<QueuedGoal> prefetch_queue_;
+  // Starts at 1, as generation 0 marks goals that can not be preempted
+  std::atomic<uint64_t> live_generation_{ 1 };
+  bool shutting_down_ = false;
 };
 
 
@@ -0,0 +1,120 @@
+/* Author: Nina Marie Wahl
+   Desc: Keeps detected objects and occupied carry areas in the planning scene
+*/
+
+#include <kmr_moveit2/scene_updater.hpp>
+
+#include <algorithm>
+#include <chrono>
+
+#include <shape_msgs/msg/solid_primitive.hpp>
+#include <tf2_eigen/tf2_eigen.h>
+
+namespace kmr_moveit2
+{
+constexpr const char* SceneUpdater::DETECTED_OBJECT;
+
+static const rclcpp::Logger LOGGER = rclcpp::get_logger("scene_updater");
+
+SceneUpdater::SceneUpdater(const rclcpp::Node::SharedPtr& node,
+                           const planning_scene_monitor::PlanningSceneMonitorPtr& monitor, double rate,
+                           const std::vector<double>& object_size)
+  : monitor_(monitor), object_size_(object_size)
+{
+  detection_subscriber_ = node->create_subscription<geometry_msgs::msg::PoseStamped>(
+      "/moveit/detected_object", 10, std::bind(&SceneUpdater::detectionCallback, this, std::placeholders::_1));
+  // Transient local, so the carry areas filled before this node started are known as well
+  carry_area_subscriber_ = node->create_subscription<std_msgs::msg::String>(
+      "/moveit/carry_area_occupied", rclcpp::QoS(10).transient_local(),
+      std::bind(&SceneUpdater::carryAreaCallback, this, std::placeholders::_1));
+  timer_ = node->create_wall_timer(std::chrono::duration<double>(1.0 / std::max(rate, 0.1)),
+                                   std::bind(&SceneUpdater::update, this));
+}
+
+void SceneUpdater::remove(const std::string& id)
+{
+  moveit_msgs::msg::CollisionObject object;
+  object.id = id;
+  object.operation = object.REMOVE;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_objects_.erase(id);
+  }
+  {
+    planning_scene_monitor::LockedPlanningSceneRW scene(monitor_);
+    if (!scene->getWorld()->hasObject(id))
+      return;
+    scene->processCollisionObjectMsg(object);
+  }
+  monitor_->triggerSceneUpdateEvent(planning_scene_monitor::PlanningSceneMonitor::UPDATE_GEOMETRY);
+}
+
+void SceneUpdater::detectionCallback(const geometry_msgs::msg::PoseStamped::SharedPtr msg)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_objects_[DETECTED_OBJECT] = makeObject(DETECTED_OBJECT, *msg);
+}
+
+void SceneUpdater::carryAreaCallback(const std_msgs::msg::String::SharedPtr msg)
+{
+  RCLCPP_INFO(LOGGER, "Object placed in %s", msg->data.c_str());
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_carry_areas_.insert(msg->data);
+}
+
+void SceneUpdater::update()
+{
+  std::map<std::string, moveit_msgs::msg::CollisionObject> objects;
+  std::set<std::string> carry_areas;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    objects.swap(pending_objects_);
+    carry_areas.swap(pending_carry_areas_);
+  }
+  if (objects.empty() && carry_areas.empty())
+    return;
+
+  {
+    planning_scene_monitor::LockedPlanningSceneRW scene(monitor_);
+    for (const auto& carry_area : carry_areas)
+    {
+      const moveit::core::RobotState& state = scene->getCurrentState();
+      geometry_msgs::msg::PoseStamped pose;
+      pose.header.frame_id = scene->getPlanningFrame();
+      pose.pose = tf2::toMsg(state.getGlobalLinkTransform("gripper_middle_point"));
+      objects[carry_area] = makeObject(carry_area, pose);
+    }
+    for (const auto& object : objects)
+      scene->processCollisionObjectMsg(object.second);
+
+    // The gripper is still around the object it just released, and is allowed to touch it so
+    // that the next plan does not start in collision
+    const moveit::core::JointModelGroup* gripper = scene->getRobotModel()->getJointModelGroup("gripper");
+    if (gripper)
+    {
+      for (const auto& carry_area : carry_areas)
+        scene->getAllowedCollisionMatrixNonConst().setEntry(
+            carry_area, gripper->getLinkModelNamesWithCollisionGeometry(), true);
+    }
+  }
+  monitor_->triggerSceneUpdateEvent(planning_scene_monitor::PlanningSceneMonitor::UPDATE_GEOMETRY);
+}
+
+moveit_msgs::msg::CollisionObject SceneUpdater::makeObject(const std::string& id,
+                                                           const geometry_msgs::msg::PoseStamped& pose) const
+{
+  moveit_msgs::msg::CollisionObject object;
+  object.header = pose.header;
+  object.id = id;
+  // Replaces the object if it is already in the scene
+  object.operation = object.ADD;
+
+  shape_msgs::msg::SolidPrimitive cylinder;
+  cylinder.type = cylinder.CYLINDER;
+  cylinder.dimensions = object_size_;
+  object.primitives.push_back(cylinder);
+  object.primitive_poses.push_back(pose.pose);
+  return object;
+}
+
+}  // namespace kmr_moveit2
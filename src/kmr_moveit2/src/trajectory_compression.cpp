@@ -0,0 +1,89 @@
+/* Author: Nina Marie Wahl
+   Desc: Removes the waypoints of planned trajectories that the controller can interpolate
+*/
+
+#include <kmr_moveit2/trajectory_compression.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include <rclcpp/duration.hpp>
+
+namespace kmr_moveit2
+{
+namespace
+{
+double seconds(const trajectory_msgs::msg::JointTrajectoryPoint& point)
+{
+  return rclcpp::Duration(point.time_from_start).seconds();
+}
+
+// Largest joint distance of point from the interpolation between from and to
+double deviation(const trajectory_msgs::msg::JointTrajectoryPoint& from,
+                 const trajectory_msgs::msg::JointTrajectoryPoint& to,
+                 const trajectory_msgs::msg::JointTrajectoryPoint& point, double fraction_by_index)
+{
+  const double duration = seconds(to) - seconds(from);
+  const double fraction = duration > 0.0 ? (seconds(point) - seconds(from)) / duration : fraction_by_index;
+  double max_deviation = 0.0;
+  for (std::size_t j = 0; j < point.positions.size(); ++j)
+  {
+    const double interpolated = from.positions[j] + fraction * (to.positions[j] - from.positions[j]);
+    max_deviation = std::max(max_deviation, std::abs(point.positions[j] - interpolated));
+  }
+  return max_deviation;
+}
+}  // namespace
+
+trajectory_msgs::msg::JointTrajectory compressTrajectory(const trajectory_msgs::msg::JointTrajectory& trajectory,
+                                                         double tolerance)
+{
+  const auto& points = trajectory.points;
+  if (tolerance <= 0.0 || points.size() < 3)
+    return trajectory;
+
+  // Ramer-Douglas-Peucker: a span is split at its worst waypoint until all waypoints are close
+  // enough to the interpolation across the span
+  std::vector<bool> keep(points.size(), false);
+  keep.front() = true;
+  keep.back() = true;
+  std::vector<std::pair<std::size_t, std::size_t>> spans = { { 0, points.size() - 1 } };
+  while (!spans.empty())
+  {
+    const auto span = spans.back();
+    spans.pop_back();
+
+    std::size_t worst = span.first;
+    double worst_deviation = tolerance;
+    for (std::size_t i = span.first + 1; i < span.second; ++i)
+    {
+      const double fraction = static_cast<double>(i - span.first) / (span.second - span.first);
+      const double d = deviation(points[span.first], points[span.second], points[i], fraction);
+      if (d > worst_deviation)
+      {
+        worst = i;
+        worst_deviation = d;
+      }
+    }
+    if (worst != span.first)
+    {
+      keep[worst] = true;
+      spans.emplace_back(span.first, worst);
+      spans.emplace_back(worst, span.second);
+    }
+  }
+
+  trajectory_msgs::msg::JointTrajectory compressed;
+  compressed.header = trajectory.header;
+  compressed.joint_names = trajectory.joint_names;
+  for (std::size_t i = 0; i < points.size(); ++i)
+  {
+    if (keep[i])
+      compressed.points.push_back(points[i]);
+  }
+  return compressed;
+}
+
+}  // namespace kmr_moveit2
@@ -0,0 +1,76 @@
+/* Author: Nina Marie Wahl
+   Desc: Replays planned trajectories as robot states for RViz in the background
+*/
+
+#include <kmr_moveit2/trajectory_visualizer.hpp>
+
+#include <algorithm>
+
+#include <moveit/robot_state/conversions.h>
+
+namespace kmr_moveit2
+{
+TrajectoryVisualizer::TrajectoryVisualizer(
+    const rclcpp::Publisher<moveit_msgs::msg::DisplayRobotState>::SharedPtr& publisher, double rate)
+  : publisher_(publisher), period_(1.0 / std::max(rate, 1.0))
+{
+  thread_ = std::thread(&TrajectoryVisualizer::run, this);
+}
+
+TrajectoryVisualizer::~TrajectoryVisualizer()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutting_down_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+void TrajectoryVisualizer::visualize(const robot_trajectory::RobotTrajectory& trajectory)
+{
+  if (trajectory.empty())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    next_trajectory_ = std::make_shared<robot_trajectory::RobotTrajectory>(trajectory);
+  }
+  cv_.notify_all();
+}
+
+void TrajectoryVisualizer::run()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true)
+  {
+    cv_.wait(lock, [this]() { return shutting_down_ || next_trajectory_; });
+    if (shutting_down_)
+      return;
+
+    const auto trajectory = next_trajectory_;
+    next_trajectory_.reset();
+    auto state = std::make_shared<moveit::core::RobotState>(trajectory->getFirstWayPoint());
+    const double duration = trajectory->getDuration();
+    const auto start_time = std::chrono::steady_clock::now();
+
+    moveit_msgs::msg::DisplayRobotState waypoint;
+    while (true)
+    {
+      const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+      trajectory->getStateAtDurationFromStart(std::min(elapsed, duration), state);
+      moveit::core::robotStateToRobotStateMsg(*state, waypoint.state);
+
+      lock.unlock();
+      publisher_->publish(waypoint);
+      lock.lock();
+
+      if (elapsed >= duration)
+        break;
+      // Wake up early when there is a new trajectory to show instead
+      if (cv_.wait_for(lock, period_, [this]() { return shutting_down_ || next_trajectory_; }))
+        break;
+    }
+  }
+}
+
+}  // namespace kmr_moveit2
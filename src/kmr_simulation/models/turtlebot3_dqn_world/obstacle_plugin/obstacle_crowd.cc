@@ -0,0 +1,273 @@
+// Copyright 2019 Nina Marie Wahl and Charlotte Heggem.
+// Copyright 2019 Norwegian University of Science and Technology.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// World plugin moving any number of cylinder obstacles in one update loop, for benchmarking
+// navigation with a given number of dynamic obstacles. The obstacles are read from a YAML
+// file, generated from a seed, or both:
+//
+// <plugin name="obstacle_crowd" filename="libobstacle_crowd.so">
+//   <spec_file>crowd.yaml</spec_file>
+//   <random>
+//     <count>100</count>
+//     <seed>1</seed>
+//     <min>-5 -5</min>
+//     <max>5 5</max>
+//     <waypoints>4</waypoints>
+//     <speed>0.2 0.6</speed>
+//     <radius>0.12</radius>
+//   </random>
+//   <update_rate>50</update_rate>
+// </plugin>
+//
+// with the YAML file
+//
+// obstacles:
+//   - radius: 0.12
+//     height: 0.25
+//     speed: 0.3
+//     waypoints: [[0.0, 0.0], [-3.5, -1.0], [-3.7, -3.0]]
+//
+// Every obstacle drives around its closed path of waypoints at constant speed. The poses only
+// depend on the simulation time, so a run is repeated exactly with the same spec and seed,
+// also after a reset of the world.
+
+#include <yaml-cpp/yaml.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <ignition/math.hh>
+#include <gazebo/common/common.hh>
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+
+namespace gazebo
+{
+
+struct CrowdObstacle
+{
+  std::string name;
+  double radius{0.12};
+  double height{0.25};
+  double speed{0.0};
+  // Distance along the path at time 0
+  double offset{0.0};
+  std::vector<ignition::math::Vector2d> waypoints;
+  // Distance along the path to each waypoint, with the length of the closed path at the end
+  std::vector<double> distances;
+  physics::ModelPtr model;
+
+  void computeDistances()
+  {
+    distances.assign(1, 0.0);
+    for (size_t i = 0; i < waypoints.size(); ++i) {
+      const auto & next = waypoints[(i + 1) % waypoints.size()];
+      distances.push_back(distances.back() + waypoints[i].Distance(next));
+    }
+  }
+
+  ignition::math::Pose3d poseAt(double time) const
+  {
+    const double length = distances.back();
+    if (waypoints.size() < 2 || length <= 0.0) {
+      return ignition::math::Pose3d(waypoints[0].X(), waypoints[0].Y(), height / 2, 0, 0, 0);
+    }
+    const double s = std::fmod(offset + speed * time, length);
+    const size_t i =
+      std::upper_bound(distances.begin(), distances.end(), s) - distances.begin() - 1;
+    const auto & from = waypoints[i];
+    const auto & to = waypoints[(i + 1) % waypoints.size()];
+    const double segment = distances[i + 1] - distances[i];
+    const auto position = from + (to - from) * ((s - distances[i]) / segment);
+    const double yaw = std::atan2(to.Y() - from.Y(), to.X() - from.X());
+    return ignition::math::Pose3d(position.X(), position.Y(), height / 2, 0, 0, yaw);
+  }
+};
+
+class ObstacleCrowd : public WorldPlugin
+{
+public:
+  void Load(physics::WorldPtr world, sdf::ElementPtr sdf) override
+  {
+    world_ = world;
+
+    if (sdf->HasElement("spec_file")) {
+      loadSpecFile(sdf->Get<std::string>("spec_file"));
+    }
+    if (sdf->HasElement("random")) {
+      generate(sdf->GetElement("random"));
+    }
+    if (sdf->HasElement("update_rate")) {
+      const double rate = sdf->Get<double>("update_rate");
+      update_period_ = rate > 0.0 ? 1.0 / rate : 0.0;
+    }
+
+    for (auto & obstacle : obstacles_) {
+      obstacle.computeDistances();
+      world_->InsertModelString(modelString(obstacle));
+    }
+    gzmsg << "ObstacleCrowd: " << obstacles_.size() << " obstacles" << std::endl;
+
+    update_connection_ = event::Events::ConnectWorldUpdateBegin(
+      std::bind(&ObstacleCrowd::OnUpdate, this, std::placeholders::_1));
+  }
+
+private:
+  void loadSpecFile(const std::string & filename)
+  {
+    std::string path = common::SystemPaths::Instance()->FindFile(filename);
+    if (path.empty()) {
+      gzerr << "ObstacleCrowd: Could not find " << filename << std::endl;
+      return;
+    }
+    try {
+      const YAML::Node spec = YAML::LoadFile(path);
+      for (const auto & entry : spec["obstacles"]) {
+        CrowdObstacle obstacle;
+        obstacle.name = "crowd_obstacle_" + std::to_string(obstacles_.size());
+        obstacle.radius = entry["radius"].as<double>(obstacle.radius);
+        obstacle.height = entry["height"].as<double>(obstacle.height);
+        obstacle.speed = entry["speed"].as<double>(obstacle.speed);
+        for (const auto & waypoint : entry["waypoints"]) {
+          obstacle.waypoints.emplace_back(waypoint[0].as<double>(), waypoint[1].as<double>());
+        }
+        if (obstacle.waypoints.empty()) {
+          gzerr << "ObstacleCrowd: Obstacle without waypoints in " << path << std::endl;
+          continue;
+        }
+        obstacles_.push_back(obstacle);
+      }
+    } catch (const YAML::Exception & e) {
+      gzerr << "ObstacleCrowd: Failed to read " << path << ": " << e.what() << std::endl;
+    }
+  }
+
+  void generate(const sdf::ElementPtr & random)
+  {
+    const int count = random->Get<int>("count", 10).first;
+    const auto seed = random->Get<unsigned int>("seed", 0).first;
+    const auto min = random->Get<ignition::math::Vector2d>(
+      "min", ignition::math::Vector2d(-5, -5)).first;
+    const auto max = random->Get<ignition::math::Vector2d>(
+      "max", ignition::math::Vector2d(5, 5)).first;
+    const int waypoints = random->Get<int>("waypoints", 4).first;
+    const auto speed = random->Get<ignition::math::Vector2d>(
+      "speed", ignition::math::Vector2d(0.2, 0.6)).first;
+    const double radius = random->Get<double>("radius", 0.12).first;
+
+    // The distributions of the standard library differ between implementations, so the
+    // numbers are scaled here to get the same obstacles everywhere from the same seed
+    std::mt19937 generator(seed);
+    auto uniform = [&generator](double low, double high) {
+        return low + (high - low) * (generator() / 4294967296.0);
+      };
+
+    for (int i = 0; i < count; ++i) {
+      CrowdObstacle obstacle;
+      obstacle.name = "crowd_obstacle_" + std::to_string(obstacles_.size());
+      obstacle.radius = radius;
+      obstacle.speed = uniform(speed.X(), speed.Y());
+      for (int j = 0; j < std::max(waypoints, 1); ++j) {
+        // Separate statements, as the order of evaluating function arguments is unspecified
+        const double x = uniform(min.X(), max.X());
+        const double y = uniform(min.Y(), max.Y());
+        obstacle.waypoints.emplace_back(x, y);
+      }
+      // Starts somewhere along the path, or all obstacles would leave their first waypoint
+      // together
+      obstacle.offset = uniform(0.0, 1.0) * 100.0;
+      obstacles_.push_back(obstacle);
+    }
+    gzmsg << "ObstacleCrowd: Generated " << count << " obstacles with seed " << seed <<
+      std::endl;
+  }
+
+  // Kinematic cylinder without gravity, which is moved by setting its pose
+  std::string modelString(const CrowdObstacle & obstacle) const
+  {
+    const auto pose = obstacle.poseAt(0.0);
+    std::ostringstream geometry;
+    geometry << "<geometry><cylinder><radius>" << obstacle.radius << "</radius><length>" <<
+      obstacle.height << "</length></cylinder></geometry>";
+    std::ostringstream model;
+    model << "<sdf version='1.6'><model name='" << obstacle.name << "'>" <<
+      "<pose>" << pose.Pos().X() << " " << pose.Pos().Y() << " " << pose.Pos().Z() <<
+      " 0 0 " << pose.Rot().Yaw() << "</pose>" <<
+      "<link name='link'><kinematic>true</kinematic><gravity>false</gravity>" <<
+      "<collision name='collision'>" << geometry.str() << "</collision>" <<
+      "<visual name='visual'>" << geometry.str() << "</visual>" <<
+      "</link></model></sdf>";
+    return model.str();
+  }
+
+  void OnUpdate(const common::UpdateInfo & info)
+  {
+    const double time = info.simTime.Double();
+    // The world was reset
+    if (time < last_update_) {
+      last_update_ = -1.0;
+    }
+    if (last_update_ >= 0.0 && time - last_update_ < update_period_) {
+      return;
+    }
+    last_update_ = time;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (auto & obstacle : obstacles_) {
+      // The models are inserted asynchronously, and are found once they are in the world
+      if (!obstacle.model) {
+        obstacle.model = world_->ModelByName(obstacle.name);
+        if (!obstacle.model) {
+          continue;
+        }
+      }
+      obstacle.model->SetWorldPose(obstacle.poseAt(time));
+    }
+    update_time_ += std::chrono::steady_clock::now() - start;
+    updates_++;
+
+    if (time - last_report_ >= 10.0 || time < last_report_) {
+      gzmsg << "ObstacleCrowd: " << obstacles_.size() << " obstacles, mean update " <<
+        std::chrono::duration<double, std::micro>(update_time_).count() / updates_ << " us" <<
+        std::endl;
+      last_report_ = time;
+      update_time_ = std::chrono::steady_clock::duration::zero();
+      updates_ = 0;
+    }
+  }
+
+  physics::WorldPtr world_;
+  std::vector<CrowdObstacle> obstacles_;
+  event::ConnectionPtr update_connection_;
+
+  double update_period_{0.0};
+  double last_update_{-1.0};
+
+  double last_report_{0.0};
+  std::chrono::steady_clock::duration update_time_{std::chrono::steady_clock::duration::zero()};
+  uint64_t updates_{0};
+};
+
+// Register this plugin with the simulator
+GZ_REGISTER_WORLD_PLUGIN(ObstacleCrowd)
+
+}  // namespace gazebo
@@ -1,30 +0,0 @@
-from launch import LaunchDescription
-from launch.actions import DeclareLaunchArgument
-from launch.substitutions import LaunchConfiguration
-from launch_ros.actions import Node
-from ament_index_python.packages import get_package_share_directory
-
-
-def generate_launch_description():
-    use_sim_time = LaunchConfiguration('use_sim_time')
-
-    declare_use_sim_time_argument = DeclareLaunchArgument(
-        'use_sim_time',
-        default_value='false',
-        description='Use simulation/Gazebo clock')
-
-    start_async_slam_toolbox_node = Node(
-        parameters=[
-          get_package_share_directory("kmr_slam_toolbox") + '/config/KMR_localization_params_online_async.yaml',
-          {'use_sim_time': False}],
-        package='slam_toolbox',
-        executable='async_slam_toolbox_node',
-        name='slam_toolbox',
-        output='screen')
-
-    ld = LaunchDescription()
-
-    ld.add_action(declare_use_sim_time_argument)
-    ld.add_action(start_async_slam_toolbox_node)
-
-    return ld
@@ -0,0 +1,48 @@
+from launch import LaunchDescription
+from launch.actions import DeclareLaunchArgument, OpaqueFunction
+from launch.substitutions import LaunchConfiguration
+from launch_ros.actions import Node
+from ament_index_python.packages import get_package_share_directory
+
+
+def start_slam_toolbox(context):
+    # slam_toolbox starts without a map when map_file_name is empty
+    map_name = LaunchConfiguration('map').perform(context)
+    map_file_name = ''
+    if map_name:
+        map_file_name = get_package_share_directory("kmr_slam_toolbox") + '/created_maps/' + map_name
+
+    return [Node(
+        parameters=[
+          get_package_share_directory("kmr_slam_toolbox") + '/config/KMR_localization_params_online_async.yaml',
+          {'use_sim_time': False,
+           'map_file_name': map_file_name}],
+        package='slam_toolbox',
+        executable='async_slam_toolbox_node',
+        name='slam_toolbox',
+        output='screen')]
+
+
+def generate_launch_description():
+    use_sim_time = LaunchConfiguration('use_sim_time')
+
+    declare_use_sim_time_argument = DeclareLaunchArgument(
+        'use_sim_time',
+        default_value='false',
+        description='Use simulation/Gazebo clock')
+
+    # The serialized pose graph is loaded by slam_toolbox at startup, so localization starts
+    # without loading the map from the rviz panel
+    declare_map_argument = DeclareLaunchArgument(
+        'map',
+        default_value='',
+        description='Serialized map (.posegraph and .data) in created_maps to localize against, '
+                    'none if empty')
+
+    ld = LaunchDescription()
+
+    ld.add_action(declare_use_sim_time_argument)
+    ld.add_action(declare_map_argument)
+    ld.add_action(OpaqueFunction(function=start_slam_toolbox))
+
+    return ld
@@ -20,6 +20,9 @@
 #include "rviz_plugin/slam_toolbox_rviz_plugin.h"
 // ROS
 #include <tf2_ros/transform_listener.h>
+#include <tf2/LinearMath/Matrix3x3.h>
+#include <tf2/LinearMath/Quaternion.h>
+#include <tf2_geometry_msgs/tf2_geometry_msgs.h>
 // QT
 #include <QPushButton>
 #include <QCheckBox>
@@ -30,8 +33,12 @@
 #include <QtGui>
 #include <QLabel>
 #include <QFrame>
+#include <QTimer>
 // STL
+#include <atomic>
 #include <memory>
+#include <string>
+#include <vector>
 
 
 namespace slam_toolbox
@@ -45,14 +52,16 @@ SlamToolboxPlugin::SlamToolboxPlugin(QWidget * parent)
 {
   ros_node_ = std::make_shared<rclcpp::Node>("SlamToolboxPlugin");
 
-  bool paused_measure = false, interactive = false;
-  paused_measure = ros_node_->declare_parameter(
-    "/slam_toolbox/paused_new_measurements", paused_measure);
-  interactive = ros_node_->declare_parameter(
-    "/slam_toolbox/interactive_mode", interactive);
-    
   _initialposeSub = ros_node_->create_subscription<geometry_msgs::msg::PoseWithCovarianceStamped>(
-    "/initialpose", 10, std::bind(&SlamToolboxPlugin::InitialPoseCallback, this, _1));
+    "/initialpose", 10, std::bind(&SlamToolboxPlugin::InitialPoseCallback, this,
+    std::placeholders::_1));
+
+  // slam_toolbox publishes its parameters on /parameter_events when it declares them at
+  // startup and whenever they are changed, so the check boxes follow them without polling
+  _slam_parameters =
+    std::make_shared<rclcpp::AsyncParametersClient>(ros_node_, "/slam_toolbox");
+  _parameterEventSub = _slam_parameters->on_parameter_event(
+    std::bind(&SlamToolboxPlugin::onParameterEvent, this, std::placeholders::_1));
 
   _serialize =
     ros_node_->create_client<slam_toolbox::srv::SerializePoseGraph>(
@@ -139,12 +148,18 @@ SlamToolboxPlugin::SlamToolboxPlugin(QWidget * parent)
   _label8 = new QLabel(this);
   _label8->setText("θ");
   _label8->setAlignment(Qt::AlignCenter);
+  _label9 = new QLabel(this);
+  _label9->setAlignment(Qt::AlignCenter);
+
+  _loadTimer = new QTimer(this);
+  connect(_loadTimer, &QTimer::timeout, this, &SlamToolboxPlugin::UpdateLoadProgress);
 
+  // Both start at the defaults of slam_toolbox until its parameters are received
   _check1 = new QCheckBox();
-  _check1->setChecked(interactive);
+  _check1->setChecked(false);
   connect(_check1, SIGNAL(stateChanged(int)), this, SLOT(InteractiveCb(int)));
   _check2 = new QCheckBox();
-  _check2->setChecked(!paused_measure);
+  _check2->setChecked(true);
   connect(_check2, SIGNAL(stateChanged(int)), this,
     SLOT(PauseMeasurementsCb(int)));
   _radio1 = new QRadioButton(tr("Start At Dock"));
@@ -227,6 +242,7 @@ SlamToolboxPlugin::SlamToolboxPlugin(QWidget * parent)
   _vbox->addLayout(_hbox3);
   _vbox->addLayout(_hbox7);
   _vbox->addLayout(_hbox8);
+  _vbox->addWidget(_label9);
   _vbox->addLayout(_hbox9);
   _vbox->addLayout(_hbox10);
   _vbox->addLayout(_hbox4);
@@ -237,33 +253,156 @@ SlamToolboxPlugin::SlamToolboxPlugin(QWidget * parent)
 
   setLayout(_vbox);
 
-  _thread =
-    std::make_unique<std::thread>(
-    &SlamToolboxPlugin::updateCheckStateIfExternalChange, this);
+  // The ROS callbacks run on the executor thread and only emit signals. The connections are
+  // queued, so the widgets are only touched on the GUI thread.
+  connect(this, &SlamToolboxPlugin::serviceCallFinished,
+    this, &SlamToolboxPlugin::ServiceCallFinished, Qt::QueuedConnection);
+  connect(this, &SlamToolboxPlugin::interactiveStateChanged,
+    this, &SlamToolboxPlugin::UpdateInteractiveState, Qt::QueuedConnection);
+  connect(this, &SlamToolboxPlugin::pausedStateChanged,
+    this, &SlamToolboxPlugin::UpdatePausedState, Qt::QueuedConnection);
+  connect(this, &SlamToolboxPlugin::initialPoseReceived,
+    this, &SlamToolboxPlugin::UpdateInitialPose, Qt::QueuedConnection);
+
+  _executor.add_node(ros_node_);
+  _thread = std::make_unique<std::thread>([this]() {_executor.spin();});
+
+  // The parameter services of slam_toolbox are only discovered some time after the client is
+  // created, so they are polled until they are ready, and the current state is taken from them.
+  // Changes made afterwards are received as parameter events.
+  _parameterTimer = new QTimer(this);
+  connect(_parameterTimer, &QTimer::timeout, this, &SlamToolboxPlugin::FetchSlamParameters);
+  _parameterTimer->start(500);
 }
 
 /*****************************************************************************/
 SlamToolboxPlugin::~SlamToolboxPlugin()
 /*****************************************************************************/
 {
+  _executor.cancel();
   _thread->join();
   _thread.reset();
 }
-  
+
 /*****************************************************************************/
-void SlamToolboxPlugin::InitialPoseCallback(const geometry_msgs::msg::PoseWithCovarianceStamped::SharedPtr& msg)
+template<typename ServiceT>
+bool SlamToolboxPlugin::callService(
+  const typename rclcpp::Client<ServiceT>::SharedPtr & client,
+  const std::shared_ptr<typename ServiceT::Request> & request,
+  QWidget * widget, const QString & failure, int timeout_ms)
+/*****************************************************************************/
+{
+  if (!client->service_is_ready()) {
+    RCLCPP_WARN(ros_node_->get_logger(), "%s", failure.toStdString().c_str());
+    return false;
+  }
+
+  // Set by whichever comes first of the response and the timeout
+  auto finished = std::make_shared<std::atomic<bool>>(false);
+
+  widget->setEnabled(false);
+  client->async_send_request(request,
+    [this, widget, finished](typename rclcpp::Client<ServiceT>::SharedFuture) {
+      if (!finished->exchange(true)) {
+        Q_EMIT serviceCallFinished(widget, QString());
+      }
+    });
+
+  if (timeout_ms > 0) {
+    QTimer::singleShot(timeout_ms, this, [this, widget, finished, failure]() {
+        if (!finished->exchange(true)) {
+          ServiceCallFinished(widget, failure);
+        }
+      });
+    return true;
+  }
+
+  // Long calls are only given up if the server goes away while working on them
+  QTimer * watchdog = new QTimer(this);
+  connect(watchdog, &QTimer::timeout, this,
+    [this, client, widget, finished, failure, watchdog]() {
+      if (*finished) {
+        watchdog->deleteLater();
+      } else if (!client->service_is_ready() && !finished->exchange(true)) {
+        ServiceCallFinished(widget, failure);
+        watchdog->deleteLater();
+      }
+    });
+  watchdog->start(1000);
+  return true;
+}
+
+/*****************************************************************************/
+void SlamToolboxPlugin::ServiceCallFinished(QWidget * widget, QString failure)
+/*****************************************************************************/
+{
+  widget->setEnabled(true);
+  if (!failure.isEmpty()) {
+    RCLCPP_WARN(ros_node_->get_logger(), "%s", failure.toStdString().c_str());
+  }
+
+  if (widget == _button8) {
+    _loadTimer->stop();
+    double elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - _loadStart).count();
+    _label9->setText(failure.isEmpty() ?
+      QString("Map loaded in %1 s").arg(elapsed, 0, 'f', 1) :
+      QString("Failed to load map after %1 s").arg(elapsed, 0, 'f', 1));
+  }
+}
+
+/*****************************************************************************/
+void SlamToolboxPlugin::UpdateLoadProgress()
+/*****************************************************************************/
+{
+  double elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - _loadStart).count();
+  _label9->setText(QString("Loading map... %1 s").arg(elapsed, 0, 'f', 0));
+}
+
+/*****************************************************************************/
+void SlamToolboxPlugin::FetchSlamParameters()
+/*****************************************************************************/
+{
+  if (!_slam_parameters->service_is_ready()) {
+    return;
+  }
+  _parameterTimer->stop();
+  _slam_parameters->get_parameters(
+    {"paused_new_measurements", "interactive_mode"},
+    [this](std::shared_future<std::vector<rclcpp::Parameter>> future) {
+      std::vector<rcl_interfaces::msg::Parameter> parameters;
+      for (const auto & parameter : future.get()) {
+        parameters.push_back(parameter.to_parameter_msg());
+      }
+      updateCheckState(parameters);
+    });
+}
+
+/*****************************************************************************/
+void SlamToolboxPlugin::InitialPoseCallback(
+  const geometry_msgs::msg::PoseWithCovarianceStamped::SharedPtr msg)
 /*****************************************************************************/
 {
-  _match_type = PROCESS_NEAR_REGION_CMT;
-  ROS_INFO("Setting initial pose from rviz; you can now deserialize a map given that pose.");
-  _radio2->setChecked(true);
-  _line5->setText(QString::number(msg->pose.pose.position.x, 'f', 2));
-  _line6->setText(QString::number(msg->pose.pose.position.y, 'f', 2));
   tf2::Quaternion quat_tf;
-  tf2::convert(msg->pose.pose.orientation , quat_tf);
+  tf2::convert(msg->pose.pose.orientation, quat_tf);
   tf2::Matrix3x3 m(quat_tf);
   double roll, pitch, yaw;
   m.getRPY(roll, pitch, yaw);
+  Q_EMIT initialPoseReceived(
+    msg->pose.pose.position.x, msg->pose.pose.position.y, yaw);
+}
+
+/*****************************************************************************/
+void SlamToolboxPlugin::UpdateInitialPose(double x, double y, double yaw)
+/*****************************************************************************/
+{
+  _match_type = PROCESS_NEAR_REGION_CMT;
+  RCLCPP_INFO(ros_node_->get_logger(),
+    "Setting initial pose from rviz; you can now deserialize a map given that pose.");
+  _radio2->setChecked(true);
+  _line5->setText(QString::number(x, 'f', 2));
+  _line6->setText(QString::number(y, 'f', 2));
   _line7->setText(QString::number(yaw, 'f', 2));
 }
 
@@ -274,16 +413,9 @@ void SlamToolboxPlugin::SerializeMap()
   auto request =
     std::make_shared<slam_toolbox::srv::SerializePoseGraph::Request>();
   request->filename = _line3->text().toStdString();
-  auto result_future = _serialize->async_send_request(request);
-
-  if (rclcpp::spin_until_future_complete(ros_node_, result_future,
-    std::chrono::seconds(5)) !=
-    rclcpp::executor::FutureReturnCode::SUCCESS)
-  {
-    RCLCPP_WARN(ros_node_->get_logger(),
-      "SlamToolbox: Failed to serialize"
-      " pose graph to file, is service running?");
-  }
+  callService<slam_toolbox::srv::SerializePoseGraph>(
+    _serialize, request, _button7,
+    "SlamToolbox: Failed to serialize pose graph to file, is service running?", 0);
 }
 
 /*****************************************************************************/
@@ -307,7 +439,7 @@ void SlamToolboxPlugin::DeserializeMap()
     }
     catch (const std::invalid_argument& ia)
     {
-      ROS_WARN("Initial pose invalid.");
+      RCLCPP_WARN(ros_node_->get_logger(), "Initial pose invalid.");
       return;
     }
   } else if (_match_type == LOCALIZE_CMT) {
@@ -320,7 +452,7 @@ void SlamToolboxPlugin::DeserializeMap()
     }
     catch (const std::invalid_argument& ia)
     {
-      ROS_WARN("Initial pose invalid.");
+      RCLCPP_WARN(ros_node_->get_logger(), "Initial pose invalid.");
       return;
     }
   } else {
@@ -329,15 +461,14 @@ void SlamToolboxPlugin::DeserializeMap()
     return;
   }
 
-  auto result_future = _load_map->async_send_request(request);
-
-  if (rclcpp::spin_until_future_complete(ros_node_, result_future,
-    std::chrono::seconds(5)) !=
-    rclcpp::executor::FutureReturnCode::SUCCESS)
+  // Large pose graphs take much longer than 5 s to load, so there is no timeout
+  _loadStart = std::chrono::steady_clock::now();
+  if (callService<slam_toolbox::srv::DeserializePoseGraph>(
+      _load_map, request, _button8,
+      "SlamToolbox: Failed to deserialize mapper object from file, is service running?", 0))
   {
-    RCLCPP_WARN(ros_node_->get_logger(),
-      "SlamToolbox: Failed to deserialize mapper object "
-      "from file, is service running?");
+    UpdateLoadProgress();
+    _loadTimer->start(1000);
   }
 }
 
@@ -347,30 +478,18 @@ void SlamToolboxPlugin::LoadSubmap()
 {
   auto request = std::make_shared<slam_toolbox::srv::AddSubmap::Request>();
   request->filename = _line2->text().toStdString();
-  auto result_future = _load_submap_for_merging->async_send_request(request);
-
-  if (rclcpp::spin_until_future_complete(ros_node_, result_future,
-    std::chrono::seconds(5)) !=
-    rclcpp::executor::FutureReturnCode::SUCCESS)
-  {
-    RCLCPP_WARN(ros_node_->get_logger(),
-      "MergeMaps: Failed to load pose graph from file, is service running?");
-  }
+  callService<slam_toolbox::srv::AddSubmap>(
+    _load_submap_for_merging, request, _button5,
+    "MergeMaps: Failed to load pose graph from file, is service running?");
 }
 /*****************************************************************************/
 void SlamToolboxPlugin::GenerateMap()
 /*****************************************************************************/
 {
   auto request = std::make_shared<slam_toolbox::srv::MergeMaps::Request>();
-  auto result_future = _merge->async_send_request(request);
-
-  if (rclcpp::spin_until_future_complete(ros_node_, result_future,
-    std::chrono::seconds(5)) !=
-    rclcpp::executor::FutureReturnCode::SUCCESS)
-  {
-    RCLCPP_WARN(ros_node_->get_logger(),
-      "MergeMaps: Failed to merge maps, is service running?");
-  }
+  callService<slam_toolbox::srv::MergeMaps>(
+    _merge, request, _button6,
+    "MergeMaps: Failed to merge maps, is service running?");
 }
 
 /*****************************************************************************/
@@ -378,15 +497,9 @@ void SlamToolboxPlugin::ClearChanges()
 /*****************************************************************************/
 {
   auto request = std::make_shared<slam_toolbox::srv::Clear::Request>();
-  auto result_future = _clearChanges->async_send_request(request);
-
-  if (rclcpp::spin_until_future_complete(ros_node_, result_future,
-    std::chrono::seconds(5)) !=
-    rclcpp::executor::FutureReturnCode::SUCCESS)
-  {
-    RCLCPP_WARN(ros_node_->get_logger(),
-      "SlamToolbox: Failed to clear changes, is service running?");
-  }
+  callService<slam_toolbox::srv::Clear>(
+    _clearChanges, request, _button1,
+    "SlamToolbox: Failed to clear changes, is service running?");
 }
 
 /*****************************************************************************/
@@ -394,15 +507,9 @@ void SlamToolboxPlugin::SaveChanges()
 /*****************************************************************************/
 {
   auto request = std::make_shared<slam_toolbox::srv::LoopClosure::Request>();
-  auto result_future = _saveChanges->async_send_request(request);
-
-  if (rclcpp::spin_until_future_complete(ros_node_, result_future,
-    std::chrono::seconds(5)) !=
-    rclcpp::executor::FutureReturnCode::SUCCESS)
-  {
-    RCLCPP_WARN(ros_node_->get_logger(),
-      "SlamToolbox: Failed to save changes, is service running?");
-  }
+  callService<slam_toolbox::srv::LoopClosure>(
+    _saveChanges, request, _button2,
+    "SlamToolbox: Failed to save changes, is service running?");
 }
 
 /*****************************************************************************/
@@ -411,16 +518,9 @@ void SlamToolboxPlugin::SaveMap()
 {
   auto request = std::make_shared<slam_toolbox::srv::SaveMap::Request>();
   request->name.data = _line1->text().toStdString();
-  auto result_future = _saveMap->async_send_request(request);
-
-  if (rclcpp::spin_until_future_complete(ros_node_, result_future,
-    std::chrono::seconds(5)) !=
-    rclcpp::executor::FutureReturnCode::SUCCESS)
-  {
-    RCLCPP_WARN(ros_node_->get_logger(),
-      "SlamToolbox: Failed to save map as %s, is service running?",
-      request->name.data.c_str());
-  }
+  callService<slam_toolbox::srv::SaveMap>(
+    _saveMap, request, _button3,
+    QString("SlamToolbox: Failed to save map as %1, is service running?").arg(_line1->text()));
 }
 
 /*****************************************************************************/
@@ -428,15 +528,9 @@ void SlamToolboxPlugin::ClearQueue()
 /*****************************************************************************/
 {
   auto request = std::make_shared<slam_toolbox::srv::ClearQueue::Request>();
-  auto result_future = _clearQueue->async_send_request(request);
-
-  if (rclcpp::spin_until_future_complete(ros_node_, result_future,
-    std::chrono::seconds(5)) !=
-    rclcpp::executor::FutureReturnCode::SUCCESS)
-  {
-    RCLCPP_WARN(ros_node_->get_logger(),
-      "Failed to clear queue, is service running?");
-  }
+  callService<slam_toolbox::srv::ClearQueue>(
+    _clearQueue, request, _button4,
+    "Failed to clear queue, is service running?");
 }
 
 /*****************************************************************************/
@@ -445,15 +539,9 @@ void SlamToolboxPlugin::InteractiveCb(int state)
 {
   auto request =
     std::make_shared<slam_toolbox::srv::ToggleInteractive::Request>();
-  auto result_future = _interactive->async_send_request(request);
-
-  if (rclcpp::spin_until_future_complete(ros_node_, result_future,
-    std::chrono::seconds(5)) !=
-    rclcpp::executor::FutureReturnCode::SUCCESS)
-  {
-    RCLCPP_WARN(ros_node_->get_logger(),
-      "SlamToolbox: Failed to toggle interactive mode, is service running?");
-  }
+  callService<slam_toolbox::srv::ToggleInteractive>(
+    _interactive, request, _check1,
+    "SlamToolbox: Failed to toggle interactive mode, is service running?");
 }
 
 /*****************************************************************************/
@@ -461,15 +549,9 @@ void SlamToolboxPlugin::PauseMeasurementsCb(int state)
 /*****************************************************************************/
 {
   auto request = std::make_shared<slam_toolbox::srv::Pause::Request>();
-  auto result_future = _pause_measurements->async_send_request(request);
-
-  if (rclcpp::spin_until_future_complete(ros_node_, result_future,
-    std::chrono::seconds(5)) !=
-    rclcpp::executor::FutureReturnCode::SUCCESS)
-  {
-    RCLCPP_WARN(ros_node_->get_logger(),
-      "SlamToolbox: Failed to toggle pause measurements, is service running?");
-  }
+  callService<slam_toolbox::srv::Pause>(
+    _pause_measurements, request, _check2,
+    "SlamToolbox: Failed to toggle pause measurements, is service running?");
 }
 
 /*****************************************************************************/
@@ -527,28 +609,50 @@ void SlamToolboxPlugin::LocalizeCb()
 
 
 /*****************************************************************************/
-void SlamToolboxPlugin::updateCheckStateIfExternalChange()
+void SlamToolboxPlugin::onParameterEvent(
+  const rcl_interfaces::msg::ParameterEvent::SharedPtr event)
 /*****************************************************************************/
 {
-  rclcpp::Rate r(1);
-  bool paused_measure = false, interactive = false;
-
-  while (rclcpp::ok()) {
-    paused_measure = ros_node_->get_parameter(
-      "/slam_toolbox/paused_new_measurements").as_bool();
-    interactive = ros_node_->get_parameter(
-      "/slam_toolbox/interactive_mode").as_bool();
+  if (event->node != "/slam_toolbox") {
+    return;
+  }
+  updateCheckState(event->new_parameters);
+  updateCheckState(event->changed_parameters);
+}
 
-    bool oldState = _check1->blockSignals(true);
-    _check1->setChecked(interactive);
-    _check1->blockSignals(oldState);
+/*****************************************************************************/
+void SlamToolboxPlugin::updateCheckState(
+  const std::vector<rcl_interfaces::msg::Parameter> & parameters)
+/*****************************************************************************/
+{
+  for (const auto & parameter : parameters) {
+    if (parameter.value.type != rcl_interfaces::msg::ParameterType::PARAMETER_BOOL) {
+      continue;
+    }
+    if (parameter.name == "interactive_mode") {
+      Q_EMIT interactiveStateChanged(parameter.value.bool_value);
+    } else if (parameter.name == "paused_new_measurements") {
+      Q_EMIT pausedStateChanged(parameter.value.bool_value);
+    }
+  }
+}
 
-    oldState = _check2->blockSignals(true);
-    _check2->setChecked(!paused_measure);
-    _check2->blockSignals(oldState);
+/*****************************************************************************/
+void SlamToolboxPlugin::UpdateInteractiveState(bool interactive)
+/*****************************************************************************/
+{
+  bool oldState = _check1->blockSignals(true);
+  _check1->setChecked(interactive);
+  _check1->blockSignals(oldState);
+}
 
-    r.sleep();
-  }
+/*****************************************************************************/
+void SlamToolboxPlugin::UpdatePausedState(bool paused)
+/*****************************************************************************/
+{
+  bool oldState = _check2->blockSignals(true);
+  _check2->setChecked(!paused);
+  _check2->blockSignals(oldState);
 }
 
 }  // namespace slam_toolbox
@@ -32,20 +32,23 @@
 #include <QLabel>
 #include <QFrame>
 #include <QRadioButton>
+#include <QString>
 // STL
 #include <thread>
 #include <chrono>
 #include <memory>
+#include <vector>
 // ROS
 #include "rclcpp/rclcpp.hpp"
 #include "rviz_common/panel.hpp"
 #include "slam_toolbox/toolbox_msgs.hpp"
-#include "geometry_msgs/msg/PoseWithCovarianceStamped.hpp"
+#include "geometry_msgs/msg/pose_with_covariance_stamped.hpp"
 
 
 class QLineEdit;
 class QSpinBox;
 class QComboBox;
+class QTimer;
 
 namespace rviz_common
 {
@@ -89,9 +92,36 @@ public Q_SLOTS:
   void SerializeMap();
   void DeserializeMap();
 
-  void updateCheckStateIfExternalChange();
+  void ServiceCallFinished(QWidget * widget, QString failure);
+  void UpdateInteractiveState(bool interactive);
+  void UpdatePausedState(bool paused);
+  void UpdateInitialPose(double x, double y, double yaw);
+  void UpdateLoadProgress();
+  void FetchSlamParameters();
+
+Q_SIGNALS:
+  // Emitted from the ROS executor thread, handled by the slots above on the GUI thread
+  void serviceCallFinished(QWidget * widget, QString failure);
+  void interactiveStateChanged(bool interactive);
+  void pausedStateChanged(bool paused);
+  void initialPoseReceived(double x, double y, double yaw);
 
 protected:
+  // Sends the request without waiting for the response. The widget is disabled until the
+  // response arrives, or until the service has not responded within the timeout. With a
+  // timeout of 0 the call waits for as long as the service is available. Returns false if
+  // the service is not available.
+  template<typename ServiceT>
+  bool callService(
+    const typename rclcpp::Client<ServiceT>::SharedPtr & client,
+    const std::shared_ptr<typename ServiceT::Request> & request,
+    QWidget * widget, const QString & failure, int timeout_ms = 5000);
+
+  void onParameterEvent(const rcl_interfaces::msg::ParameterEvent::SharedPtr event);
+
+  void updateCheckState(const std::vector<rcl_interfaces::msg::Parameter> & parameters);
+
+
   QVBoxLayout * _vbox;
   QHBoxLayout * _hbox1;
   QHBoxLayout * _hbox2;
@@ -136,6 +166,14 @@ protected:
   QLabel * _label6;
   QLabel * _label7;
   QLabel * _label8;
+  QLabel * _label9;
+
+  // Shows how long the map has been loading
+  QTimer * _loadTimer;
+  std::chrono::steady_clock::time_point _loadStart;
+
+  // Polls the parameter services of slam_toolbox until they are ready
+  QTimer * _parameterTimer;
 
   QFrame * _line;
 
@@ -151,13 +189,18 @@ protected:
   rclcpp::Client<slam_toolbox::srv::SerializePoseGraph>::SharedPtr _serialize;
   rclcpp::Client<slam_toolbox::srv::DeserializePoseGraph>::SharedPtr _load_map;
 
+  // Parameters of slam_toolbox, only used to follow changes made outside of the panel
+  rclcpp::AsyncParametersClient::SharedPtr _slam_parameters;
+  rclcpp::Subscription<rcl_interfaces::msg::ParameterEvent>::SharedPtr _parameterEventSub;
+
+  rclcpp::executors::SingleThreadedExecutor _executor;
   std::unique_ptr<std::thread> _thread;
 
   ContinueMappingType _match_type;
   
   rclcpp::Subscription<geometry_msgs::msg::PoseWithCovarianceStamped>::SharedPtr _initialposeSub;
   
-  void InitialPoseCallback(const geometry_msgs::msg::PoseWithCovarianceStamped::SharedPtr& pose);
+  void InitialPoseCallback(const geometry_msgs::msg::PoseWithCovarianceStamped::SharedPtr pose);
 };
 
 }  // namespace slam_toolbox
@@ -74,6 +74,12 @@ public class KMRiiwaSunriseApplication extends RoboticsAPIApplication{
 	int LBR_command_port = 30005;
 	int LBR_status_port = 30006;
 	int LBR_sensor_port = 30007;
+	int sensor_port = 30008;
+	
+	// Send all sensor and status data over one connection to the sensor bridge on the ROS side,
+	// instead of one connection per reader. Must match the multiplexed argument of
+	// sunrise_communication.launch.py.
+	boolean multiplexed_sensors = false;
 	
 	// Threading parameter
 	String threading_prio = "LBR";
@@ -81,6 +87,7 @@ public class KMRiiwaSunriseApplication extends RoboticsAPIApplication{
 	// Connection types
 	String TCPConnection = "TCP";
 	String UDPConnection = "UDP";
+	String MUXConnection = "MUX";
 
 	// Implemented node classes
 	KMP_commander kmp_commander;
@@ -138,7 +145,13 @@ public class KMRiiwaSunriseApplication extends RoboticsAPIApplication{
 			}				
 		}
 		// Establish remaining nodes
-		if(AppRunning){
+		if(AppRunning && multiplexed_sensors){
+			kmp_status_reader = new KMP_status_reader(sensor_port, kmp, MUXConnection);
+			lbr_status_reader = new LBR_status_reader(sensor_port, lbr, MUXConnection);
+			lbr_sensor_reader = new LBR_sensor_reader(sensor_port, lbr, MUXConnection);
+			kmp_sensor_reader = new KMP_sensor_reader(sensor_port, sensor_port, MUXConnection, MUXConnection);
+		}
+		else if(AppRunning){
 			kmp_status_reader = new KMP_status_reader(KMP_status_port, kmp,TCPConnection);
 			lbr_status_reader = new LBR_status_reader(LBR_status_port, lbr,TCPConnection);
 			lbr_sensor_reader = new LBR_sensor_reader(LBR_sensor_port, lbr, TCPConnection);
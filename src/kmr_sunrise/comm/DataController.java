@@ -21,6 +21,8 @@ package API_ROS2_Sunrise;
 // RoboticsAPI
 import API_ROS2_Sunrise.ISocket;
 
+import java.nio.ByteBuffer;
+
 import com.kuka.nav.fdi.DataConnectionListener;
 import com.kuka.nav.fdi.DataListener;
 import com.kuka.nav.fdi.data.CommandedVelocity;
@@ -36,6 +38,11 @@ public class DataController implements DataListener, DataConnectionListener{
 	long ms_sent = System.currentTimeMillis();
 	Odometry odom;
 	
+	// Binary laser scan frame, see kmr_communication/nodes/kmp_protocol.py
+	private static final byte FRAME_LASER_SCAN = 0x01;
+	private static final byte PROTOCOL_VERSION = 1;
+	private static final int LASER_SCAN_HEADER_SIZE = 16;
+	
 
 	public DataController(ISocket laser_socket, ISocket odometry_socket) {
 		this.fdi_isConnected=false;
@@ -53,15 +60,51 @@ public class DataController implements DataListener, DataConnectionListener{
 	@Override
 	public void onNewLaserData(LaserScan scan) {
 		if(fdi_isConnected && this.laser_socket.isConnected()){
-			String scan_data = ">laserScan " +  scan.getTimestamp() + " " + scan.getLaserId()  + " " + scan.getRangesAsString();
 			try{
-				this.laser_socket.send_message(scan_data);
+				if(this.laser_socket.isBinaryLaser()){
+					this.laser_socket.send_frame(encodeLaserScan(scan));
+				}else{
+					String scan_data = ">laserScan " +  scan.getTimestamp() + " " + scan.getLaserId()  + " " + scan.getRangesAsString();
+					this.laser_socket.send_message(scan_data);
+				}
 			}catch(Exception e){
 				System.out.println("Could not send KMP laserdata to ROS: " + e);
 			}
 		}
 	}
 
+	private byte[] encodeLaserScan(LaserScan scan) {
+		String[] values = scan.getRangesAsString().split(",");
+		int count = 0;
+		for (String value : values) {
+			if (value.length() > 0) {
+				count++;
+			}
+		}
+		
+		// ByteBuffer is big endian, as expected by the ROS side
+		ByteBuffer frame = ByteBuffer.allocate(LASER_SCAN_HEADER_SIZE + 4 * count);
+		frame.put(FRAME_LASER_SCAN);
+		frame.put(PROTOCOL_VERSION);
+		frame.putShort((short) scan.getLaserId());
+		frame.putLong(scan.getTimestamp());
+		frame.putInt(count);
+		for (String value : values) {
+			if (value.length() > 0) {
+				frame.putFloat(parseRange(value));
+			}
+		}
+		return frame.array();
+	}
+	
+	private static float parseRange(String value) {
+		try {
+			return Float.parseFloat(value);
+		} catch (NumberFormatException e) {
+			return Float.NaN;
+		}
+	}
+
 	@Override
 	public void onNewOdometryData(Odometry odom) {
 		long msg_time = System.currentTimeMillis();
@@ -5,11 +5,17 @@ package API_ROS2_Sunrise;
 
 public interface ISocket {
 	
+	// Offered by the ROS laser scan node when it accepts binary laser scan frames
+	public static final String BINARY_LASER_OFFER = "binary_laser";
+	
 	public void close();
 	public void send_message(String msg);
+	public void send_frame(byte[] frame);
 	public String receive_message();
 	public byte[] encode(String string);
 	public boolean isConnected();
+	public boolean negotiate_binary_laser();
+	public boolean isBinaryLaser();
 
 
 }
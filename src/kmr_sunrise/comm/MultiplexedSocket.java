@@ -0,0 +1,114 @@
+// Copyright 2019 Nina Marie Wahl og Charlotte Heggem.
+// Copyright 2019 Norwegian University of Science and Technology.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package API_ROS2_Sunrise;
+
+import API_ROS2_Sunrise.ISocket;
+import API_ROS2_Sunrise.TCPSocket;
+
+// One TCP connection shared by all sensor and status readers, to the sensor bridge on the ROS
+// side. Every message already starts with its type (">laserScan", ">odometry", ... or the frame
+// type of a binary frame), so the bridge can tell the streams apart. TCPSocket serializes the
+// writes of the reader threads.
+public class MultiplexedSocket implements ISocket{
+
+	// A connection and the number of readers using it. A reader that opened an earlier
+	// connection only ever releases that one, so closing it after a reconnect does not close
+	// the connection the other readers have moved on to.
+	private static class Connection{
+		final TCPSocket socket;
+		int users = 0;
+
+		Connection(TCPSocket socket){
+			this.socket = socket;
+		}
+	}
+
+	private static Connection current;
+
+	// The connection of this reader, null once it is closed or if it never connected
+	private Connection connection;
+	private final TCPSocket socket;
+	String nodename;
+
+	public MultiplexedSocket(int port, String node_name) {
+		this.nodename = node_name;
+		synchronized(MultiplexedSocket.class){
+			if(current == null || !current.socket.isConnected()){
+				current = new Connection(new TCPSocket(port, "Multiplexed sensor socket"));
+			}
+			this.socket = current.socket;
+			if(current.socket.isConnected()){
+				current.users++;
+				connection = current;
+				System.out.println(this.nodename + " sending over the multiplexed sensor socket on port: " + port);
+			}
+		}
+	}
+
+	@Override
+	public void send_message(String msg){
+		socket.send_message(msg);
+	}
+
+	@Override
+	public void send_frame(byte[] frame){
+		socket.send_frame(frame);
+	}
+
+	// The bridge only sends the binary laser offer, so nothing else is read from the connection
+	@Override
+	public String receive_message(){
+		return "";
+	}
+
+	@Override
+	public boolean negotiate_binary_laser(){
+		return socket.negotiate_binary_laser();
+	}
+
+	@Override
+	public boolean isBinaryLaser(){
+		return socket.isBinaryLaser();
+	}
+
+	// The connection is closed when the last reader using it closes
+	@Override
+	public void close(){
+		synchronized(MultiplexedSocket.class){
+			if(connection == null){
+				return;
+			}
+			connection.users--;
+			if(connection.users == 0){
+				connection.socket.close();
+			}
+			connection = null;
+		}
+	}
+
+	@Override
+	public byte[] encode(String string) {
+		return socket.encode(string);
+	}
+
+	@Override
+	public boolean isConnected() {
+		synchronized(MultiplexedSocket.class){
+			return connection != null && socket.isConnected();
+		}
+	}
+
+}
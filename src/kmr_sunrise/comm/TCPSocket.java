@@ -2,6 +2,8 @@ package API_ROS2_Sunrise;
 
 
 import java.io.IOException;
+import java.io.OutputStream;
+import java.net.SocketTimeoutException;
 
 import java.net.DatagramPacket;
 
@@ -22,10 +24,12 @@ public class TCPSocket implements ISocket{
 	DatagramPacket package_out;
 	DatagramPacket package_in;
 	public PrintWriter outputStream;
+	public OutputStream rawOutputStream;
 	public BufferedReader inputStream;
 	private final static Charset UTF8_CHARSET = Charset.forName("UTF-8");
 	int COMport;
 	String nodename;
+	boolean binaryLaser = false;
 	
 	public TCPSocket(int port, String node_name) {
 		isConnected = false;
@@ -52,7 +56,8 @@ public class TCPSocket implements ISocket{
 			}
 		}
 		try{
-			outputStream = new PrintWriter(TCPConn.getOutputStream(),true);
+			rawOutputStream = TCPConn.getOutputStream();
+			outputStream = new PrintWriter(rawOutputStream,true);
 			inputStream = new BufferedReader(new InputStreamReader(TCPConn.getInputStream()));
 			isConnected=true;
 			return TCPConn;
@@ -63,13 +68,51 @@ public class TCPSocket implements ISocket{
 		
 		}
 	
-	public void send_message(String buffer){
+	public synchronized void send_message(String buffer){
 		int len = (this.encode(buffer)).length;
 		String send_string = String.format("%010d", len) + " "+buffer;
 		outputStream.write(send_string);
 		outputStream.flush();
 	}
 	
+	// Binary frames get the same length prefix as the text messages
+	@Override
+	public synchronized void send_frame(byte[] frame){
+		try{
+			rawOutputStream.write(this.encode(String.format("%010d", frame.length) + " "));
+			rawOutputStream.write(frame);
+			rawOutputStream.flush();
+		}catch(Exception e){
+			System.out.println(this.nodename+ " could not send frame over TCP on port: "+ this.COMport + " Error: " +e);
+		}
+	}
+	
+	// The ROS node sends the offer right after accepting the connection. Without it the
+	// laser scans are sent as text as before.
+	@Override
+	public boolean negotiate_binary_laser(){
+		try{
+			TCPConn.setSoTimeout(2000);
+			String line = this.inputStream.readLine();
+			binaryLaser = line != null && line.trim().equals(BINARY_LASER_OFFER);
+		}catch(SocketTimeoutException e){
+			binaryLaser = false;
+		}catch(Exception e){
+			System.out.println(this.nodename+ " could not negotiate binary laser scans on port: "+ this.COMport + " Error: " +e);
+			binaryLaser = false;
+		}
+		try{
+			TCPConn.setSoTimeout(0);
+		}catch(Exception e){}
+		System.out.println(this.nodename + " sending laser scans as " + (binaryLaser ? "binary frames" : "text"));
+		return binaryLaser;
+	}
+	
+	@Override
+	public boolean isBinaryLaser(){
+		return binaryLaser;
+	}
+	
 	@Override
 	public String receive_message(){
 		String line;
@@ -21,6 +21,7 @@ public class UDPSocket implements ISocket{
 	int COMport;
     static BindException b;
     String nodename;
+    boolean binaryLaser = false;
 
 	
 	public UDPSocket(int port, String node_name) {
@@ -73,6 +74,8 @@ public class UDPSocket implements ISocket{
 		       		System.out.println( this.nodename+ "  did not receive any message in 3 seconds, shutting off");
 		       		break;
 		       	 }
+		        // The ROS laser scan node appends the offer to its reply when it accepts binary frames
+		        binaryLaser = s.trim().endsWith(BINARY_LASER_OFFER);
 		        udpConn.setSoTimeout(0);
 		        isConnected=true;
 			}
@@ -115,6 +118,31 @@ public class UDPSocket implements ISocket{
 			System.out.println( this.nodename+ " could not send package over UDP on port: "  + this.COMport + " error: " + e);
 		}
 	}
+    @Override
+    public void send_frame(byte[] frame)
+	{
+    	package_out.setData(frame);
+    	package_out.setLength(frame.length);
+     try {
+			udpConn.send(package_out);
+		} catch (Exception e) {
+			System.out.println( this.nodename+ " could not send frame over UDP on port: "  + this.COMport + " error: " + e);
+		}
+	}
+    
+    // Already done in connect, from the reply to the first package
+    @Override
+	public boolean negotiate_binary_laser()
+	{
+		return binaryLaser;
+	}
+    
+    @Override
+	public boolean isBinaryLaser()
+	{
+		return binaryLaser;
+	}
+    
     @Override
 	public String receive_message()
 	{
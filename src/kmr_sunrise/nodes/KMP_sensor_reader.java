@@ -39,6 +39,9 @@ public class KMP_sensor_reader extends Node{
 	public KMP_sensor_reader(int laserport, int odomport, String LaserConnectionType, String OdometryConnectionType) {
 		super(laserport, LaserConnectionType, odomport, OdometryConnectionType, "KMP sensor reader");
 		
+		if (isLaserSocketConnected()) {
+			laser_socket.negotiate_binary_laser();
+		}
 		if (!(isLaserSocketConnected())) {
 			Thread monitorLaserConnections = new MonitorLaserConnectionThread();
 			monitorLaserConnections.run();
@@ -70,6 +73,7 @@ public class KMP_sensor_reader extends Node{
 			while(!(isLaserSocketConnected()) && (!(closed))) {
 				createSocket("Laser");
 				if(isLaserSocketConnected()){
+					laser_socket.negotiate_binary_laser();
 					break;
 				}	
 				try {
@@ -18,6 +18,7 @@ package API_ROS2_Sunrise;
 import API_ROS2_Sunrise.ISocket;
 import API_ROS2_Sunrise.TCPSocket;
 import API_ROS2_Sunrise.UDPSocket;
+import API_ROS2_Sunrise.MultiplexedSocket;
 
 
 public abstract class Node extends Thread{
@@ -81,6 +82,9 @@ public abstract class Node extends Thread{
 		if (this.ConnectionType == "TCP") {
 			 this.socket = new TCPSocket(this.port, this.node_name);
 		}
+		else if (this.ConnectionType == "MUX") {
+			 this.socket = new MultiplexedSocket(this.port, this.node_name);
+		}
 		else {
 			this.socket = new UDPSocket(this.port, this.node_name);
 		}
@@ -90,6 +94,8 @@ public abstract class Node extends Thread{
 		if (Type=="Laser"){
 			if(LaserConnectionType == "TCP") {
 				this.laser_socket = new TCPSocket(KMP_laser_port, this.node_name);
+			}else if(LaserConnectionType == "MUX") {
+				this.laser_socket = new MultiplexedSocket(KMP_laser_port, this.node_name);
 			}else {
 				this.laser_socket = new UDPSocket(KMP_laser_port, this.node_name);
 			}
@@ -97,6 +103,8 @@ public abstract class Node extends Thread{
 			if(OdometryConnectionType == "TCP") {
 				this.odometry_socket = new TCPSocket(KMP_odometry_port, this.node_name);
 
+			}else if(OdometryConnectionType == "MUX") {
+				this.odometry_socket = new MultiplexedSocket(KMP_odometry_port, this.node_name);
 			}else {
 				this.odometry_socket = new UDPSocket(KMP_odometry_port, this.node_name);
 			}